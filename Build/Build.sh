@@ -11,6 +11,7 @@ nasm -felf32 'Source/Boot/Bootstrap.asm' -o 'Build/Output/Bootstrap.o'
 nasm -felf32 'Source/Boot/GDT.asm' -o 'Build/Output/Objs/GDT.o'
 nasm -felf32 'Source/Kernel/HAL/Interrupts/IRQs.asm' -o 'Build/Output/Objs/IRQs.o'
 nasm -felf32 'Source/Kernel/HAL/RealMode.asm' -o 'Build/Output/Objs/RealMode.o'
+nasm -felf32 'Source/Kernel/HAL/SMP.asm' -o 'Build/Output/Objs/SMPTrampoline.o'
 
 # Entry C++ file
 i686-elf-g++ -w -IInclude -c "Source/Boot/Entry.cpp" -o "Build/Output/Objs/Entry.o" -fno-use-cxa-atexit -ffreestanding -O2 -Wall -Wextra -fno-exceptions -fno-rtti -Wno-write-strings -Wno-unused-variable
@@ -132,4 +133,4 @@ grub-mkrescue -o  'PMOS.iso' 'Build/Output/isodir'
 cp 'PMOS.iso' 'PMOS.img'
 
 # Run QEMU instance of operating system
-qemu-system-i386 -m 256M -vga std -hda 'Disk.img' -cdrom 'PMOS.iso' -serial stdio -boot d -soundhw ac97 -enable-kvm -rtc base=localtime -cpu host
\ No newline at end of file
+qemu-system-i386 -m 256M -vga std -hda 'Disk.img' -cdrom 'PMOS.iso' -serial stdio -smp 4 -boot d -soundhw ac97 -enable-kvm -rtc base=localtime -cpu host
\ No newline at end of file
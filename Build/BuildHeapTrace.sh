@@ -0,0 +1,8 @@
+rm -r "HeapTrace/bin"
+mkdir "HeapTrace/bin"
+
+c++ -IHeapTrace/Include -c "HeapTrace/Source/Main.cpp" -o "HeapTrace/bin/Main.o"
+c++ -IHeapTrace/Include -c "HeapTrace/Source/Trace.cpp" -o "HeapTrace/bin/Trace.o"
+c++ -IHeapTrace/Include -c "HeapTrace/Source/Analysis.cpp" -o "HeapTrace/bin/Analysis.o"
+c++ -IHeapTrace/Include -c "HeapTrace/Source/Replay.cpp" -o "HeapTrace/bin/Replay.o"
+c++ -o "./HeapTrace/bin/HeapTrace" "HeapTrace/bin/Main.o" "HeapTrace/bin/Trace.o" "HeapTrace/bin/Analysis.o" "HeapTrace/bin/Replay.o"
@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "Trace.hpp"
+
+namespace Analysis
+{
+	void Summary(std::vector<TraceRecord>& records, TraceInfo& info);
+	void Leaks(std::vector<TraceRecord>& records, size_t max_rows);
+	void Fragmentation(std::vector<TraceRecord>& records, uint32_t interval_ms);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "Trace.hpp"
+
+// an allocator design driven by a trace, addresses are offsets into a flat address space
+class ReplayModel
+{
+	public:
+		uint64_t Top = 0;
+		uint64_t Peak = 0;
+
+	public:
+		virtual ~ReplayModel() { }
+		virtual const char* GetName() = 0;
+		virtual uint64_t Allocate(uint32_t size) = 0;
+		virtual void Free(uint64_t addr) = 0;
+};
+
+// address ordered free list with coalescing, picks the first or the smallest block that fits
+class FitModel : public ReplayModel
+{
+	private:
+		std::map<uint64_t, uint64_t> FreeBlocks;
+		std::map<uint64_t, uint64_t> Used;
+		uint32_t Align;
+		bool BestFit;
+
+	public:
+		FitModel(uint32_t align, bool best_fit);
+		const char* GetName();
+		uint64_t Allocate(uint32_t size);
+		void Free(uint64_t addr);
+};
+
+// power of two size classes with per class free lists and no coalescing
+class SegregatedModel : public ReplayModel
+{
+	private:
+		std::vector<uint64_t> FreeLists[32];
+		std::map<uint64_t, uint32_t> Used;
+
+	public:
+		const char* GetName();
+		uint64_t Allocate(uint32_t size);
+		void Free(uint64_t addr);
+};
+
+// the kernel heap - slab classes up to 2016 bytes on 4 KB slabs, page rounded first fit above that
+class KernelModel : public ReplayModel
+{
+	private:
+		typedef struct { uint64_t Base; uint32_t Used; std::vector<uint64_t> Free; uint32_t Bump; } Slab;
+		FitModel Pages;
+		std::map<uint64_t, Slab> Slabs[14];
+		std::map<uint64_t, int> Objects;
+
+	public:
+		KernelModel();
+		const char* GetName();
+		uint64_t Allocate(uint32_t size);
+		void Free(uint64_t addr);
+};
+
+namespace Replay
+{
+	void Run(std::vector<TraceRecord>& records);
+}
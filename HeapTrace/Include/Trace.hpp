@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// must match MM_TRACE_MAGIC and the structures in Kernel/Services/MemoryMgr.hpp
+#define TRACE_MAGIC 0x43525448
+
+enum class TraceOp : uint8_t
+{
+	Allocate = 1,
+	Free     = 2,
+};
+
+typedef struct
+{
+	uint32_t Time;
+	uint32_t Pointer;
+	uint32_t Size;
+	uint32_t Caller;
+	uint8_t  Op;
+	uint8_t  Type;
+	uint16_t Reserved;
+} __attribute__((packed)) TraceRecord;
+
+typedef struct
+{
+	uint32_t Magic;
+	uint16_t Count;
+	uint16_t Dropped;
+} __attribute__((packed)) TraceFrame;
+
+typedef struct
+{
+	size_t Frames;
+	size_t BadFrames;
+	size_t Dropped;
+	size_t SkippedBytes;
+} TraceInfo;
+
+namespace Trace
+{
+	bool Load(std::string path, std::vector<TraceRecord>& records, TraceInfo& info);
+	const char* GetTypeName(uint8_t type);
+}
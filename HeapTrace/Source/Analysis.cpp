@@ -0,0 +1,112 @@
+#include "Analysis.hpp"
+#include <stdio.h>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+namespace Analysis
+{
+	void Summary(std::vector<TraceRecord>& records, TraceInfo& info)
+	{
+		size_t allocs = 0, frees = 0;
+		uint64_t bytes = 0;
+		for (TraceRecord& rec : records)
+		{
+			if (rec.Op == (uint8_t)TraceOp::Allocate) { allocs++; bytes += rec.Size; }
+			else { frees++; }
+		}
+
+		printf("FRAMES        %zu (%zu bad, %zu bytes of other serial output)\n", info.Frames, info.BadFrames, info.SkippedBytes);
+		printf("RECORDS       %zu (%zu dropped by the kernel)\n", records.size(), info.Dropped);
+		printf("ALLOCATIONS   %zu (%llu bytes)\n", allocs, (unsigned long long)bytes);
+		printf("FREES         %zu\n", frees);
+		if (!records.empty()) { printf("DURATION      %u ms\n", records.back().Time - records.front().Time); }
+		if (info.Dropped > 0 || info.BadFrames > 0) { printf("warning: records are missing, leak and replay results are approximate\n"); }
+	}
+
+	// blocks still live at the end of the trace, grouped by the code that allocated them
+	void Leaks(std::vector<TraceRecord>& records, size_t max_rows)
+	{
+		std::unordered_map<uint32_t, TraceRecord> live;
+		size_t unmatched = 0;
+		for (TraceRecord& rec : records)
+		{
+			if (rec.Op == (uint8_t)TraceOp::Allocate) { live[rec.Pointer] = rec; }
+			else if (live.erase(rec.Pointer) == 0) { unmatched++; }
+		}
+
+		typedef struct { uint32_t Caller; uint8_t Type; size_t Count; uint64_t Bytes; uint32_t First; } LeakSite;
+		std::map<uint32_t, LeakSite> sites;
+		for (auto& pair : live)
+		{
+			TraceRecord& rec = pair.second;
+			LeakSite& site = sites[rec.Caller];
+			if (site.Count == 0) { site.Caller = rec.Caller; site.Type = rec.Type; site.First = rec.Time; }
+			site.Count++;
+			site.Bytes += rec.Size;
+			if (rec.Time < site.First) { site.First = rec.Time; }
+		}
+
+		std::vector<LeakSite> sorted;
+		for (auto& pair : sites) { sorted.push_back(pair.second); }
+		std::sort(sorted.begin(), sorted.end(), [](const LeakSite& a, const LeakSite& b) { return a.Bytes > b.Bytes; });
+
+		printf("%zu live blocks at %zu call sites, %zu frees of unknown blocks\n", live.size(), sorted.size(), unmatched);
+		printf("CALLER        TYPE      COUNT     BYTES       FIRST MS\n");
+		for (size_t i = 0; i < sorted.size() && i < max_rows; i++)
+		{
+			LeakSite& site = sorted[i];
+			printf("0x%08X    %-8s  %-8zu  %-10llu  %u\n", site.Caller, Trace::GetTypeName(site.Type), site.Count, (unsigned long long)site.Bytes, site.First);
+		}
+		if (!sorted.empty()) { printf("resolve callers with: addr2line -f -C -e Build/Output/Kernel.bin <address>\n"); }
+	}
+
+	// page level fragmentation - how much of the free space inside the used span is usable as one block
+	void Fragmentation(std::vector<TraceRecord>& records, uint32_t interval_ms)
+	{
+		std::map<uint32_t, uint32_t> pages;
+		std::unordered_map<uint32_t, uint32_t> sizes;
+		uint64_t live = 0;
+		uint32_t next = records.empty() ? 0 : records.front().Time;
+
+		printf("TIME MS     LIVE BYTES  PAGE BLOCKS  SPAN KB     FREE KB     LARGEST KB  FRAG\n");
+		for (size_t i = 0; i <= records.size(); i++)
+		{
+			bool last = (i == records.size());
+			if (last || records[i].Time >= next)
+			{
+				uint32_t lo = 0, hi = 0, largest = 0;
+				uint64_t used = 0;
+				for (auto& block : pages)
+				{
+					if (hi == 0) { lo = block.first; }
+					else if (block.first > hi) { largest = std::max(largest, block.first - hi); }
+					hi = std::max(hi, block.first + block.second);
+					used += block.second;
+				}
+
+				uint64_t span = hi - lo, free = span - used;
+				double frag = (free == 0) ? 0.0 : (1.0 - ((double)largest / (double)free)) * 100.0;
+				printf("%-10u  %-10llu  %-11zu  %-10llu  %-10llu  %-10u  %.1f%%\n", last ? (records.empty() ? 0 : records.back().Time) : next, (unsigned long long)live, pages.size(), (unsigned long long)(span / 1024), (unsigned long long)(free / 1024), largest / 1024, frag);
+				if (last) { break; }
+				while (next <= records[i].Time) { next += interval_ms; }
+			}
+
+			TraceRecord& rec = records[i];
+			if (rec.Op == (uint8_t)TraceOp::Allocate)
+			{
+				sizes[rec.Pointer] = rec.Size;
+				live += rec.Size;
+				if ((rec.Pointer & 0xFFF) == 0) { pages[rec.Pointer] = (rec.Size + 0xFFF) & ~0xFFF; }
+			}
+			else
+			{
+				auto it = sizes.find(rec.Pointer);
+				if (it == sizes.end()) { continue; }
+				live -= it->second;
+				sizes.erase(it);
+				pages.erase(rec.Pointer);
+			}
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Trace.hpp"
+#include "Analysis.hpp"
+#include "Replay.hpp"
+
+// decodes heap traces captured from COM1, e.g. qemu ... -serial file:heap.trace after running 'heaptrace on' in the kernel
+void PrintUsage()
+{
+	printf("PurpleMoon Heap Trace Tool\n");
+	printf("usage: HeapTrace [capture] [command]\n");
+	printf("  summary              record and frame counts (default)\n");
+	printf("  leaks [rows]         blocks still live at the end, grouped by caller\n");
+	printf("  frag [interval_ms]   page fragmentation over time\n");
+	printf("  replay               run the trace against candidate allocator designs\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) { PrintUsage(); return 1; }
+
+	std::vector<TraceRecord> records;
+	TraceInfo info;
+	if (!Trace::Load(argv[1], records, info)) { printf("unable to open '%s'\n", argv[1]); return 1; }
+
+	std::string cmd = (argc >= 3) ? argv[2] : "summary";
+	if (cmd == "summary") { Analysis::Summary(records, info); }
+	else if (cmd == "leaks") { Analysis::Leaks(records, (argc >= 4) ? atoi(argv[3]) : 20); }
+	else if (cmd == "frag") { Analysis::Fragmentation(records, (argc >= 4) ? atoi(argv[3]) : 1000); }
+	else if (cmd == "replay") { Replay::Run(records); }
+	else { PrintUsage(); return 1; }
+	return 0;
+}
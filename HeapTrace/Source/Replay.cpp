@@ -0,0 +1,196 @@
+#include "Replay.hpp"
+#include <stdio.h>
+#include <unordered_map>
+#include <algorithm>
+
+// same classes as InitializeSlabs in the kernel
+static const uint32_t SlabSizes[14] = { 16, 32, 48, 64, 96, 128, 192, 256, 336, 448, 672, 1008, 1344, 2016 };
+
+FitModel::FitModel(uint32_t align, bool best_fit) { Align = align; BestFit = best_fit; }
+
+const char* FitModel::GetName() { return BestFit ? "best fit" : "first fit"; }
+
+uint64_t FitModel::Allocate(uint32_t size)
+{
+	uint64_t length = ((uint64_t)size + Align - 1) & ~((uint64_t)Align - 1);
+	auto pick = FreeBlocks.end();
+	for (auto it = FreeBlocks.begin(); it != FreeBlocks.end(); it++)
+	{
+		if (it->second < length) { continue; }
+		if (pick == FreeBlocks.end() || it->second < pick->second) { pick = it; }
+		if (!BestFit || it->second == length) { break; }
+	}
+
+	uint64_t addr;
+	if (pick != FreeBlocks.end())
+	{
+		addr = pick->first;
+		uint64_t rest = pick->second - length;
+		FreeBlocks.erase(pick);
+		if (rest > 0) { FreeBlocks[addr + length] = rest; }
+	}
+	else
+	{
+		// nothing fits, grow the heap
+		addr = Top;
+		Top += length;
+		Peak = std::max(Peak, Top);
+	}
+
+	Used[addr] = length;
+	return addr;
+}
+
+void FitModel::Free(uint64_t addr)
+{
+	auto it = Used.find(addr);
+	if (it == Used.end()) { return; }
+	uint64_t length = it->second;
+	Used.erase(it);
+
+	// merge with the free neighbours on both sides
+	auto next = FreeBlocks.find(addr + length);
+	if (next != FreeBlocks.end()) { length += next->second; FreeBlocks.erase(next); }
+	auto prev = FreeBlocks.lower_bound(addr);
+	if (prev != FreeBlocks.begin())
+	{
+		prev--;
+		if (prev->first + prev->second == addr) { addr = prev->first; length += prev->second; FreeBlocks.erase(prev); }
+	}
+
+	// free space at the top goes back to the heap
+	if (addr + length == Top) { Top = addr; return; }
+	FreeBlocks[addr] = length;
+}
+
+const char* SegregatedModel::GetName() { return "pow2 segregated"; }
+
+uint64_t SegregatedModel::Allocate(uint32_t size)
+{
+	uint32_t cls = 4;
+	while ((1ull << cls) < size) { cls++; }
+
+	uint64_t addr;
+	if (!FreeLists[cls].empty()) { addr = FreeLists[cls].back(); FreeLists[cls].pop_back(); }
+	else
+	{
+		addr = Top;
+		Top += 1ull << cls;
+		Peak = std::max(Peak, Top);
+	}
+
+	Used[addr] = cls;
+	return addr;
+}
+
+void SegregatedModel::Free(uint64_t addr)
+{
+	auto it = Used.find(addr);
+	if (it == Used.end()) { return; }
+	FreeLists[it->second].push_back(addr);
+	Used.erase(it);
+}
+
+KernelModel::KernelModel() : Pages(4096, false) { }
+
+const char* KernelModel::GetName() { return "kernel slab+pages"; }
+
+uint64_t KernelModel::Allocate(uint32_t size)
+{
+	if (size > 2016)
+	{
+		uint64_t addr = Pages.Allocate(size);
+		Top = Pages.Top;
+		Peak = Pages.Peak;
+		return addr;
+	}
+
+	int cls = 0;
+	while (SlabSizes[cls] < size) { cls++; }
+	uint32_t cap = (4096 - 32) / (SlabSizes[cls] + 1);
+	uint32_t offset = (32 + cap + 15) & ~15u;
+	while (offset + (cap * SlabSizes[cls]) > 4096) { cap--; offset = (32 + cap + 15) & ~15u; }
+
+	// first slab with room, otherwise a new one
+	Slab* slab = nullptr;
+	for (auto& pair : Slabs[cls]) { if (pair.second.Used < cap) { slab = &pair.second; break; } }
+	if (slab == nullptr)
+	{
+		uint64_t base = Pages.Allocate(4096);
+		Top = Pages.Top;
+		Peak = Pages.Peak;
+		slab = &Slabs[cls][base];
+		slab->Base = base;
+		slab->Used = 0;
+		slab->Bump = 0;
+	}
+
+	uint64_t addr;
+	if (!slab->Free.empty()) { addr = slab->Free.back(); slab->Free.pop_back(); }
+	else { addr = slab->Base + offset + (slab->Bump++ * SlabSizes[cls]); }
+	slab->Used++;
+	Objects[addr] = cls;
+	return addr;
+}
+
+void KernelModel::Free(uint64_t addr)
+{
+	auto it = Objects.find(addr);
+	if (it == Objects.end()) { Pages.Free(addr); Top = Pages.Top; return; }
+
+	int cls = it->second;
+	Objects.erase(it);
+	auto slab = Slabs[cls].find(addr & ~0xFFFull);
+	if (slab == Slabs[cls].end()) { return; }
+	slab->second.Free.push_back(addr);
+	slab->second.Used--;
+
+	// empty slabs go back to the page heap, except the last one of a class
+	if (slab->second.Used == 0 && Slabs[cls].size() > 1)
+	{
+		Pages.Free(slab->first);
+		Top = Pages.Top;
+		Slabs[cls].erase(slab);
+	}
+}
+
+namespace Replay
+{
+	void Run(std::vector<TraceRecord>& records)
+	{
+		FitModel first_fit(16, false), best_fit(16, true);
+		SegregatedModel segregated;
+		KernelModel kernel;
+		ReplayModel* models[] = { &kernel, &first_fit, &best_fit, &segregated };
+
+		// peak of the bytes actually requested, the lower bound for every design
+		std::unordered_map<uint32_t, uint32_t> sizes;
+		uint64_t live = 0, peak_live = 0;
+		for (TraceRecord& rec : records)
+		{
+			if (rec.Op == (uint8_t)TraceOp::Allocate) { sizes[rec.Pointer] = rec.Size; live += rec.Size; peak_live = std::max(peak_live, live); }
+			else { auto it = sizes.find(rec.Pointer); if (it != sizes.end()) { live -= it->second; sizes.erase(it); } }
+		}
+
+		printf("peak requested bytes: %llu\n", (unsigned long long)peak_live);
+		printf("MODEL               PEAK KB     FINAL KB    EFFICIENCY\n");
+		for (ReplayModel* model : models)
+		{
+			std::unordered_map<uint32_t, uint64_t> map;
+			for (TraceRecord& rec : records)
+			{
+				if (rec.Op == (uint8_t)TraceOp::Allocate) { map[rec.Pointer] = model->Allocate(rec.Size); }
+				else
+				{
+					auto it = map.find(rec.Pointer);
+					if (it == map.end()) { continue; }
+					model->Free(it->second);
+					map.erase(it);
+				}
+			}
+
+			double efficiency = (model->Peak == 0) ? 0.0 : ((double)peak_live / (double)model->Peak) * 100.0;
+			printf("%-18s  %-10llu  %-10llu  %.1f%%\n", model->GetName(), (unsigned long long)(model->Peak / 1024), (unsigned long long)(model->Top / 1024), efficiency);
+		}
+	}
+}
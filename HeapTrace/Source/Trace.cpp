@@ -0,0 +1,62 @@
+#include "Trace.hpp"
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+namespace Trace
+{
+	// AllocationType names, in kernel order
+	const char* TypeNames[] = { "UNUSED", "DEFAULT", "STRING", "BITMAP", "SYSTEM", "THREAD", "STACK", "FRAMEBUF", "PCI", "VMRAM", "UI", "CACHED", "ARENA" };
+
+	const char* GetTypeName(uint8_t type)
+	{
+		if (type >= sizeof(TypeNames) / sizeof(TypeNames[0])) { return "?"; }
+		return TypeNames[type];
+	}
+
+	// the capture is a raw COM1 log, so frames are found by magic and kept only if their checksum matches
+	bool Load(std::string path, std::vector<TraceRecord>& records, TraceInfo& info)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) { return false; }
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		info = { 0, 0, 0, 0 };
+		std::unordered_map<uint32_t, uint8_t> types;
+		uint8_t freed = 0;
+		size_t pos = 0;
+		while (pos + sizeof(TraceFrame) <= data.size())
+		{
+			TraceFrame* frame = (TraceFrame*)&data[pos];
+			if (frame->Magic != TRACE_MAGIC) { pos++; info.SkippedBytes++; continue; }
+
+			size_t length = sizeof(TraceFrame) + (frame->Count * sizeof(TraceRecord)) + 4;
+			if (pos + length > data.size()) { info.BadFrames++; break; }
+
+			TraceRecord* recs = (TraceRecord*)&data[pos + sizeof(TraceFrame)];
+			uint32_t sum = 0;
+			for (size_t i = 0; i < frame->Count * sizeof(TraceRecord) / 4; i++) { sum += ((uint32_t*)recs)[i]; }
+			uint32_t expected = *(uint32_t*)&data[pos + length - 4];
+			if (sum != expected) { pos++; info.BadFrames++; continue; }
+
+			for (size_t i = 0; i < frame->Count; i++)
+			{
+				TraceRecord rec = recs[i];
+
+				// frees are tagged with the type of the block, and the allocation half of a realloc keeps the type of the block it replaced
+				if (rec.Op == (uint8_t)TraceOp::Free) { freed = types[rec.Pointer]; types.erase(rec.Pointer); rec.Type = freed; }
+				else
+				{
+					if (rec.Type == 0) { rec.Type = freed; }
+					types[rec.Pointer] = rec.Type;
+				}
+				records.push_back(rec);
+			}
+
+			info.Frames++;
+			info.Dropped += frame->Dropped;
+			pos += length;
+		}
+		return true;
+	}
+}
@@ -4,12 +4,19 @@
 #include <Kernel/Lib/Math.hpp>
 #include <Kernel/Lib/Map.hpp>
 #include <Kernel/Lib/Memory.hpp>
+#include <Kernel/Lib/Sync.hpp>
 #include <Kernel/HAL/Ports.hpp>
 #include <Kernel/HAL/Serial.hpp>
 #include <Kernel/HAL/Multiboot.hpp>
 #include <Kernel/HAL/PIT.hpp>
+#include <Kernel/HAL/APICTimer.hpp>
 #include <Kernel/HAL/RTC.hpp>
+#include <Kernel/HAL/Clock.hpp>
 #include <Kernel/HAL/CPU.hpp>
+#include <Kernel/HAL/Paging.hpp>
+#include <Kernel/HAL/ACPI.hpp>
+#include <Kernel/HAL/APIC.hpp>
+#include <Kernel/HAL/SMP.hpp>
 #include <Kernel/HAL/PCI.hpp>
 #include <Kernel/HAL/Thread.hpp>
 #include <Kernel/HAL/RealMode.hpp>
@@ -24,6 +31,10 @@
 #include <Kernel/Core/Service.hpp>
 #include <Kernel/Core/Debug.hpp>
 #include <Kernel/Services/MemoryMgr.hpp>
+#include <Kernel/Services/FrameMgr.hpp>
+#include <Kernel/Services/TimerMgr.hpp>
+#include <Kernel/Services/WorkMgr.hpp>
+#include <Kernel/Services/EventLoop.hpp>
 #include <Kernel/Services/ServiceMgr.hpp>
 #include <Kernel/Services/ThreadMgr.hpp>
 #include <Kernel/Services/Terminal.hpp>
@@ -53,12 +64,23 @@ namespace PMOS
         extern HAL::SerialController Serial;
         extern HAL::PITController PIT;
         extern HAL::RTCController RTC;
+        extern HAL::ClockController Clock;
         extern HAL::PCIBusController PCI;
         extern HAL::CPUManager CPU;
+        extern HAL::PagingManager Paging;
+        extern HAL::ACPIManager ACPI;
+        extern HAL::APICController APIC;
+        extern HAL::APICTimerController APICTimer;
+        extern HAL::SMPManager SMP;
 
         // services
         extern Services::ServiceManager ServiceMgr;
+        extern Services::FrameManager FrameMgr;
         extern Services::MemoryManager MemoryMgr;
+        extern Services::TimerManager TimerMgr;
+        extern Services::WorkManager WorkMgr;
+        extern Services::EventLoop MainLoop;
+        extern Services::EventLoop UILoop;
         extern Services::TextModeTerminal* Terminal;
         extern Services::CommandLine* CLI;
         extern Threading::ThreadManager ThreadMgr;
@@ -85,8 +107,7 @@ namespace PMOS
         // methods
         void BootStage1();
         void BootStage2();
-        void Run();
-        void PITCallback(uint* regs);
+        void TimerCallback(uint* regs);
         void ThreadCallback(Threading::Thread* t);
         void IdleThreadCallback(Threading::Thread* t);
         void FetchMultiboot();
@@ -0,0 +1,124 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+
+// limits on what is kept from the madt
+#define ACPI_MAX_PROCESSORS 16
+#define ACPI_MAX_OVERRIDES  16
+
+// madt entry types
+#define MADT_LOCAL_APIC 0
+#define MADT_IO_APIC    1
+#define MADT_OVERRIDE   2
+
+// interrupt override flags - polarity in bits 0-1, trigger mode in bits 2-3
+#define MADT_ACTIVE_LOW 0x02
+#define MADT_LEVEL      0x08
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        typedef struct
+        {
+            char  Signature[8];
+            byte  Checksum;
+            char  OEMID[6];
+            byte  Revision;
+            uint  RSDT;
+        } ATTR_PACK ACPIRSDP;
+
+        typedef struct
+        {
+            char  Signature[4];
+            uint  Length;
+            byte  Revision;
+            byte  Checksum;
+            char  OEMID[6];
+            char  OEMTableID[8];
+            uint  OEMRevision;
+            uint  CreatorID;
+            uint  CreatorRevision;
+        } ATTR_PACK ACPIHeader;
+
+        // multiple apic description table, variable length entries follow the header
+        typedef struct
+        {
+            ACPIHeader Header;
+            uint       LocalAPIC;
+            uint       Flags;
+        } ATTR_PACK ACPIMADT;
+
+        typedef struct
+        {
+            byte Type;
+            byte Length;
+        } ATTR_PACK MADTEntry;
+
+        typedef struct
+        {
+            MADTEntry Entry;
+            byte      ProcessorID;
+            byte      APICID;
+            uint      Flags;
+        } ATTR_PACK MADTLocalAPIC;
+
+        typedef struct
+        {
+            MADTEntry Entry;
+            byte      IOAPICID;
+            byte      Reserved;
+            uint      Address;
+            uint      GSIBase;
+        } ATTR_PACK MADTIOAPIC;
+
+        typedef struct
+        {
+            MADTEntry Entry;
+            byte      Bus;
+            byte      Source;
+            uint      GSI;
+            ushort    Flags;
+        } ATTR_PACK MADTOverride;
+
+        // isa irq that is wired to a different io apic input than its number
+        typedef struct
+        {
+            byte   Source;
+            uint   GSI;
+            ushort Flags;
+        } ATTR_PACK IRQOverride;
+
+        class ACPIManager
+        {
+            public:
+                uint LocalAPICAddress;
+                uint IOAPICAddress;
+                uint IOAPICBase;
+                byte IOAPICID;
+
+            private:
+                byte        APICIDs[ACPI_MAX_PROCESSORS];
+                uint        ProcessorCount;
+                IRQOverride Overrides[ACPI_MAX_OVERRIDES];
+                uint        OverrideCount;
+                bool        Available;
+
+            public:
+                void Initialize();
+                void Print(DebugMode mode);
+                bool IsAvailable();
+
+            public:
+                uint GetProcessorCount();
+                byte GetAPICID(uint index);
+                uint GetGSI(byte irq, ushort* flags);
+
+            private:
+                ACPIRSDP* FindRSDP();
+                ACPIRSDP* ScanRSDP(uint start, uint length);
+                bool      Validate(void* table, uint length);
+                void      ParseMADT(ACPIMADT* madt);
+        };
+    }
+}
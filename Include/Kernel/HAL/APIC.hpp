@@ -0,0 +1,83 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+
+// local apic registers, offsets from its mmio base
+#define LAPIC_ID        0x020
+#define LAPIC_VERSION   0x030
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_LDR       0x0D0
+#define LAPIC_DFR       0x0E0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_ESR       0x280
+#define LAPIC_ICR_LOW   0x300
+#define LAPIC_ICR_HIGH  0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LINT0     0x350
+#define LAPIC_LINT1     0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+// interrupt command register fields
+#define ICR_FIXED     0x00000
+#define ICR_NMI       0x00400
+#define ICR_INIT      0x00500
+#define ICR_STARTUP   0x00600
+#define ICR_PENDING   0x01000
+#define ICR_ASSERT    0x04000
+#define ICR_LEVEL     0x08000
+#define ICR_OTHERS    0xC0000
+
+// lvt mask bit and software enable bit of the spurious vector register
+#define APIC_MASKED   0x10000
+#define APIC_ENABLE   0x100
+
+// timer lvt mode bit, and the divide configuration for a division by 16
+#define APIC_TIMER_PERIODIC 0x20000
+#define APIC_TIMER_DIV16    0x03
+
+// io apic registers, reached through the select and window pair
+#define IOAPIC_SELECT 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_VER    0x01
+#define IOAPIC_REDIR  0x10
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        class APICController
+        {
+            private:
+                volatile uint* LocalBase;
+                volatile uint* IOBase;
+                uint           Redirections;
+                bool           Enabled;
+
+            public:
+                void Initialize();
+                void InitializeLocal();
+                bool IsEnabled();
+                uint GetID();
+                void EOI();
+
+            public:
+                void SendIPI(uint apic, byte vector);
+                void BroadcastIPI(byte vector);
+                void BroadcastNMI();
+                void SendInit(uint apic);
+                void SendStartup(uint apic, uint addr);
+
+            public:
+                uint Read(uint reg);
+                void Write(uint reg, uint value);
+
+            private:
+                uint ReadIO(uint reg);
+                void WriteIO(uint reg, uint value);
+                void WaitICR();
+        };
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/HAL/Interrupts/ISR.hpp>
+
+// length of the pit countdown the local apic timer is calibrated against
+#define APIC_TIMER_CALIBRATE_MS 10
+
+// longest idle countdown in milliseconds, the clock only catches up once it ends
+#define APIC_TIMER_ONESHOT_MAX 1000
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // what the timer of one processor is doing, kept in its processor block
+        enum class TimerMode : byte
+        {
+            Periodic,
+            OneShot,
+            Stopped,
+        };
+
+        // per processor tick from the local apic timer, the boot processor's tick also keeps the time for everyone
+        // without a local apic the pit takes over as a plain periodic tick on the boot processor
+        class APICTimerController
+        {
+            private:
+                uint Frequency;
+                uint CountsPerMS;
+                uint Period;
+                bool Enabled;
+
+            private:
+                uint Milliseconds;
+                ulong TotalMilliseconds;
+                uint MillisTick;
+                uint Ticks;
+                uint Residual;
+
+            public:
+                ISR Callback;
+
+            public:
+                void Initialize(uint freq, ISR callback);
+                void InitializeLocal();
+                void CalculateMilliseconds();
+
+            public:
+                void SetOneShot(uint ms);
+                void Stop();
+                void Resume();
+
+            public:
+                bool IsEnabled();
+                uint GetFrequency();
+                uint GetCountsPerMS();
+                uint GetMilliseconds();
+                ulong GetTotalMilliseconds();
+                uint GetTicks();
+
+            private:
+                bool Calibrate();
+                void SetPeriodic();
+                void AddTicks(uint ticks);
+        };
+    }
+}
@@ -1,13 +1,16 @@
 #pragma once
 #include <Kernel/Lib/Types.hpp>
 
+// length of the pit countdown the time stamp counter is calibrated against
+#define TSC_CALIBRATE_MS 50
+
 namespace PMOS
 {
     namespace HAL
     {
         typedef struct
         {
-            bool PSE, PAE, APIC, MTRR;
+            bool PSE, PAE, APIC, MTRR, FXSR, InvariantTSC;
         } ATTR_PACK CPUFeatures;
 
         typedef struct
@@ -25,8 +28,17 @@ namespace PMOS
                 CPUInstructions Instructions;
                 bool X64Compatible;
 
+            private:
+                // time stamp counter rate in khz, zero until calibrated
+                uint TSCFrequency;
+
             public:
                 void Detect();
+                void CalibrateTSC();
+                uint ReadTSC();
+                ulonglong ReadCycles();
+                uint GetTSCFrequency();
+                bool EnableSSE();
 
             private:
                 void GetCPUInfo(uint reg, uint* eax, uint* ebx, uint* ecx, uint* edx);
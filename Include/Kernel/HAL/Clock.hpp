@@ -0,0 +1,35 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+
+#define CLOCK_NS_PER_US  1000ULL
+#define CLOCK_NS_PER_MS  1000000ULL
+#define CLOCK_NS_PER_SEC 1000000000ULL
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // monotonic nanoseconds since boot from the time stamp counter, safe and cheap to read from anywhere - wall time is this plus an offset taken once from the rtc
+        class ClockController
+        {
+            private:
+                ulonglong Base;
+                uint      Mult;
+                uint      Shift;
+                bool      TSC;
+                ulonglong WallOffset;
+
+            public:
+                void Initialize();
+                void SetWallTime(uint seconds);
+
+            public:
+                ulonglong GetNanoseconds();
+                ulonglong GetMicroseconds();
+                ulonglong GetMilliseconds();
+                ulonglong GetWallNanoseconds();
+                uint GetWallSeconds();
+                bool IsPrecise();
+        };
+    }
+}
@@ -50,6 +50,7 @@ namespace PMOS
                     void Start() override;
                     void Stop() override;
                     void Handle(byte key);
+                    void UpdateKeymap(byte key);
                     void SetStream(Stream* stream);
 
                 public:
@@ -61,7 +62,6 @@ namespace PMOS
 
                 private:
                     void ClearKeymap();
-                    void UpdateKeymap();
             };
         }
     }
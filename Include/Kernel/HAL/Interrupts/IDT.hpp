@@ -22,5 +22,6 @@ extc
     } ATTR_PACK IDTRegister;
 
     void IDTSetGate(int n, uint handler);
+    void IDTSetTaskGate(int n, ushort selector);
     void IDTSet();
 }
\ No newline at end of file
@@ -52,6 +52,11 @@ extc
     extern void irq13();
     extern void irq14();
     extern void irq15();
+    extern void irq_yield();
+    extern void irq_schedule();
+    extern void irq_flush();
+    extern void irq_timer();
+    extern void irq_spurious();
     extern void syscall();
 
     #define IRQ0 32
@@ -71,6 +76,15 @@ extc
     #define IRQ14 46
     #define IRQ15 47
 
+    // software interrupt a thread raises to give up the cpu, not routed through the pic
+    #define IRQ_YIELD 0x81
+
+    // vectors the local apics send each other and their timers raise, the spurious vector is never acknowledged
+    #define IRQ_SCHEDULE 0xF0
+    #define IRQ_FLUSH    0xF1
+    #define IRQ_TIMER    0xF2
+    #define IRQ_SPURIOUS 0xFF
+
     // structure for managing protected mode registers
     typedef struct
     {
@@ -103,6 +117,7 @@ namespace PMOS
                 void Unregister(byte irq);
                 void EnableInterrupts();
                 void DisableInterrupts();
+                bool InInterrupt();
         };
     }
 }
\ No newline at end of file
@@ -2,17 +2,22 @@
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/HAL/Interrupts/ISR.hpp>
 
+// pit input clock in hz
+#define PIT_CLOCK 1193180
+
+// longest countdown channel 2 can time, the counter is 16 bits wide
+#define PIT_COUNTDOWN_MAX 54
+
 namespace PMOS
 {
     namespace HAL
     {
+        // only used to calibrate the other clocks against, and as the tick on machines without a local apic
         class PITController
         {
             private:
                 uint Frequency;
-                uint Milliseconds;
-                ulong TotalMilliseconds;
-                uint MillisTick;
+                uint Divisor;
 
             public:
                 ISR Callback;
@@ -20,12 +25,13 @@ namespace PMOS
             public:
                 void Initialize(uint freq, ISR callback);
                 void Disable();
-                void CalculateMilliseconds();
+
+            public:
+                void StartCountdown(uint ms);
+                bool CountdownExpired();
 
             public:
                 uint GetFrequency();
-                uint GetMilliseconds();
-                ulong GetTotalMilliseconds();
         };
     }
-}
\ No newline at end of file
+}
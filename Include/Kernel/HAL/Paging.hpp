@@ -0,0 +1,102 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
+
+#define PG_SIZE 0x1000
+
+// thread stacks are reserved in this virtual window and committed a page at a time on first touch
+#define PG_STACK_BASE  0xD0000000
+#define PG_STACK_SIZE  0x8000000
+#define PG_STACK_PAGES (PG_STACK_SIZE / PG_SIZE)
+
+// page fault handler task stack
+#define PG_FAULT_STACK 0x4000
+
+// frames each processor keeps for committing stack pages on a fault, topped up on every tick
+#define PG_FRAME_RESERVE 8
+
+// gdt selectors of the task state segments
+#define TSS_KERNEL 0x18
+#define TSS_FAULT  0x20
+
+// page entry flags
+#define PG_PRESENT      0x01
+#define PG_WRITE        0x02
+#define PG_WRITETHROUGH 0x08
+#define PG_NOCACHE      0x10
+#define PG_LARGE        0x80
+
+// software bit of a stack page entry - unmapped, but its frame is kept until every processor dropped it from its tlb
+#define PG_RETIRED 0x200
+
+extc
+{
+    typedef struct
+    {
+        uint   Link;
+        uint   ESP0, SS0;
+        uint   ESP1, SS1;
+        uint   ESP2, SS2;
+        uint   CR3, EIP, EFlags;
+        uint   EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI;
+        uint   ES, CS, SS, DS, FS, GS;
+        uint   LDT;
+        ushort Trap;
+        ushort IOMap;
+    } ATTR_PACK TaskState;
+
+    extern void PageFaultTask();
+    void PageFaultHandler(uint error);
+}
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        struct Processor;
+
+        class PagingManager
+        {
+            private:
+                uint* Directory;
+                uint* StackTables;
+                uint  StackUsed[PG_STACK_PAGES / 32];
+                uint  StackGuard[PG_STACK_PAGES / 32];
+                uint  StackRetired[2][PG_STACK_PAGES / 32];
+                uint  RetireCount[2];
+                uint  RetireRequest[2];
+                uint  RetireOpen;
+                uint  Committed;
+                uint  PendingBase;
+                uint  PendingSize;
+                bool  Enabled;
+                Threading::Spinlock StackLock;
+
+            public:
+                void Initialize();
+                void InitializeTasks(Processor* cpu);
+                void HandleFault(uint error);
+                bool IsEnabled();
+
+            public:
+                void* ReserveStack(uint size);
+                void  ReleaseStack(void* base, uint size);
+                bool  IsMapped(uint addr);
+                bool  IsStackAddress(uint addr);
+                uint  GetCommittedBytes();
+                void  MapDevice(uint addr);
+                void  Refill();
+
+            private:
+                void SetTaskDescriptor(uint* gdt, uint selector, TaskState* tss);
+                bool Commit(uint addr, bool fault);
+                void FreeRange(uint base, uint size);
+                void Reclaim();
+                void FlushPending();
+                bool IsStackPage(uint page);
+                bool IsGuardPage(uint page);
+                bool IsRetiredPage(uint page);
+        };
+    }
+}
@@ -20,14 +20,15 @@ namespace PMOS
                 bool    ShowSeconds;
 
             private:
-                uint Tick;
+                uint Synced;
 
             public:
                 void Initialize();
-                void Update();
                 void Read();
 
             private:
+                void Sync();
+                uint GetEpoch();
                 void UpdateStrings();
                 void SetRegister(ushort reg, byte data);
                 byte GetRegister(ushort reg);
@@ -0,0 +1,103 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/HAL/Paging.hpp>
+#include <Kernel/HAL/APICTimer.hpp>
+#include <Kernel/Core/Debug.hpp>
+
+#define SMP_MAX_CPUS 16
+
+// application processors start in real mode at this page, each gets a small stack to run on until its idle thread takes over
+#define SMP_TRAMPOLINE 0x8000
+#define SMP_STACK_SIZE 0x4000
+
+// every processor has its own gdt - the boot entries, its two task state segments and the per processor segment loaded into gs
+#define SMP_GDT_ENTRIES 6
+#define SMP_PERCPU_SEL  0x28
+
+extc
+{
+    extern byte SMPTrampoline[];
+    extern byte SMPTrampolineEnd[];
+    extern uint SMPParamCR3;
+    extern uint SMPParamStack;
+    extern uint SMPParamCPU;
+}
+
+namespace PMOS
+{
+    namespace Threading { class Thread; }
+
+    namespace HAL
+    {
+        typedef struct
+        {
+            ushort Limit;
+            uint   Base;
+        } ATTR_PACK GDTRegister;
+
+        // state private to one processor, reached through gs so code never has to look up which cpu it runs on
+        typedef struct Processor
+        {
+            Processor*         Self;
+            uint               Index;
+            uint               APICID;
+            uint               IRQDepth;
+            Threading::Thread* CurrentThread;
+            Threading::Thread* IdleThread;
+            Threading::Thread* FPUOwner;
+            Threading::Thread* Previous;
+            ulonglong          SwitchStamp;
+            TimerMode          Timer;
+            uint               TimerCount;
+            uint               Steals;
+            volatile uint      FlushDone;
+            volatile bool      Online;
+            uint               GDT[SMP_GDT_ENTRIES * 2];
+            TaskState          KernelTask;
+            TaskState          FaultTask;
+            byte*              FaultStack;
+            uint               FrameReserve[PG_FRAME_RESERVE];
+            volatile uint      FrameReserveCount;
+            byte*              BootStack;
+        } Processor;
+
+        class SMPManager
+        {
+            private:
+                Processor     CPUs[SMP_MAX_CPUS];
+                volatile uint Count;
+                volatile uint FlushRequest;
+                volatile bool Halting;
+
+            public:
+                void Initialize();
+                void Start();
+                void Print(DebugMode mode);
+
+            public:
+                void EnterProcessor(Processor* cpu);
+                void SendOthers(byte vector);
+                uint RequestFlush();
+                bool IsFlushed(uint request);
+                void HaltOthers();
+                uint GetCount();
+                Processor* Get(uint index);
+                bool IsHalting();
+
+            public:
+                // single gs relative loads, so a thread moved to another cpu halfway through can never mix two processors up
+                static inline Processor* GetCurrent() { Processor* cpu; asm volatile("mov %%gs:0, %0" : "=r"(cpu)); return cpu; }
+                static inline uint GetIndex() { uint index; asm volatile("mov %%gs:%c1, %0" : "=r"(index) : "i"(__builtin_offsetof(Processor, Index))); return index; }
+                static inline uint GetIRQDepth() { uint depth; asm volatile("mov %%gs:%c1, %0" : "=r"(depth) : "i"(__builtin_offsetof(Processor, IRQDepth))); return depth; }
+                static inline Threading::Thread* GetCurrentThread() { Threading::Thread* t; asm volatile("mov %%gs:%c1, %0" : "=r"(t) : "i"(__builtin_offsetof(Processor, CurrentThread))); return t; }
+
+            private:
+                bool StartProcessor(Processor* cpu);
+                void LoadSegments(Processor* cpu);
+                void Delay(uint us);
+                static void FlushLocal();
+                static void FlushCallback(uint* regs);
+                static void HaltCallback(uint* regs);
+        };
+    }
+}
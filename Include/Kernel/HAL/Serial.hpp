@@ -32,6 +32,7 @@ namespace PMOS
                 char Read();
                 void WriteChar(char c);
                 void WriteChar(char c, Col4 fg);
+                void WriteBytes(byte* data, uint length);
                 void Write(char* text);
                 void Write(char* text, Col4 fg);
                 void WriteLine(char* text);
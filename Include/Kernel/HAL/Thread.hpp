@@ -1,6 +1,9 @@
 #pragma once
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/HAL/Interrupts/ISR.hpp>
+#include <Kernel/Services/MemoryMgr.hpp>
+#include <Kernel/Services/TimerMgr.hpp>
+#include <Kernel/Lib/Sync.hpp>
 
 namespace PMOS
 {
@@ -12,6 +15,7 @@ namespace PMOS
         Completed       = 0x03,
         Sleeping        = 0x04,
         Paused          = 0x05,
+        Blocked         = 0x06,
     };
 
     enum class ThreadPriority
@@ -36,22 +40,61 @@ namespace PMOS
         class ThreadManager;
 
         void ThreadEntry();
+        void ThreadWake(Services::KernelTimer* timer);
 
         extern const uint STACK_SIZE;
 
+        // fxsave area plus slack to align it to 16 bytes
+        #define FPU_STATE_SIZE 528
+        #define FPU_STATE(t) ((byte*)(((uint)(t)->FPUState + 15) & 0xFFFFFFF0))
+
         class Thread
         {
             friend class ThreadManager;
 
             private:
                 ThreadProperties Properties;
-                uint TPS, TPSTick, Time, LastTime;
+                ulonglong Cycles, SampleCycles;
                 float CPUUsage;
 
+            private:
+                Thread* QueueNext;
+                Thread* QueuePrev;
+                Thread* ReapNext;
+                uint    Slice;
+                byte    QueueSet;
+                bool    Queued;
+                bool    Reaping;
+
+            private:
+                byte          CPU;
+                bool          Pinned;
+                bool          FPUUsed;
+                volatile bool OnCPU;
+
+            // deadline class - a budget in ticks per period in milliseconds, period 0 for an ordinary thread
+            private:
+                uint Period;
+                uint Budget;
+                uint Remaining;
+                uint Deadline;
+                uint Load;
+                uint Misses;
+                bool DeadlinePinned;
+
+            private:
+                Services::KernelTimer SleepTimer;
+                Thread*    WaitNext;
+                WaitQueue* Waiting;
+                Spinlock*  WaitGuard;
+
             public:
                 ISRRegs* Registers;
                 byte*        Stack;
                 uint         StackSize;
+                HeapArena*   Arena;
+                HeapMagazine* Magazines;
+                byte*        FPUState;
 
             public:
                 void         (*Protocol)(Thread* sender);
@@ -61,16 +104,22 @@ namespace PMOS
                 Thread(char* name, ThreadPriority priority, void protocol(Thread*));
                 Thread(char* name, uint stack, ThreadPriority priority, void protocol(Thread*));
                 void Dispose();
-                void CalculateTPS();
+
+            private:
+                void Setup(char* name, ThreadPriority priority, void protocol(Thread*));
+                void Reset(char* name, ThreadPriority priority, void protocol(Thread*));
+                void Detach();
 
             public:
                 bool Start();
+                bool StartOn(uint cpu);
                 bool Stop();
                 void Sleep(uint ms);
                 void OnUnhandledException(char* msg);
 
             public:
                 void SetPriority(ThreadPriority priority);
+                bool SetDeadline(uint period, uint budget);
                 void SetState(ThreadState state);
 
             public: 
@@ -82,7 +131,11 @@ namespace PMOS
                 ulong GetID();
                 ThreadState    GetState();
                 ThreadPriority GetPriority();
-                uint GetTPS();
+                uint  GetPeriod();
+                uint  GetCPU();
+                ulonglong GetCycles();
+                uint  GetCPUTime();
+                float GetCPUUsage();
         };
     }
 }
\ No newline at end of file
@@ -11,16 +11,16 @@ template<class V> class HashMap
         size_t Count;
 
     public:
-        HashMap() { Clear(); }
+        HashMap() { Keys = nullptr; Values = nullptr; Count = 0; }
 
         void Clear()
         {
             if (Keys != nullptr)
             {
                 for (size_t i = 0; i < Count; i++) { Keys[i].Dispose(); }
-                delete Keys;
+                MemFree(Keys);
             }
-            if (Values != nullptr) { delete Values; }
+            if (Values != nullptr) { MemFree(Values); }
 
             Keys = nullptr;
             Values = nullptr;
@@ -29,31 +29,12 @@ template<class V> class HashMap
 
         void Add(PMOS::String key, V val)
         {
-            PMOS::String* keys = new PMOS::String[Count + 1];
-            V* values    = new V[Count + 1];
-
-            if (Keys != nullptr)
-            {
-                for (size_t i = 0; i < Count; i++)
-                {
-                    if (Keys[i].GetLength() == 0) { continue; }
-                    keys[i] = Keys[i];
-                    Keys[i].Dispose();
-                }
-                delete Keys;
-            }
-
-            if (Values != nullptr)
-            {
-                for (size_t i = 0; i < Count; i++) { values[i] = Values[i]; }
-                delete Values;
-            }
-            
-            keys[Count] = key;
-            values[Count] = val;
+            // strings only own a data pointer, so they can be moved with the block
+            Keys   = (PMOS::String*)MemRealloc(Keys, (Count + 1) * sizeof(PMOS::String));
+            Values = (V*)MemRealloc(Values, (Count + 1) * sizeof(V));
 
-            Keys = keys;
-            Values = values;
+            Keys[Count].Set(key);
+            Values[Count] = val;
             Count++;
         }
 
@@ -101,7 +82,7 @@ template<class K, class V> class Map
         size_t Count;
 
     public:
-        Map() { Clear(); }
+        Map() { Keys = nullptr; Values = nullptr; Count = 0; }
 
         void Clear()
         {
@@ -115,26 +96,11 @@ template<class K, class V> class Map
 
         void Add(K name, V value)
         {
-            K* keys   = new K[Count + 1];
-            V* values = new V[Count + 1];
-
-            if (Keys != nullptr)
-            {
-                for (size_t i = 0; i < Count; i++) { keys[i] = Keys[i]; }
-                delete Keys;
-            }
-
-            if (Values != nullptr)
-            {
-                for (size_t i = 0; i < Count; i++) { values[i] = Values[i]; }
-                delete Values;
-            }
-
-            keys[Count] = name;
-            values[Count] = value;
+            Keys   = (K*)MemRealloc(Keys, (Count + 1) * sizeof(K));
+            Values = (V*)MemRealloc(Values, (Count + 1) * sizeof(V));
 
-            Keys   = keys;
-            Values = values;
+            Keys[Count]   = name;
+            Values[Count] = value;
             Count  += 1;
         }
 
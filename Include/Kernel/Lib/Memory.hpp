@@ -2,18 +2,39 @@
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/Services/MemoryMgr.hpp>
 
+// requests at or above this size leave the inline loops for the selected block method
+#define MEM_BLOCK_MIN 64
+
+// copies and fills at or above this size use non-temporal stores when sse2 is available
+#define MEM_STREAM_MIN 0x40000
+
 namespace PMOS
 {
     namespace Memory
     {
+        typedef void* (*CopyMethod)(void* dest, void* src, uint size);
+        typedef void* (*SetMethod)(void* dest, int data, uint size);
+
+        // block methods picked at boot from the detected cpu features
+        extern CopyMethod CopyBlock;
+        extern SetMethod  SetBlock;
+
+        void  Initialize(bool sse2);
+        void* CopyRep(void* dest, void* src, uint size);
+        void* SetRep(void* dest, int data, uint size);
+        void* CopyStream(void* dest, void* src, uint size);
+        void* SetStream(void* dest, int data, uint size);
+
         static inline void* Set(void* dest, int data, uint size)
         {
+            if (size >= MEM_BLOCK_MIN) { return SetBlock(dest, data, size); }
+
             uint num_dwords = size / 4;
             uint num_bytes = size % 4;
             uint *dest32 = (uint*)dest;
             byte *dest8 = ((byte*)dest) + num_dwords * 4;
             byte val8 = (byte)data;
-            uint val32 = data | (data << 8) | (data << 16) | (data << 24);
+            uint val32 = val8 | (val8 << 8) | (val8 << 16) | (val8 << 24);
             uint i;
 
             for (i = 0; i < num_dwords; i++) { dest32[i] = val32; }
@@ -23,15 +44,14 @@ namespace PMOS
 
         static inline void* Copy(void* dest, void* src, uint size)
         {
-            uint buffer_size = size;
-            uint destt       = (uint)dest;
-            uint srcc        = (uint)src;
-            uint num_dwords = buffer_size / 4;
-            uint num_bytes  = buffer_size % 4;
-            uint *dest32    = (uint*)destt;
-            uint *src32     = (uint*)srcc;
-            byte *dest8      = ((byte*)destt) + num_dwords * 4;
-            byte *src8       = ((byte*)srcc) + num_dwords * 4;
+            if (size >= MEM_BLOCK_MIN) { return CopyBlock(dest, src, size); }
+
+            uint num_dwords = size / 4;
+            uint num_bytes  = size % 4;
+            uint *dest32    = (uint*)dest;
+            uint *src32     = (uint*)src;
+            byte *dest8      = ((byte*)dest) + num_dwords * 4;
+            byte *src8       = ((byte*)src) + num_dwords * 4;
             uint i;
 
             for (i = 0; i < num_dwords; i++) { dest32[i] = src32[i]; }
@@ -41,38 +61,30 @@ namespace PMOS
 
         static inline void* Move(void* dest, void* src, uint size)
         {
-            uint buffer_size = size;
-            uint destt       = (uint)dest;
-            uint srcc        = (uint)src;
-            uint num_dwords = buffer_size / 4;
-            uint num_bytes  = buffer_size % 4;
-            uint *dest32    = (uint*)destt;
-            uint *src32     = (uint*)srcc;
-            byte *dest8      = ((byte*)destt) + num_dwords * 4;
-            byte *src8       = ((byte*)srcc) + num_dwords * 4;
-            uint i;
-
-            for (i = 0; i < num_dwords; i++) { dest32[i] = src32[i]; }
-            for (i = 0; i < num_bytes; i++) { dest8[i] = src8[i]; }
+            Copy(dest, src, size);
             Set(src, 0, size);
             return dest;
         }
 
+        // compare a dword at a time and only drop to bytes to find the sign of the first difference
         static inline int Compare(void* p1, void* p2, uint size)
         {
-            byte *p = (byte*)p1;
-            byte *q = (byte*)p2;
-            int charCompareStatus = 0;
+            if (p1 == p2) { return 0; }
+
+            uint *p32 = (uint*)p1;
+            uint *q32 = (uint*)p2;
+            while (size >= 4 && *p32 == *q32) { p32++; q32++; size -= 4; }
 
-            if (p1 == p2) { return charCompareStatus; }
+            byte *p = (byte*)p32;
+            byte *q = (byte*)q32;
             while (size > 0)
             {
-                if (*p != *q) { charCompareStatus = (*p > *q) ? 1 : -1; break; }
+                if (*p != *q) { return (*p > *q) ? 1 : -1; }
                 size--;
                 p++;
                 q++;
             }
-            return charCompareStatus;
+            return 0;
         } 
     }
 }
@@ -89,5 +101,6 @@ extern void operator delete[](void *p, size_t size);
 
 void* MemAlloc(size_t size);
 void* MemAlloc(size_t size, bool clear, PMOS::AllocationType type = PMOS::AllocationType::Default);
+void* MemRealloc(void* ptr, size_t size);
 void  MemFree(void* ptr);
 void  MemFreeArray(void** ptr, size_t len);
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+
+namespace PMOS
+{
+    namespace Services
+    {
+        class EventLoop;
+        struct LoopTask;
+    }
+
+    namespace Threading
+    {
+        class Thread;
+
+        // threads parked on a lock, linked through the thread itself
+        typedef struct
+        {
+            Thread* Head;
+            Thread* Tail;
+        } WaitQueue;
+
+        // counters kept by every lock, named locks are listed by the LOCKS command
+        typedef struct LockInfo
+        {
+            char*     Name;
+            uint      Acquires;
+            uint      Contentions;
+            LockInfo* Next;
+        } LockInfo;
+
+        // busy waiting lock that keeps interrupts off while held, safe to take from irq handlers
+        class Spinlock
+        {
+            private:
+                volatile uint Locked;
+                uint          Flags;
+                uint          Holder;
+
+            public:
+                LockInfo Info;
+
+            public:
+                void Initialize(char* name);
+                void Acquire();
+                bool TryAcquire();
+                void Release();
+                bool IsLocked();
+                bool IsHeld();
+        };
+
+        // sleeping lock, waiters block until Unlock hands ownership straight to the first of them - the owner may lock it again
+        class Mutex
+        {
+            private:
+                Spinlock  Guard;
+                WaitQueue Waiters;
+                Thread*   Owner;
+                uint      Depth;
+
+            public:
+                LockInfo Info;
+
+            public:
+                void Initialize(char* name);
+                void Lock();
+                bool TryLock();
+                void Unlock();
+                bool IsLocked();
+                Thread* GetOwner();
+        };
+
+        // counting semaphore, a signal with waiters queued goes directly to the first one
+        class Semaphore
+        {
+            private:
+                Spinlock  Guard;
+                WaitQueue Waiters;
+                uint      Count;
+
+            public:
+                LockInfo Info;
+
+            public:
+                void Initialize(char* name, uint count);
+                void Wait();
+                bool TryWait();
+                void Signal();
+                uint GetCount();
+        };
+
+        // waits atomically release the mutex, it is locked again before Wait returns
+        class ConditionVariable
+        {
+            private:
+                Spinlock  Guard;
+                WaitQueue Waiters;
+
+            public:
+                LockInfo Info;
+
+            public:
+                void Initialize(char* name);
+                void Wait(Mutex* mutex);
+                void Signal();
+                void Broadcast();
+        };
+
+        // set from anywhere including irq handlers, waited on by threads and event loop tasks - an auto reset event lets one waiter through per set
+        class Event
+        {
+            friend class Services::EventLoop;
+
+            private:
+                Spinlock  Guard;
+                WaitQueue Waiters;
+                Services::LoopTask* Tasks;
+                bool      Signaled;
+                bool      AutoReset;
+
+            public:
+                LockInfo Info;
+
+            public:
+                void Initialize(char* name, bool autoReset);
+                void Wait();
+                void Set();
+                void Reset();
+                bool IsSet();
+
+            private:
+                bool Subscribe(Services::LoopTask* task);
+                void Unsubscribe(Services::LoopTask* task);
+        };
+
+        // holds a mutex until the end of the enclosing scope
+        class MutexGuard
+        {
+            private:
+                Mutex* Target;
+
+            public:
+                MutexGuard(Mutex* mutex) : Target(mutex) { Target->Lock(); }
+                ~MutexGuard() { Target->Unlock(); }
+        };
+
+        void RegisterLock(LockInfo* info, char* name);
+        void PrintLocks(DebugMode mode);
+    }
+}
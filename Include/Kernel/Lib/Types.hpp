@@ -10,6 +10,7 @@ extc
     typedef unsigned short ushort;
     typedef unsigned int   uint;
     typedef unsigned long  ulong;
+    typedef unsigned long long ulonglong;
 
     // signed types
     typedef signed char sbyte;
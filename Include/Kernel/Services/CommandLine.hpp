@@ -3,6 +3,8 @@
 #include <Kernel/Lib/Stream.hpp>
 #include <Kernel/Core/Service.hpp>
 #include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
+#include <Kernel/Services/EventLoop.hpp>
 
 namespace PMOS
 {
@@ -44,6 +46,11 @@ namespace PMOS
                 uint CommandArgsCount;
                 Debugger Debug;
 
+            public:
+                // set for every command pushed, the input task sleeps on it between commands
+                Threading::Event InputReady;
+                LoopTask InputTask;
+
             public:
                 static const int MaxCommandCount = 256;
                 static const int MaxBufferCount = 256;
@@ -57,6 +64,7 @@ namespace PMOS
             public:
                 void PrintCaret();
                 static void OnEnterPressed(Stream* input);
+                static void OnInput(LoopTask* task);
                 void RegisterCommand(Command cmd);
                 void PushCommand(char* input);
                 void PopCommand();
@@ -90,8 +98,19 @@ namespace PMOS
         void PERF(char* input, Array<char**> args);
         void LSPCI(char* input, Array<char**> args);
         void HEAP(char* input, Array<char**> args);
+        void SLABS(char* input, Array<char**> args);
+        void HEAPSTAT(char* input, Array<char**> args);
+        void HEAPTRACE(char* input, Array<char**> args);
+        void FRAMES(char* input, Array<char**> args);
         void SERVICES(char* input, Array<char**> args);
         void THREADS(char* input, Array<char**> args);
+        void THREADPOOL(char* input, Array<char**> args);
+        void DEADLINES(char* input, Array<char**> args);
+        void TIMERS(char* input, Array<char**> args);
+        void WORKQ(char* input, Array<char**> args);
+        void LOOPS(char* input, Array<char**> args);
+        void LOCKS(char* input, Array<char**> args);
+        void CPUS(char* input, Array<char**> args);
         void MMAP(char* input, Array<char**> args);
         void VESAMODES(char* input, Array<char**> args);
 
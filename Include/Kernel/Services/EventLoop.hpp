@@ -0,0 +1,77 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
+#include <Kernel/Services/TimerMgr.hpp>
+#include <Kernel/HAL/Thread.hpp>
+
+// a task is parked on nothing, queued to run or waiting for an event or its timer - whichever wins the move to ready runs it
+#define LOOP_TASK_IDLE    0
+#define LOOP_TASK_READY   1
+#define LOOP_TASK_WAITING 2
+
+namespace PMOS
+{
+    namespace Services
+    {
+        class EventLoop;
+        struct LoopTask;
+
+        // runs on the loop's thread and must return instead of blocking, a task that wants to run again re-arms itself with Post, WaitFor or Delay
+        typedef void (*TaskCallback)(LoopTask* task);
+
+        // owned by the caller like a kernel timer, the loop only links it while it is queued
+        typedef struct LoopTask
+        {
+            LoopTask*         Next;
+            LoopTask*         EventNext;
+            EventLoop*        Loop;
+            TaskCallback      Callback;
+            void*             Data;
+            Threading::Event* Waiting;
+            KernelTimer       Timer;
+            volatile uint     State;
+            bool              TimedOut;
+        } LoopTask;
+
+        // many small services sharing one thread - tasks run to completion one after another and the thread sleeps on an event while none are ready
+        class EventLoop
+        {
+            private:
+                char*               Name;
+                Threading::Spinlock Guard;
+                LoopTask*           Head;
+                LoopTask*           Tail;
+                Threading::Event    Wakeup;
+                Threading::Thread*  Host;
+                EventLoop*          Next;
+
+            private:
+                uint Tasks;
+                uint Runs;
+                uint Sleeps;
+                uint Timeouts;
+
+            public:
+                void Initialize(char* name);
+                void Start(ThreadPriority priority);
+                void Run();
+                static void Print(DebugMode mode);
+
+            public:
+                void Attach(LoopTask* task, TaskCallback callback, void* data);
+                void Post(LoopTask* task);
+                void WaitFor(LoopTask* task, Threading::Event* event, uint timeout);
+                void Delay(LoopTask* task, uint ms);
+                void Cancel(LoopTask* task);
+                Threading::Thread* GetThread();
+                static bool Wake(LoopTask* task, bool timedOut);
+
+            private:
+                void Push(LoopTask* task);
+                LoopTask* Pop();
+                static void TimerExpired(KernelTimer* timer);
+                static void ThreadMain(Threading::Thread* t);
+        };
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/Core/Service.hpp>
+#include <Kernel/Lib/Sync.hpp>
 
 namespace PMOS
 {
@@ -95,6 +96,7 @@ namespace PMOS
                 uint             EntryCount;
                 uint             DiskSize;
                 bool             Mounted;
+                Threading::Mutex IOLock;
 
             public:
                 FSHost();
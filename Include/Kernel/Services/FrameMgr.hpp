@@ -0,0 +1,54 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+#include <Kernel/Services/MemoryMgr.hpp>
+
+#define FM_FRAME 0x1000
+
+namespace PMOS
+{
+    namespace Services
+    {
+        // physical page allocator seeded from every usable multiboot memory map region
+        class FrameManager
+        {
+            private:
+                uint* Bitmap;
+                uint* StartMap;
+                uint* EndMap;
+                uint  FrameCount;
+                uint  TotalCount;
+                uint  FreeCount;
+                uint  InstalledBytes;
+                uint  MapEnd;
+                Threading::Spinlock FrameLock;
+
+            public:
+                void Initialize();
+                void Print(DebugMode mode);
+
+            public:
+                uint AllocateFrames(uint count);
+                bool ClaimFrames(uint addr, uint count);
+                void ReserveRange(uint addr, uint length);
+                uint FreeFrames(uint addr);
+                bool IsAllocation(uint addr);
+                uint GetAllocationSize(uint addr);
+                uint GetLargestRun(uint* base);
+                bool IsBusy();
+
+            public:
+                uint GetInstalledBytes();
+                uint GetTotalBytes();
+                uint GetFreeBytes();
+                uint GetUsedBytes();
+
+            private:
+                void Lock();
+                void Unlock();
+                bool IsUsed(uint frame);
+                void SetRange(uint* map, uint frame, uint count, bool state);
+                void MarkAllocation(uint frame, uint count);
+        };
+    }
+}
@@ -2,9 +2,50 @@
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/Core/Service.hpp>
 #include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
 
 #define MM_ALIGN 0x1000
 
+// heap sizing - initial claim from the frame allocator, minimum growth step, and the size above which large buffers take frames directly
+#define MM_HEAP_INITIAL 0x1000000
+#define MM_HEAP_GROW    0x400000
+#define MM_DIRECT_MIN   0x10000
+
+// direct frame runs the heap keeps a record of, one page of them - a request that finds the table full goes to the heap instead
+#define MM_DIRECT_RUNS (MM_ALIGN / sizeof(HeapDirectRun))
+
+// free page blocks are bucketed by log2 of their page count
+#define MM_BUCKETS 20
+
+// background zeroing - bytes cleared per step and how far ahead of the mass base to pre-zero
+#define MM_ZERO_STEP   0x10000
+#define MM_ZERO_WINDOW 0x1000000
+
+// slab allocator - small requests are served from size-classed pages
+#define MM_SLAB_MAGIC   0x534C4142
+#define MM_SLAB_CLASSES 14
+#define MM_SLAB_MAX     2016
+#define MM_SLAB_HEADER  32
+
+// arenas - owner scoped bump allocation released in one call
+#define MM_ARENA_MAGIC  0x4152454E
+#define MM_ARENA_CHUNK  0x1000
+#define MM_ARENA_HEADER 16
+
+// per-thread magazines - cached slab objects, refilled and drained a batch at a time
+#define MM_MAGAZINE_SIZE  16
+#define MM_MAGAZINE_BATCH 8
+
+// statistics - request sizes and latencies in cycles are bucketed by powers of two
+#define MM_TYPES           13
+#define MM_SIZE_BUCKETS    20
+#define MM_LATENCY_BUCKETS 32
+
+// allocation tracing - records sit in a ring and go out over COM1 in checksummed frames
+#define MM_TRACE_MAGIC   0x43525448
+#define MM_TRACE_RECORDS 4096
+#define MM_TRACE_BATCH   64
+
 namespace PMOS
 {
     enum class AllocationType : byte
@@ -20,6 +61,14 @@ namespace PMOS
         PCIDevice,
         VMRAM,
         UI,
+        Slab,
+        Arena,
+    };
+
+    enum class HeapTraceOp : byte
+    {
+        Allocate = 1,
+        Free     = 2,
     };
 
     typedef struct
@@ -37,9 +86,13 @@ namespace PMOS
         uint Base;
         uint Length;
         uint Size;
+        uint Next;
+        uint Prev;
         byte Type;
+        byte Clean;
     } ATTR_PACK HeapEntry;
 
+    // not packed, some counters are updated atomically and need their natural alignment
     typedef struct
     {
         uint TableStart;
@@ -48,14 +101,106 @@ namespace PMOS
         uint TableEntries;
         uint TableEntriesUsed;
         uint TableMaxEntries;
+        uint TableFreeSlot;
+        uint PageMapStart;
+        uint PageMapCount;
         uint DataStart;
         uint DataEnd;
+        uint DataLimit;
         uint DataLength;
         uint DataUsed;
+        uint DirectUsed;
+        uint MassClean;
         uint MMapStart;
         uint MMapSize;
         uint MMapCount;
-    } ATTR_PACK HeapHeader;
+    } HeapHeader;
+
+    typedef struct
+    {
+        uint   Magic;
+        uint   Next;
+        uint   Prev;
+        uint   FreeList;
+        ushort Bump;
+        ushort Used;
+        byte   Class;
+        byte   Reserved[11];
+    } ATTR_PACK SlabHeader;
+
+    typedef struct
+    {
+        ushort Size;
+        ushort Capacity;
+        ushort ObjectOffset;
+        ushort Reserved;
+        uint   Partial;
+        uint   Slabs;
+    } ATTR_PACK SlabClass;
+
+    typedef struct
+    {
+        uint Magic;
+        uint Next;
+        uint Arena;
+        uint Used;
+    } ATTR_PACK ArenaChunk;
+
+    typedef struct
+    {
+        uint Chunks;
+        uint Current;
+        uint Size;
+        uint Count;
+        byte Type;
+    } ATTR_PACK HeapArena;
+
+    typedef struct
+    {
+        uint Count;
+        uint Objects[MM_MAGAZINE_SIZE];
+    } ATTR_PACK HeapMagazine;
+
+    // requested size and type of a run of frames handed out directly, base 0 when the slot is free
+    typedef struct
+    {
+        uint Base;
+        uint Size;
+        uint Type;
+    } HeapDirectRun;
+
+    // not packed for the same reason as the header
+    typedef struct
+    {
+        uint LiveCount[MM_TYPES];
+        uint LiveBytes[MM_TYPES];
+        uint Sizes[MM_SIZE_BUCKETS];
+        uint AllocCycles[MM_LATENCY_BUCKETS];
+        uint FreeCycles[MM_LATENCY_BUCKETS];
+        uint Allocations;
+        uint Frees;
+        uint Waste;
+        uint Peak;
+    } HeapStats;
+
+    typedef struct
+    {
+        uint   Time;
+        uint   Pointer;
+        uint   Size;
+        uint   Caller;
+        byte   Op;
+        byte   Type;
+        ushort Reserved;
+    } ATTR_PACK HeapTraceRecord;
+
+    // frame header, followed by Count records and a uint sum of the record words
+    typedef struct
+    {
+        uint   Magic;
+        ushort Count;
+        ushort Dropped;
+    } ATTR_PACK HeapTraceFrame;
 
     namespace Services
     {
@@ -65,6 +210,16 @@ namespace PMOS
                 HeapHeader Header;
                 bool MessagesEnabled;
                 bool MemoryMapReady;
+                SlabClass SlabClasses[MM_SLAB_CLASSES];
+                byte      SlabLookup[(MM_SLAB_MAX >> 4) + 1];
+                bool      SlabsReady;
+                uint      FreeBuckets[2][MM_BUCKETS];
+                HeapStats Stats;
+                HeapDirectRun* DirectRuns;
+                HeapTraceRecord* Trace;
+                uint      TraceHead, TraceTail, TraceDropped;
+                bool      Tracing;
+                Threading::Spinlock HeapLock;
              
             public:
                 void Initialize();
@@ -73,6 +228,8 @@ namespace PMOS
 
             public:
                 void PrintTable(DebugMode mode);
+                void PrintSlabs(DebugMode mode);
+                void PrintStats(DebugMode mode);
                 void PrintMemoryMap(DebugMode mode);
                 void PrintAllocation(HeapEntry* entry);
                 void PrintFree(HeapEntry* entry);
@@ -80,17 +237,85 @@ namespace PMOS
             public:
                 void* Allocate(uint size);
                 void* Allocate(uint size, bool clear, AllocationType type);
+                void* Allocate(uint size, bool clear, AllocationType type, void* caller);
+                void* Reallocate(void* ptr, uint size);
+                void* Reallocate(void* ptr, uint size, void* caller);
                 void  Free(void* ptr);
+                void  Free(void* ptr, void* caller);
                 void  FreeArray(void** ptr, uint len);
-                void MergeFreeEntries();
+                void  SetType(void* ptr, AllocationType type);
+                bool  ZeroStep();
+                void  StartZeroThread();
+
+            public:
+                HeapArena* CreateArena(AllocationType type);
+                void*      ArenaAllocate(HeapArena* arena, uint size, bool clear);
+                void       ReleaseArena(HeapArena* arena);
+                HeapArena* PushArena(HeapArena* arena);
+                void       PopArena(HeapArena* previous);
+
+            public:
+                void ReleaseMagazines(HeapMagazine* magazines);
+
+            public:
+                void StartTrace();
+                void StopTrace();
+                bool FlushTrace();
+                bool IsTracing();
+
+            public:
+                HeapStats* GetStats();
+                uint       GetLatencyPercentile(uint* buckets, uint percent);
+                uint       GetSizeBucket(uint size);
+
+            private:
+                void  Lock();
+                void  Unlock();
+                void* AllocateRouted(uint size, bool clear, AllocationType type);
+                void  FreeRouted(void* ptr);
+                void* ReallocateRouted(void* ptr, uint size);
+                void* AllocateDirect(uint size, bool clear, AllocationType type);
+                void  FreeDirect(void* ptr);
+                HeapDirectRun* GetDirectRun(uint base);
+                void  UpdatePeak();
+                void  TrackType(AllocationType type, int count, int bytes);
+                void  TrackLatency(uint* buckets, uint start);
+                void  RetypeSmall(SlabHeader* slab, void* ptr, AllocationType type);
+                void  TraceEvent(HeapTraceOp op, void* ptr, uint size, AllocationType type, void* caller);
+                void* AllocateCached(HeapMagazine** magazines, uint size, bool clear, AllocationType type);
+                bool  FreeCached(HeapMagazine* magazines, void* ptr);
+                void  InitializeSlabs();
+                void* AllocatePages(uint size, bool clear, AllocationType type);
+                void  FreePages(void* ptr);
+                void* ReallocateSmall(void* ptr, uint size);
+                void* ReallocatePages(void* ptr, uint size);
+                bool  ZeroChunk();
+                void  FreeEntry(HeapEntry* entry);
+                ArenaChunk* GetArenaChunkFromPtr(void* ptr);
+                void* AllocateSmall(uint size, bool clear, AllocationType type);
+                void  FreeSmall(void* ptr);
+                SlabHeader* CreateSlab(byte cls);
+                SlabHeader* GetSlabFromPtr(void* ptr);
+                byte* GetSlabType(SlabHeader* slab, void* ptr);
+                void  LinkSlab(SlabClass* cls, SlabHeader* slab);
+                void  UnlinkSlab(SlabClass* cls, SlabHeader* slab);
+                uint  GetBucket(uint length);
+                void  InsertFree(HeapEntry* entry);
+                void  RemoveFree(HeapEntry* entry);
+                void  SetTag(HeapEntry* entry);
+                void  Coalesce(HeapEntry* entry);
 
             public: 
                 HeapEntry* GetEntry(int index);
-                HeapEntry* GetFreeEntry(uint size);
+                HeapEntry* GetFreeEntry(uint size, bool clear);
+                bool       Grow(uint size);
+                bool       IsDirect(AllocationType type, uint size);
                 int        GetFreeIndex();
                 HeapEntry* GetNeighbour(HeapEntry* entry);
-                HeapEntry* CreateEntry(HeapEntry entry);
+                HeapEntry* GetPrevNeighbour(HeapEntry* entry);
+                HeapEntry* CreateEntry(uint base, uint length, AllocationType type);
                 bool       DeleteEntry(HeapEntry* entry);
+                int        GetEntryIndex(HeapEntry* entry);
                 bool       IsAddressValid(uint addr);
 
             public:
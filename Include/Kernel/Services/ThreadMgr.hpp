@@ -2,27 +2,79 @@
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/HAL/Thread.hpp>
 #include <Kernel/HAL/Interrupts/ISR.hpp>
+#include <Kernel/HAL/SMP.hpp>
 #include <Kernel/Core/Service.hpp>
 #include <Kernel/Core/Debug.hpp>
 
+// one ready queue per ThreadPriority
+#define THREAD_PRIORITIES 4
+
+// finished threads with a default size stack kept for reuse - the idle thread refills up to the low mark, anything over the high mark is freed
+#define THREAD_POOL_LOW  4
+#define THREAD_POOL_HIGH 16
+
+// queue set of threads on the deadline list of their run queue, and the share of one processor deadline threads may reserve in total(per mille)
+#define THREAD_DEADLINE_SET  2
+#define THREAD_DEADLINE_LOAD 750
+
 namespace PMOS
 {
     namespace Threading
     {
+        typedef struct
+        {
+            Thread* Head;
+            Thread* Tail;
+        } ThreadQueue;
+
+        // ready queues of one processor - threads that used up their slice wait in the expired set until the active one drains
+        typedef struct
+        {
+            Spinlock    Lock;
+            ThreadQueue Queues[2][THREAD_PRIORITIES];
+            uint        ReadyMask[2];
+            uint        Active;
+            uint        ReadyCount;
+            Thread*     Reaping;
+            Thread*     Deadlines;
+            uint        DeadlineCount;
+            uint        DeadlineLoad;
+        } RunQueue;
+
+        // threads waiting to be handed out again by Create, linked through QueueNext
+        typedef struct
+        {
+            Spinlock Lock;
+            Thread*  Head;
+            uint     Count;
+            uint     LowWater;
+            uint     HighWater;
+            uint     Reused;
+            uint     Allocated;
+        } ThreadPool;
+
         class ThreadManager : public Service
         {
             friend class Thread;
 
             public:
                 Thread** Threads;
-                Thread*  CurrentThread;
-                int      CurrentIndex;
                 uint     Count;
                 uint     MaxCount;
                 Thread*  Unloading;
 
             private:
                 float CPUUsage;
+                uint  IdleTicks;
+                uint  LastTick;
+                uint  SampleTicks;
+                uint  SampleIdle;
+                ulonglong SampleStamp;
+
+            private:
+                RunQueue   RunQueues[SMP_MAX_CPUS];
+                Spinlock   TableLock;
+                ThreadPool Pool;
 
             public:
                 ThreadManager();
@@ -35,13 +87,27 @@ namespace PMOS
                 void Unload(Thread* t);
                 Thread* Create(char* name, ThreadPriority priority, void protocol(Thread*));
                 Thread* Create(char* name, uint stack, ThreadPriority priority, void protocol(Thread*));
+                void UpdateQueue(Thread* t);
+                void Yield();
+                void Idle();
+                Thread* GetCurrentThread();
+                uint GetReadyCount(uint cpu);
+
+            public:
+                void Block(WaitQueue* queue, Spinlock* guard);
+                Thread* WakeOne(WaitQueue* queue);
+                void WakeAll(WaitQueue* queue);
+                void Unwait(Thread* t);
 
             public:
                 static void Schedule(uint* regs);
+                static void YieldCallback(uint* regs);
+                static void SwitchFPU(uint* regs);
 
             public:
                 void CalculateCPUUsage();
                 float GetCPUUsage();
+                static char* FormatUsage(float usage, char* text);
 
             public:
                 bool Terminate(Thread* thread);
@@ -49,11 +115,33 @@ namespace PMOS
                 bool Terminate(char* name);
                 bool TerminateAll(char* name);
 
+            public:
+                void SetPoolLimits(uint low, uint high);
+                void FillPool();
+                void PrintPool(DebugMode mode);
+                void PrintDeadlines(DebugMode mode);
+
             public:
                 void Print(DebugMode mode);
 
             private:
+                static void Reschedule(uint* regs, bool yield);
+                static void ScheduleCallback(uint* regs);
+                void ChargeCycles(HAL::Processor* cpu);
+                void Reap(RunQueue* rq);
                 uint GetFreeIndex();
+                uint GetIdlestCPU();
+                RunQueue* LockQueue(Thread* t);
+                void Enqueue(RunQueue* rq, Thread* t, uint set);
+                void Dequeue(RunQueue* rq, Thread* t);
+                Thread* PickNext(RunQueue* rq);
+                Thread* PickDeadline(RunQueue* rq);
+                void EnqueueDeadline(RunQueue* rq, Thread* t);
+                void DequeueDeadline(RunQueue* rq, Thread* t);
+                Thread* Steal(HAL::Processor* cpu, RunQueue* rq);
+                uint GetTimeSlice(Thread* t);
+                Thread* TakePooled(char* name, uint stack, ThreadPriority priority, void protocol(Thread*));
+                bool Recycle(Thread* t);
         };
     }
 }
\ No newline at end of file
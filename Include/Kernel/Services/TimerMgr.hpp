@@ -0,0 +1,70 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
+
+// innermost wheel has one slot per millisecond, each outer level covers the whole level below it per slot
+#define TIMER_ROOT_BITS  8
+#define TIMER_ROOT_SLOTS (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_BITS 6
+#define TIMER_LEVEL_SLOTS (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS     3
+
+// longest delay the wheel can hold directly, later timers are parked in the last slot and re-sorted on cascade
+#define TIMER_MAX_DELAY ((1 << (TIMER_ROOT_BITS + (TIMER_LEVELS * TIMER_LEVEL_BITS))) - 1)
+
+namespace PMOS
+{
+    namespace Services
+    {
+        struct KernelTimer;
+
+        // timer callbacks run from the timer interrupt with interrupts disabled, they must not block - the wheel lock is not held while they run
+        typedef void (*TimerCallback)(KernelTimer* timer);
+
+        // owned by the caller, the wheel only links it into a slot while it is pending
+        typedef struct KernelTimer
+        {
+            KernelTimer*  Next;
+            KernelTimer*  Prev;
+            KernelTimer** Slot;
+            uint          Expires;
+            uint          Period;
+            TimerCallback Callback;
+            void*         Data;
+        } KernelTimer;
+
+        class TimerManager
+        {
+            private:
+                KernelTimer* Root[TIMER_ROOT_SLOTS];
+                KernelTimer* Levels[TIMER_LEVELS][TIMER_LEVEL_SLOTS];
+                uint         Now;
+                uint         Count;
+
+            private:
+                Threading::Spinlock    WheelLock;
+                KernelTimer* volatile  Firing;
+                volatile uint          FiringCPU;
+
+            public:
+                void Initialize();
+                void Tick(uint ms);
+                void Print(DebugMode mode);
+
+            public:
+                void Start(KernelTimer* timer, uint ms, TimerCallback callback, void* data);
+                void StartPeriodic(KernelTimer* timer, uint ms, TimerCallback callback, void* data);
+                bool Stop(KernelTimer* timer);
+                bool IsPending(KernelTimer* timer);
+                uint GetCount();
+                uint GetNextDeadline(uint limit);
+
+            private:
+                void Arm(KernelTimer* timer, uint ms, uint period, TimerCallback callback, void* data);
+                void Insert(KernelTimer* timer);
+                void Unlink(KernelTimer* timer);
+                uint Cascade(uint level);
+        };
+    }
+}
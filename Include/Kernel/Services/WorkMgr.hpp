@@ -0,0 +1,59 @@
+#pragma once
+#include <Kernel/Lib/Types.hpp>
+#include <Kernel/Core/Debug.hpp>
+#include <Kernel/Lib/Sync.hpp>
+
+// slots in the deferred work ring, must be a power of two
+#define WORK_QUEUE_SIZE 256
+
+// items the worker runs in one go before it lets other threads of its priority have a turn
+#define WORK_BATCH 32
+
+namespace PMOS
+{
+    namespace Services
+    {
+        // runs on the worker thread with interrupts enabled, so unlike an irq handler it may take locks and block
+        typedef void (*WorkCallback)(void* data, uint arg);
+
+        // copied into the ring so interrupt handlers never allocate, the sequence tells producers and the worker whose turn a slot is
+        typedef struct
+        {
+            volatile uint Sequence;
+            WorkCallback  Callback;
+            void*         Data;
+            uint          Arg;
+        } WorkItem;
+
+        // bottom halves for interrupt handlers - Defer is lock free and safe from any irq on any processor, a single worker runs the items in order
+        class WorkManager
+        {
+            private:
+                WorkItem           Items[WORK_QUEUE_SIZE];
+                volatile uint      Head;
+                volatile uint      Tail;
+                volatile uint      Sleeping;
+                Threading::Semaphore Wakeup;
+                Threading::Thread* Worker;
+
+            private:
+                uint Queued;
+                uint Executed;
+                uint Dropped;
+                uint Batches;
+                uint LargestBatch;
+
+            public:
+                void Initialize();
+                void Start();
+                bool Defer(WorkCallback callback, void* data, uint arg);
+                uint GetPending();
+                void Print(DebugMode mode);
+
+            private:
+                bool Take(WorkItem* item);
+                bool IsEmpty();
+                static void WorkerMain(Threading::Thread* t);
+        };
+    }
+}
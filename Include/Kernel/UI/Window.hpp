@@ -31,6 +31,7 @@ namespace PMOS
                 Rectangle TitleBarBounds;
                 WindowFlags XFlags;
                 WindowState State;
+                HeapArena* Arena;
 
             public:
                 Button* BtnClose;
@@ -2,6 +2,7 @@
 #include <Kernel/Lib/Types.hpp>
 #include <Kernel/Core/Service.hpp>
 #include <Kernel/Graphics/Graphics.hpp>
+#include <Kernel/Services/EventLoop.hpp>
 #include <Kernel/UI/XServer/Taskbar.hpp>
 
 namespace PMOS
@@ -20,7 +21,9 @@ namespace PMOS
                 private:
                     char FPSString[64];
                     int FPS, Frames, Time, LastTime;
-                    int DrawTick, FPSLimit, DrawTime, LastDrawTime;
+                    int FPSLimit;
+                    uint NextDraw;
+                    Services::LoopTask FrameTask;
 
                 public:
                     XServerHost();
@@ -29,8 +32,11 @@ namespace PMOS
                     void Stop() override;
 
                 public:
-                    void Update();
+                    uint Update();
                     void Draw();
+
+                private:
+                    static void OnFrame(Services::LoopTask* task);
             };
         }
     }
@@ -1,6 +1,6 @@
 #pragma once
 #include <Kernel/Lib/Types.hpp>
-#include <Kernel/HAL/Thread.hpp>
+#include <Kernel/Services/EventLoop.hpp>
 #include <Kernel/VM/BPU.hpp>
 #include <Kernel/VM/RAM.hpp>
 
@@ -12,16 +12,18 @@ namespace PMOS
         {
             public:
                 BytecodeProcessor BPU;
-                Threading::Thread* Thread;
+                Services::LoopTask StepTask;
                 const char* Name;
+                HeapArena* Arena;
 
             public:
                 void Initialize(char* name);
+                void Dispose();
                 void LoadTestProgram();
                 void LoadProgram(char* filename);
                 void LoadProgram(byte* data, uint len);
                 void Run();
-                static void ThreadMain(Threading::Thread* t);
+                static void OnStep(Services::LoopTask* task);
         };
     }
 }
\ No newline at end of file
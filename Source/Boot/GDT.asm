@@ -50,6 +50,14 @@ GDTData:
     db 11001111b
     db 0x0
 
+; task state segment descriptors, filled in when paging is set up
+[global GDTTasks]
+GDTTasks:
+    dd 0x0 ; kernel task
+    dd 0x0
+    dd 0x0 ; page fault task
+    dd 0x0
+
 GDTEnd:
 
 ; GDT descriptor
@@ -196,14 +196,15 @@ namespace PMOS
     void Debugger::Panic(char* str, ISRRegs* regs)
     {
         asm volatile("cli");
+        Kernel::SMP.HaltOthers();
         Mode = DebugMode::All;
         Graphics::VESADirectCanvas canvas;
         canvas.Clear(Colors::DarkRed);
         canvas.DrawString(0, 0, str, Colors::White, Fonts::Serif8x16);
-        if (Kernel::ThreadMgr.CurrentThread != nullptr)
+        if (Kernel::ThreadMgr.GetCurrentThread() != nullptr)
         {
             canvas.DrawString(0, 16, "THREAD: ", Colors::White, Fonts::Serif8x16);
-            canvas.DrawString(72, 16, Kernel::ThreadMgr.CurrentThread->GetName(), Colors::White, Fonts::Serif8x16);
+            canvas.DrawString(72, 16, Kernel::ThreadMgr.GetCurrentThread()->GetName(), Colors::White, Fonts::Serif8x16);
         }
 
         DumpRegisters(regs);
@@ -215,16 +216,17 @@ namespace PMOS
         asm volatile("cli");
         if (code >= ExceptionMsgCount) { code = 0; }
         char* fmt = (char*)ExceptionMsgs[code];
+        Kernel::SMP.HaltOthers();
 
         Mode = DebugMode::All;
 
         Graphics::VESADirectCanvas canvas;
         canvas.Clear(Colors::DarkRed);
         canvas.DrawString(0, 0, fmt, Colors::White, Fonts::Serif8x16);
-        if (Kernel::ThreadMgr.CurrentThread != nullptr)
+        if (Kernel::ThreadMgr.GetCurrentThread() != nullptr)
         {
             canvas.DrawString(0, 16, "THREAD: ", Colors::White, Fonts::Serif8x16);
-            canvas.DrawString(72, 16, Kernel::ThreadMgr.CurrentThread->GetName(), Colors::White, Fonts::Serif8x16);
+            canvas.DrawString(72, 16, Kernel::ThreadMgr.GetCurrentThread()->GetName(), Colors::White, Fonts::Serif8x16);
         }
         
         asm volatile("hlt");
@@ -16,11 +16,22 @@ namespace PMOS
         HAL::SerialController Serial;
         HAL::PITController PIT;
         HAL::RTCController RTC;
+        HAL::ClockController Clock;
         HAL::PCIBusController PCI;
         HAL::CPUManager CPU;
+        HAL::PagingManager Paging;
+        HAL::ACPIManager ACPI;
+        HAL::APICController APIC;
+        HAL::APICTimerController APICTimer;
+        HAL::SMPManager SMP;
 
         Services::ServiceManager ServiceMgr;
+        Services::FrameManager FrameMgr;
         Services::MemoryManager MemoryMgr;
+        Services::TimerManager TimerMgr;
+        Services::WorkManager WorkMgr;
+        Services::EventLoop MainLoop;
+        Services::EventLoop UILoop;
         Services::TextModeTerminal* Terminal;
         Services::CommandLine* CLI;
         Threading::ThreadManager ThreadMgr;
@@ -53,12 +64,32 @@ namespace PMOS
             InterruptMgr = HAL::InterruptManager();
             InterruptMgr.Initialize();
 
+            SMP = HAL::SMPManager();
+            SMP.Initialize();
+
             Multiboot = HAL::MultibootHeader();
             FetchMultiboot();
 
+            FrameMgr = Services::FrameManager();
+            FrameMgr.Initialize();
+
+            // not assigned from a temporary first, the stack bitmaps make that an 8 KB clear - Initialize sets every field
+            Paging.Initialize();
+
             MemoryMgr = Services::MemoryManager();
             MemoryMgr.Initialize();
-            MemoryMgr.ToggleMessages(true);
+            MemoryMgr.ToggleMessages(false);
+
+            PIT = HAL::PITController();
+
+            CPU = HAL::CPUManager();
+            CPU.Detect();
+            CPU.CalibrateTSC();
+
+            // monotonic time for everything from here on, the rtc later adds the wall clock offset
+            Clock = HAL::ClockController();
+            Clock.Initialize();
+            Memory::Initialize(CPU.EnableSSE() && CPU.Instructions.SSE2);
 
             ServiceMgr = Services::ServiceManager();
             ServiceMgr.Initialize();
@@ -76,11 +107,33 @@ namespace PMOS
 
             //Debug.SetMode(DebugMode::All);
 
+            // bios calls go through the pic, so the apic only takes over once video is set up
+            ACPI = HAL::ACPIManager();
+            ACPI.Initialize();
+
+            APIC = HAL::APICController();
+            APIC.Initialize();
+
             ThreadMgr = Threading::ThreadManager();
             ThreadMgr.Initialize();
 
-            PIT = HAL::PITController();
-            PIT.Initialize(5000, ThreadMgr.Schedule);
+            // every processor preempts on its own local apic timer, the pit was only needed to calibrate it
+            APICTimer = HAL::APICTimerController();
+            APICTimer.Initialize(1000, ThreadMgr.Schedule);
+
+            TimerMgr = Services::TimerManager();
+            TimerMgr.Initialize();
+
+            WorkMgr = Services::WorkManager();
+            WorkMgr.Initialize();
+
+            // the kernel thread runs the command line and vm runtimes as tasks on this loop
+            MainLoop = Services::EventLoop();
+            MainLoop.Initialize("mainloop");
+
+            // the xserver draws on a loop of its own, its thread is deadline scheduled while frames are being drawn
+            UILoop = Services::EventLoop();
+            UILoop.Initialize("uiloop");
 
             RTC = HAL::RTCController();
             RTC.Initialize();
@@ -91,10 +144,10 @@ namespace PMOS
         void BootStage2()
         {
             SpawnIdleThread();
+            MemoryMgr.StartZeroThread();
+            WorkMgr.Start();
+            UILoop.Start(ThreadPriority::High);
 
-            CPU = HAL::CPUManager();
-            CPU.Detect();
-            
             PCI.Initialize();
          
             Keyboard = new HAL::Drivers::PS2Keyboard();
@@ -106,6 +159,8 @@ namespace PMOS
             InterruptMgr.EnableInterrupts();
             Debug.Info("Enabled interrupts");
 
+            SMP.Start();
+
             CLI = new Services::CommandLine();
             CLI->Initialize();
 
@@ -124,43 +179,27 @@ namespace PMOS
             CLI->Debug.WriteLine("MEM USED: %d bytes(%d MB)", MemoryMgr.GetRAMUsed(), MemoryMgr.GetRAMUsed() / 1024 / 1024);
         }
 
-        void Run()
-        {
-            if (XServer != nullptr)
-            {
-                if (XServer->IsStarted()) { XServer->Update(); return; }
-            }
-
-            if (CLI != nullptr) { CLI->Execute(); }
-
-            if (CLI->Terminated) { Kernel::ServiceMgr.Stop(CLI); CLI->Terminated = false; }
-        }
-
-        void PITCallback(uint* regs)
+        void TimerCallback(uint* regs)
         {
-            PIT.CalculateMilliseconds();
-            RTC.Update();
+            APICTimer.CalculateMilliseconds();
+            TimerMgr.Tick((uint)APICTimer.GetTotalMilliseconds());
         }
 
         void ThreadCallback(Threading::Thread* t)
         {
+            UNUSED(t);
             BootStage2();
 
             CLI->PrintCaret();
 
-            while (true) 
-            { 
-                t->CalculateTPS();
-                Run(); 
-            }
+            // never returns, the thread sleeps whenever no task is ready
+            MainLoop.Run();
         }
 
         void IdleThreadCallback(Threading::Thread* t)
         {
-            while (true)
-            {
-                t->CalculateTPS();
-            }
+            UNUSED(t);
+            while (true) { ThreadMgr.Idle(); }
         }
 
         void FetchMultiboot()
@@ -179,8 +218,9 @@ namespace PMOS
         void SpawnIdleThread()
         {
             if (IdleThread != nullptr) { return; }
-            IdleThread = ThreadMgr.Create("idle", 8192, ThreadPriority::Protected, IdleThreadCallback);
-            IdleThread->Start();
+            IdleThread = ThreadMgr.Create("idle", 8192, ThreadPriority::Low, IdleThreadCallback);
+            SMP.Get(0)->IdleThread = IdleThread;
+            IdleThread->StartOn(0);
         }
 
         uint GetStartAddress() { return (uint)&KernelStart; }
@@ -0,0 +1,160 @@
+#include <Kernel/HAL/ACPI.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // table signatures are not terminated
+        bool SignatureEquals(void* table, const char* sig, uint length)
+        {
+            for (uint i = 0; i < length; i++) { if (((char*)table)[i] != sig[i]) { return false; } }
+            return true;
+        }
+
+        // only the madt is read, everything needed from it is copied out so the tables can be left behind
+        void ACPIManager::Initialize()
+        {
+            LocalAPICAddress = 0;
+            IOAPICAddress    = 0;
+            IOAPICBase       = 0;
+            IOAPICID         = 0;
+            ProcessorCount   = 0;
+            OverrideCount    = 0;
+            Available        = false;
+
+            ACPIRSDP* rsdp = FindRSDP();
+            if (rsdp == nullptr) { Kernel::Debug.Warning("ACPI tables not found, running on a single processor"); return; }
+
+            ACPIHeader* rsdt = (ACPIHeader*)rsdp->RSDT;
+            if (!Validate(rsdt, rsdt->Length)) { Kernel::Debug.Warning("Invalid ACPI root table at 0x%8x", (uint)rsdt); return; }
+
+            uint count = (rsdt->Length - sizeof(ACPIHeader)) / 4;
+            uint* tables = (uint*)((uint)rsdt + sizeof(ACPIHeader));
+            for (uint i = 0; i < count; i++)
+            {
+                ACPIHeader* table = (ACPIHeader*)tables[i];
+                if (!SignatureEquals(table->Signature, "APIC", 4)) { continue; }
+                if (!Validate(table, table->Length)) { Kernel::Debug.Warning("Invalid MADT checksum"); return; }
+                ParseMADT((ACPIMADT*)table);
+                break;
+            }
+
+            Available = LocalAPICAddress != 0 && IOAPICAddress != 0 && ProcessorCount > 0;
+            if (!Available) { Kernel::Debug.Warning("No usable MADT, running on a single processor"); return; }
+            Kernel::Debug.OK("Parsed ACPI tables - %d processors, io apic at 0x%8x", ProcessorCount, IOAPICAddress);
+        }
+
+        void ACPIManager::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("MADT", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" --------------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("LOCAL APIC    0x%8x", LocalAPICAddress);
+            Kernel::Debug.WriteLine("IO APIC       0x%8x(id = %d, gsi = %d)", IOAPICAddress, (uint)IOAPICID, IOAPICBase);
+            for (uint i = 0; i < OverrideCount; i++) { Kernel::Debug.WriteLine("IRQ %d        GSI %d, FLAGS 0x%4x", (uint)Overrides[i].Source, Overrides[i].GSI, (uint)Overrides[i].Flags); }
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        bool ACPIManager::IsAvailable() { return Available; }
+
+        uint ACPIManager::GetProcessorCount() { return ProcessorCount; }
+
+        byte ACPIManager::GetAPICID(uint index) { return (index < ProcessorCount) ? APICIDs[index] : 0xFF; }
+
+        // io apic input an isa irq arrives on, with its polarity and trigger flags
+        uint ACPIManager::GetGSI(byte irq, ushort* flags)
+        {
+            for (uint i = 0; i < OverrideCount; i++)
+            {
+                if (Overrides[i].Source != irq) { continue; }
+                if (flags != nullptr) { *flags = Overrides[i].Flags; }
+                return Overrides[i].GSI;
+            }
+            if (flags != nullptr) { *flags = 0; }
+            return irq;
+        }
+
+        // the rsdp is in the first kilobyte of the ebda or in the bios area below 1 MB
+        ACPIRSDP* ACPIManager::FindRSDP()
+        {
+            uint ebda = (uint)(*(ushort*)0x40E) << 4;
+            ACPIRSDP* rsdp = nullptr;
+            if (ebda >= 0x80000 && ebda < 0xA0000) { rsdp = ScanRSDP(ebda, 1024); }
+            if (rsdp == nullptr) { rsdp = ScanRSDP(0xE0000, 0x20000); }
+            return rsdp;
+        }
+
+        ACPIRSDP* ACPIManager::ScanRSDP(uint start, uint length)
+        {
+            for (uint addr = start; addr < start + length; addr += 16)
+            {
+                if (!SignatureEquals((void*)addr, "RSD PTR ", 8)) { continue; }
+                if (Validate((void*)addr, 20)) { return (ACPIRSDP*)addr; }
+            }
+            return nullptr;
+        }
+
+        bool ACPIManager::Validate(void* table, uint length)
+        {
+            if (table == nullptr || length == 0) { return false; }
+            byte sum = 0;
+            for (uint i = 0; i < length; i++) { sum += ((byte*)table)[i]; }
+            return sum == 0;
+        }
+
+        void ACPIManager::ParseMADT(ACPIMADT* madt)
+        {
+            LocalAPICAddress = madt->LocalAPIC;
+
+            uint addr = (uint)madt + sizeof(ACPIMADT);
+            uint end  = (uint)madt + madt->Header.Length;
+            while (addr + sizeof(MADTEntry) <= end)
+            {
+                MADTEntry* entry = (MADTEntry*)addr;
+                if (entry->Length < sizeof(MADTEntry)) { break; }
+
+                switch (entry->Type)
+                {
+                    // bit 0 - enabled, disabled processors cannot be started
+                    case MADT_LOCAL_APIC:
+                    {
+                        MADTLocalAPIC* lapic = (MADTLocalAPIC*)entry;
+                        if (!(lapic->Flags & 1)) { break; }
+                        if (ProcessorCount < ACPI_MAX_PROCESSORS) { APICIDs[ProcessorCount++] = lapic->APICID; }
+                        break;
+                    }
+
+                    // only the io apic carrying the isa irqs is used
+                    case MADT_IO_APIC:
+                    {
+                        MADTIOAPIC* ioapic = (MADTIOAPIC*)entry;
+                        if (IOAPICAddress != 0 && ioapic->GSIBase != 0) { break; }
+                        IOAPICAddress = ioapic->Address;
+                        IOAPICBase    = ioapic->GSIBase;
+                        IOAPICID      = ioapic->IOAPICID;
+                        break;
+                    }
+
+                    case MADT_OVERRIDE:
+                    {
+                        MADTOverride* ovr = (MADTOverride*)entry;
+                        if (ovr->Bus != 0 || OverrideCount >= ACPI_MAX_OVERRIDES) { break; }
+                        Overrides[OverrideCount].Source = ovr->Source;
+                        Overrides[OverrideCount].GSI    = ovr->GSI;
+                        Overrides[OverrideCount].Flags  = ovr->Flags;
+                        OverrideCount++;
+                        break;
+                    }
+
+                    default: { break; }
+                }
+                addr += entry->Length;
+            }
+        }
+    }
+}
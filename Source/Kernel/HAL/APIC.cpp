@@ -0,0 +1,145 @@
+#include <Kernel/HAL/APIC.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // take interrupt delivery over from the pic - the isa irqs are routed through the io apic to the boot processor
+        void APICController::Initialize()
+        {
+            Enabled = false;
+            if (!Kernel::CPU.Features.APIC || !Kernel::ACPI.IsAvailable()) { Kernel::Debug.Warning("No APIC available, interrupts stay on the PIC"); return; }
+
+            LocalBase = (volatile uint*)Kernel::ACPI.LocalAPICAddress;
+            IOBase    = (volatile uint*)Kernel::ACPI.IOAPICAddress;
+            Kernel::Paging.MapDevice((uint)LocalBase);
+            Kernel::Paging.MapDevice((uint)IOBase);
+
+            // make sure the apic is globally enabled, some firmware leaves it off
+            if (Kernel::CPU.Instructions.MSR)
+            {
+                uint lo, hi;
+                asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(0x1B));
+                if (!(lo & 0x800)) { asm volatile("wrmsr" : : "a"(lo | 0x800), "d"(hi), "c"(0x1B)); }
+            }
+
+            InitializeLocal();
+
+            Redirections = ((ReadIO(IOAPIC_VER) >> 16) & 0xFF) + 1;
+            for (uint i = 0; i < Redirections; i++) { WriteIO(IOAPIC_REDIR + (i * 2), APIC_MASKED); }
+
+            // irq 2 is only the cascade from the slave pic
+            uint bsp = GetID();
+            for (byte irq = 0; irq < 16; irq++)
+            {
+                if (irq == 2) { continue; }
+                ushort flags;
+                uint gsi = Kernel::ACPI.GetGSI(irq, &flags) - Kernel::ACPI.IOAPICBase;
+                if (gsi >= Redirections) { continue; }
+
+                uint entry = IRQ0 + irq;
+                if ((flags & 0x03) == 0x03) { entry |= 0x2000; }
+                if (((flags >> 2) & 0x03) == 0x03) { entry |= 0x8000; }
+                WriteIO(IOAPIC_REDIR + (gsi * 2) + 1, bsp << 24);
+                WriteIO(IOAPIC_REDIR + (gsi * 2), entry);
+            }
+
+            // the pic stays programmed but masked, bios calls made after this point would need it back
+            Ports::Write8(0x21, 0xFF);
+            Ports::Write8(0xA1, 0xFF);
+
+            Enabled = true;
+            Kernel::Debug.OK("Initialized APIC(id = %d, io redirections = %d)", bsp, Redirections);
+        }
+
+        // runs on every processor as it comes up
+        void APICController::InitializeLocal()
+        {
+            Write(LAPIC_TPR, 0);
+            Write(LAPIC_LVT_TIMER, APIC_MASKED);
+            Write(LAPIC_LINT0, APIC_MASKED);
+            Write(LAPIC_LINT1, ICR_NMI);
+            Write(LAPIC_LVT_ERROR, APIC_MASKED);
+            Write(LAPIC_ESR, 0);
+            Write(LAPIC_ESR, 0);
+            Write(LAPIC_SVR, APIC_ENABLE | IRQ_SPURIOUS);
+            EOI();
+        }
+
+        bool APICController::IsEnabled() { return Enabled; }
+
+        uint APICController::GetID() { return Read(LAPIC_ID) >> 24; }
+
+        void APICController::EOI() { Write(LAPIC_EOI, 0); }
+
+        // the command register is written in two halves, so an irq handler sending its own ipi in between is kept out
+        void APICController::SendIPI(uint apic, byte vector)
+        {
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            WaitICR();
+            Write(LAPIC_ICR_HIGH, apic << 24);
+            Write(LAPIC_ICR_LOW, vector | ICR_FIXED | ICR_ASSERT);
+            if (flags & 0x200) { asm volatile("sti"); }
+        }
+
+        void APICController::BroadcastIPI(byte vector)
+        {
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            WaitICR();
+            Write(LAPIC_ICR_LOW, vector | ICR_FIXED | ICR_ASSERT | ICR_OTHERS);
+            if (flags & 0x200) { asm volatile("sti"); }
+        }
+
+        // stops the other processors even with their interrupts off
+        void APICController::BroadcastNMI()
+        {
+            if (!Enabled) { return; }
+            WaitICR();
+            Write(LAPIC_ICR_LOW, ICR_NMI | ICR_ASSERT | ICR_OTHERS);
+        }
+
+        void APICController::SendInit(uint apic)
+        {
+            WaitICR();
+            Write(LAPIC_ICR_HIGH, apic << 24);
+            Write(LAPIC_ICR_LOW, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+            WaitICR();
+            Write(LAPIC_ICR_HIGH, apic << 24);
+            Write(LAPIC_ICR_LOW, ICR_INIT | ICR_LEVEL);
+            WaitICR();
+        }
+
+        // the processor starts in real mode at the page given as the vector
+        void APICController::SendStartup(uint apic, uint addr)
+        {
+            WaitICR();
+            Write(LAPIC_ICR_HIGH, apic << 24);
+            Write(LAPIC_ICR_LOW, ICR_STARTUP | ((addr >> 12) & 0xFF));
+            WaitICR();
+        }
+
+        uint APICController::Read(uint reg) { return LocalBase[reg / 4]; }
+
+        void APICController::Write(uint reg, uint value) { LocalBase[reg / 4] = value; }
+
+        uint APICController::ReadIO(uint reg)
+        {
+            IOBase[IOAPIC_SELECT / 4] = reg;
+            return IOBase[IOAPIC_WINDOW / 4];
+        }
+
+        void APICController::WriteIO(uint reg, uint value)
+        {
+            IOBase[IOAPIC_SELECT / 4] = reg;
+            IOBase[IOAPIC_WINDOW / 4] = value;
+        }
+
+        void APICController::WaitICR()
+        {
+            for (uint i = 0; i < 0x100000 && (Read(LAPIC_ICR_LOW) & ICR_PENDING); i++) { asm volatile("pause"); }
+        }
+    }
+}
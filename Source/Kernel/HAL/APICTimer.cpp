@@ -0,0 +1,175 @@
+#include <Kernel/HAL/APICTimer.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // calibrate on the boot processor and start its tick, application processors start their own as they come up
+        void APICTimerController::Initialize(uint freq, ISR callback)
+        {
+            Callback          = callback;
+            Enabled           = false;
+            CountsPerMS       = 0;
+            Period            = 0;
+            Milliseconds      = 0;
+            TotalMilliseconds = 0;
+            MillisTick        = 0;
+            Ticks             = 0;
+            Residual          = 0;
+
+            // set frequency value
+            if (freq == 0) { freq = 1; }
+            if (freq > 5000) { Frequency = 5000; }
+            else { Frequency = freq; }
+
+            // without a usable local apic timer the pit keeps ticking the boot processor at a fixed rate
+            if (!Kernel::APIC.IsEnabled() || !Calibrate())
+            {
+                Kernel::PIT.Initialize(Frequency, Callback);
+                Frequency = Kernel::PIT.GetFrequency();
+                Kernel::Debug.Warning("No APIC timer, the PIT drives the scheduler");
+                return;
+            }
+
+            Period = (CountsPerMS * 1000) / Frequency;
+            if (Period == 0) { Period = 1; }
+
+            Kernel::PIT.Disable();
+            Kernel::InterruptMgr.Register(IRQ_TIMER, Callback);
+            Enabled = true;
+            InitializeLocal();
+
+            Kernel::Debug.Info("Initialized APIC timer(freq = %d, counts per ms = %d)", Frequency, CountsPerMS);
+        }
+
+        // runs on every processor as it comes up, the divider and period were found on the boot processor
+        void APICTimerController::InitializeLocal()
+        {
+            if (!Enabled) { return; }
+
+            Kernel::APIC.Write(LAPIC_TIMER_DIV, APIC_TIMER_DIV16);
+            SMPManager::GetCurrent()->Timer = TimerMode::Periodic;
+            SetPeriodic();
+        }
+
+        // called on every tick of the boot processor, a finished idle countdown stands for all the ticks it skipped
+        void APICTimerController::CalculateMilliseconds()
+        {
+            if (Enabled && SMPManager::GetCurrent()->Timer != TimerMode::Periodic) { Resume(); return; }
+            AddTicks(1);
+        }
+
+        // stop the periodic tick and interrupt once after ms milliseconds
+        void APICTimerController::SetOneShot(uint ms)
+        {
+            Processor* cpu = SMPManager::GetCurrent();
+            if (!Enabled || cpu->Timer != TimerMode::Periodic) { return; }
+
+            if (ms > APIC_TIMER_ONESHOT_MAX) { ms = APIC_TIMER_ONESHOT_MAX; }
+            uint count = ms * CountsPerMS;
+            if (count <= Period) { return; }
+
+            cpu->TimerCount = count;
+            cpu->Timer = TimerMode::OneShot;
+            Kernel::APIC.Write(LAPIC_LVT_TIMER, IRQ_TIMER);
+            Kernel::APIC.Write(LAPIC_TIMER_INIT, count);
+        }
+
+        // silence the tick of a processor that has nothing to run, an ipi wakes it again - the boot processor keeps the time and never stops
+        void APICTimerController::Stop()
+        {
+            Processor* cpu = SMPManager::GetCurrent();
+            if (!Enabled || cpu->Index == 0 || cpu->Timer != TimerMode::Periodic) { return; }
+
+            cpu->Timer = TimerMode::Stopped;
+            Kernel::APIC.Write(LAPIC_TIMER_INIT, 0);
+            Kernel::APIC.Write(LAPIC_LVT_TIMER, APIC_MASKED | IRQ_TIMER);
+        }
+
+        // go back to the periodic tick, charging the time spent in a countdown
+        void APICTimerController::Resume()
+        {
+            if (!Enabled) { return; }
+            Processor* cpu = SMPManager::GetCurrent();
+            if (cpu->Timer == TimerMode::Periodic) { return; }
+
+            // the current count stays at zero once a one shot countdown ran out
+            uint elapsed = 0;
+            if (cpu->Timer == TimerMode::OneShot)
+            {
+                uint remaining = Kernel::APIC.Read(LAPIC_TIMER_CUR);
+                elapsed = (remaining <= cpu->TimerCount) ? cpu->TimerCount - remaining : cpu->TimerCount;
+            }
+
+            cpu->Timer = TimerMode::Periodic;
+            SetPeriodic();
+            if (elapsed == 0) { return; }
+
+            Residual += elapsed;
+            AddTicks(Residual / Period);
+            Residual %= Period;
+        }
+
+        // count the timer down from its maximum across a pit countdown, interrupts are still off so nothing else runs in between
+        bool APICTimerController::Calibrate()
+        {
+            Kernel::APIC.Write(LAPIC_TIMER_DIV, APIC_TIMER_DIV16);
+            Kernel::APIC.Write(LAPIC_LVT_TIMER, APIC_MASKED | IRQ_TIMER);
+
+            Kernel::PIT.StartCountdown(APIC_TIMER_CALIBRATE_MS);
+            Kernel::APIC.Write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+            uint spins = 0;
+            while (!Kernel::PIT.CountdownExpired()) { if (++spins == 0x4000000) { break; } }
+            uint remaining = Kernel::APIC.Read(LAPIC_TIMER_CUR);
+            Kernel::APIC.Write(LAPIC_TIMER_INIT, 0);
+
+            if (spins == 0x4000000) { Kernel::Debug.Warning("APIC timer calibration timed out"); return false; }
+            CountsPerMS = (0xFFFFFFFF - remaining) / APIC_TIMER_CALIBRATE_MS;
+            return CountsPerMS > 0;
+        }
+
+        // writing the initial count starts the countdown, so the mode goes first
+        void APICTimerController::SetPeriodic()
+        {
+            Kernel::APIC.Write(LAPIC_LVT_TIMER, IRQ_TIMER | APIC_TIMER_PERIODIC);
+            Kernel::APIC.Write(LAPIC_TIMER_INIT, Period);
+        }
+
+        void APICTimerController::AddTicks(uint ticks)
+        {
+            uint per_ms = (Frequency < 1000) ? 1 : Frequency / 1000;
+            Ticks += ticks;
+            MillisTick += ticks;
+
+            // milliseconds that have passed
+            while (MillisTick >= per_ms)
+            {
+                Milliseconds++;
+                TotalMilliseconds++;
+                MillisTick -= per_ms;
+
+                // reset current millisecond timer
+                if (Milliseconds >= 1000) { Milliseconds = 0; }
+            }
+        }
+
+        bool APICTimerController::IsEnabled() { return Enabled; }
+
+        // ticks per second on every processor
+        uint APICTimerController::GetFrequency() { return Frequency; }
+
+        // timer counts per millisecond after the divider, zero while the pit stands in
+        uint APICTimerController::GetCountsPerMS() { return CountsPerMS; }
+
+        // get current millisecond within the second
+        uint APICTimerController::GetMilliseconds() { return Milliseconds; }
+
+        // get total amount of passed milliseconds
+        ulong APICTimerController::GetTotalMilliseconds() { return TotalMilliseconds; }
+
+        // ticks of the boot processor, including the ones skipped while idle
+        uint APICTimerController::GetTicks() { return Ticks; }
+    }
+}
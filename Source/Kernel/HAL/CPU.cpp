@@ -67,6 +67,8 @@
 #define EDX_RDTSCP                      (1 << 27)   // RDTSCP and IA32_TSC_AUX
 #define EDX_64_BIT                      (1 << 29)   // 64-bit Architecture
 
+#define EDX_INVARIANT_TSC               (1 << 8)    // TSC Runs at a Constant Rate in all ACPI States
+
 namespace PMOS
 {
     namespace HAL
@@ -96,6 +98,7 @@ namespace PMOS
                 Features.PAE  = (edx & EDX_PAE);
                 Features.APIC = (edx & EDX_APIC);
                 Features.MTRR = (edx & EDX_MTRR);
+                Features.FXSR = (edx & EDX_FXSR);
 
                 Instructions.MMX = (edx & EDX_MMX);
                 Instructions.TSC = (edx & EDX_TSC);
@@ -121,6 +124,13 @@ namespace PMOS
                 X64Compatible = edx & EDX_64_BIT;
             }
 
+            // Extended Function 0x07 - Advanced Power Management
+            if (largestExtendedFunc >= 0x80000007)
+            {
+                GetCPUInfo(0x80000007, &eax, &ebx, &ecx, &edx);
+                Features.InvariantTSC = edx & EDX_INVARIANT_TSC;
+            }
+
             // Extended Function 0x02-0x04 - Processor Name / Brand String
             if (largestExtendedFunc >= 0x80000004)
             {
@@ -137,6 +147,53 @@ namespace PMOS
             }
         }
 
+        // low half of the time stamp counter, zero if the cpu has none
+        uint CPUManager::ReadTSC()
+        {
+            if (!Instructions.TSC) { return 0; }
+            uint low, high;
+            asm volatile("rdtsc" : "=a" (low), "=d" (high));
+            return low;
+        }
+
+        // full time stamp counter, zero if the cpu has none
+        ulonglong CPUManager::ReadCycles()
+        {
+            if (!Instructions.TSC) { return 0; }
+            uint low, high;
+            asm volatile("rdtsc" : "=a" (low), "=d" (high));
+            return ((ulonglong)high << 32) | low;
+        }
+
+        // count tsc cycles across a 50 ms countdown on pit channel 2
+        void CPUManager::CalibrateTSC()
+        {
+            TSCFrequency = 0;
+            if (!Instructions.TSC) { Kernel::Debug.Warning("CPU has no time stamp counter"); return; }
+
+            Kernel::PIT.StartCountdown(TSC_CALIBRATE_MS);
+
+            ulonglong start = ReadCycles();
+            uint spins = 0;
+            while (!Kernel::PIT.CountdownExpired()) { if (++spins == 0x4000000) { break; } }
+            ulonglong cycles = ReadCycles() - start;
+
+            if (spins == 0x4000000) { Kernel::Debug.Warning("TSC calibration timed out"); return; }
+            TSCFrequency = (uint)(cycles / TSC_CALIBRATE_MS);
+            Kernel::Debug.Info("TSC FREQUENCY    %d MHz", TSCFrequency / 1000);
+        }
+
+        uint CPUManager::GetTSCFrequency() { return TSCFrequency; }
+
+        // let sse instructions execute - clear cr0.EM, set cr0.MP, then cr4.OSFXSR and cr4.OSXMMEXCPT
+        bool CPUManager::EnableSSE()
+        {
+            if (!Instructions.SSE) { return false; }
+            asm volatile("mov %%cr0, %%eax; and $0xFFFFFFFB, %%eax; or $0x02, %%eax; mov %%eax, %%cr0" : : : "eax");
+            asm volatile("mov %%cr4, %%eax; or $0x600, %%eax; mov %%eax, %%cr4" : : : "eax");
+            return true;
+        }
+
         void CPUManager::GetCPUInfo(uint reg, uint* eax, uint* ebx, uint* ecx, uint* edx)
         {
             asm volatile("cpuid"
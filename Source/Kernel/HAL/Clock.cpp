@@ -0,0 +1,57 @@
+#include <Kernel/HAL/Clock.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // needs the calibrated tsc frequency, without one the clock only moves with the timer tick
+        void ClockController::Initialize()
+        {
+            Base       = Kernel::CPU.ReadCycles();
+            WallOffset = 0;
+            Mult       = 0;
+            Shift      = 0;
+
+            uint khz = Kernel::CPU.GetTSCFrequency();
+            TSC = khz > 0;
+            if (!TSC) { Kernel::Debug.Warning("Clock has no time stamp counter, falling back to the timer tick"); return; }
+
+            // nanoseconds per cycle as a 32 bit fraction with as many bits after the point as fit
+            Shift = 32;
+            while (Shift > 0 && ((CLOCK_NS_PER_MS << Shift) / khz) > 0xFFFFFFFFULL) { Shift--; }
+            Mult = (uint)((CLOCK_NS_PER_MS << Shift) / khz);
+
+            // a tsc that changes rate with power states still counts up, only not at the calibrated rate
+            if (!Kernel::CPU.Features.InvariantTSC) { Kernel::Debug.Warning("Time stamp counter is not invariant, clock may drift"); }
+            Kernel::Debug.OK("Initialized clock(%d MHz)", khz / 1000);
+        }
+
+        // seconds since 1970 as of now, read once from the rtc
+        void ClockController::SetWallTime(uint seconds) { WallOffset = ((ulonglong)seconds * CLOCK_NS_PER_SEC) - GetNanoseconds(); }
+
+        // cycles times the fraction in two 32 by 32 bit multiplies, so a read costs no division
+        ulonglong ClockController::GetNanoseconds()
+        {
+            if (!TSC) { return (ulonglong)Kernel::APICTimer.GetTotalMilliseconds() * CLOCK_NS_PER_MS; }
+
+            uint low, high;
+            asm volatile("rdtsc" : "=a"(low), "=d"(high));
+            ulonglong delta = (((ulonglong)high << 32) | low) - Base;
+            uint dlow  = (uint)delta;
+            uint dhigh = (uint)(delta >> 32);
+            return (((ulonglong)dhigh * Mult) << (32 - Shift)) + (((ulonglong)dlow * Mult) >> Shift);
+        }
+
+        ulonglong ClockController::GetMicroseconds() { return GetNanoseconds() / CLOCK_NS_PER_US; }
+
+        ulonglong ClockController::GetMilliseconds() { return GetNanoseconds() / CLOCK_NS_PER_MS; }
+
+        ulonglong ClockController::GetWallNanoseconds() { return GetNanoseconds() + WallOffset; }
+
+        uint ClockController::GetWallSeconds() { return (uint)(GetWallNanoseconds() / CLOCK_NS_PER_SEC); }
+
+        // false when the clock only advances in whole timer ticks
+        bool ClockController::IsPrecise() { return TSC; }
+    }
+}
@@ -1,6 +1,8 @@
 #include <Kernel/HAL/Drivers/Input/PS2Keyboard.hpp>
 #include <Kernel/Core/Kernel.hpp>
 
+void PS2KeyboardWork(void* data, uint code);
+
 void PS2KeyboardCallback(Registers32 regs)
 {
     // check status
@@ -10,13 +12,20 @@ void PS2KeyboardCallback(Registers32 regs)
     // read scancode
     byte code = PMOS::HAL::Ports::Read8(0x60);
 
-    // handle keyboard input
-    PMOS::Kernel::Keyboard->Handle(code);
+    // only the key state is kept here, the stream and the terminal are updated from the work queue
+    PMOS::Kernel::Keyboard->UpdateKeymap(code);
+    PMOS::Kernel::WorkMgr.Defer(PS2KeyboardWork, PMOS::Kernel::Keyboard, code);
 
     // unused register argument
     UNUSED(regs);
 }
 
+// deferred part of the keyboard irq, runs on the worker thread
+void PS2KeyboardWork(void* data, uint code)
+{
+    ((PMOS::HAL::Drivers::PS2Keyboard*)data)->Handle((byte)code);
+}
+
 namespace PMOS
 {
     namespace HAL
@@ -65,14 +74,9 @@ namespace PMOS
                 Kernel::Debug.Warning("Stopped PS/2 keyboard driver");
             }
 
-            // handle keyboard input
+            // handle keyboard input, called from the work queue so writing to the terminal does not hold up interrupts
             void PS2Keyboard::Handle(byte key)
             {
-                CurrentKey = key;
-
-                if (key <= 0x58) { Keymap[(int)key] = true; }
-                else if (key >= 0x81 && key < 0xD8) { Keymap[(int)key - 128] = false; }
-                
                 if (CurrentStream != nullptr)
                 {
                     char* out = (char*)CurrentStream->ToArray();
@@ -124,10 +128,13 @@ namespace PMOS
             // clear all states in keymap array
             void PS2Keyboard::ClearKeymap() { for (ushort i = 0; i < 256; i++) { Keymap[i] = 0; } }
 
-            // get key states and store them in keymap array
-            void PS2Keyboard::UpdateKeymap()
+            // store the state of the key in keymap array, called straight from the irq
+            void PS2Keyboard::UpdateKeymap(byte key)
             {
-                
+                CurrentKey = key;
+
+                if (key <= 0x58) { Keymap[(int)key] = true; }
+                else if (key >= 0x81 && key < 0xD8) { Keymap[(int)key - 128] = false; }
             }
 
             bool PS2Keyboard::IsKeyDown(Key key)
@@ -15,6 +15,16 @@ extc
         IDT[n].HighOffset = HighBits16(handler);
     }
 
+    // task gates switch to the task state segment behind the selector instead of calling a handler
+    void IDTSetTaskGate(int n, ushort selector)
+    {
+        IDT[n].LowOffset  = 0;
+        IDT[n].Selector   = selector;
+        IDT[n].AlwaysZero = 0;
+        IDT[n].Flags      = 0x85;
+        IDT[n].HighOffset = 0;
+    }
+
     void IDTSet()
     {
         IDTReg.Base = (uint)&IDT;
@@ -11,18 +11,18 @@ isr_common_stub:
 	mov ax, 0x10  ; kernel data segment descriptor
 	mov ds, ax
 	mov es, ax
-	mov fs, ax
-	mov gs, ax
+	mov fs, ax    ; gs is the per processor segment and is left alone
 	
-    ; 2. Call C handler
+    ; 2. Call C handler with a pointer to the saved state
+	push esp
 	call ISRHandler
+	add esp, 4
 	
     ; 3. Restore state
 	pop eax 
 	mov ds, ax
 	mov es, ax
 	mov fs, ax
-	mov gs, ax
 	popa
 	add esp, 8 ; Cleans up the pushed error code and pushed ISR number
 	sti
@@ -47,7 +47,6 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     push esp
     call IRQHandler ; Different than the ISR code
     pop esp
@@ -72,6 +71,16 @@ irq_common_stub:
     sti
     iret
 
+; Page faults arrive through a task gate on their own stack with the error code pushed.
+; iret switches back to the faulting task, and the next fault resumes right after it.
+[extern PageFaultHandler]
+[global PageFaultTask]
+PageFaultTask:
+    call PageFaultHandler
+    add esp, 4
+    iret
+    jmp PageFaultTask
+
 [extern SysCallHandler]
 scall_common_stub:
     push eax
@@ -168,6 +177,11 @@ global irq12
 global irq13
 global irq14
 global irq15
+global irq_yield
+global irq_schedule
+global irq_flush
+global irq_timer
+global irq_spurious
 
 ; 0: Divide By Zero Exception
 isr0:
@@ -484,6 +498,35 @@ irq15:
 	push byte 47
 	jmp irq_common_stub
 
+; thread yield, dword push because 0x81 does not fit a signed byte
+irq_yield:
+	cli
+	push byte 0
+	push dword 0x81
+	jmp irq_common_stub
+
+irq_schedule:
+	cli
+	push byte 0
+	push dword 0xF0
+	jmp irq_common_stub
+
+irq_flush:
+	cli
+	push byte 0
+	push dword 0xF1
+	jmp irq_common_stub
+
+irq_timer:
+	cli
+	push byte 0
+	push dword 0xF2
+	jmp irq_common_stub
+
+; spurious apic interrupts have no handler and must not be acknowledged
+irq_spurious:
+	iret
+
 global syscall
 syscall:
     cli
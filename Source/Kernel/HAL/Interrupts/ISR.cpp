@@ -110,6 +110,15 @@ extc
         IDTSetGate(46, (uint)irq14);
         IDTSetGate(47, (uint)irq15);
 
+        // install the thread yield irq
+        IDTSetGate(IRQ_YIELD, (uint)irq_yield);
+
+        // install the inter processor interrupts, the local apic timer and the spurious vector
+        IDTSetGate(IRQ_SCHEDULE, (uint)irq_schedule);
+        IDTSetGate(IRQ_FLUSH, (uint)irq_flush);
+        IDTSetGate(IRQ_TIMER, (uint)irq_timer);
+        IDTSetGate(IRQ_SPURIOUS, (uint)irq_spurious);
+
         // install the system call irq
         IDTSetGate(128, (uint)syscall);
         
@@ -126,6 +135,14 @@ extc
     {
         ISRRegs* r = (ISRRegs*)regs;
 
+        // exceptions with a registered handler are recoverable, e.g. #NM for lazy fpu switching
+        if (r->Interrupt < 32 && InterruptHandlers[r->Interrupt] != 0)
+        {
+            uint ptr = (uint)regs;
+            InterruptHandlers[r->Interrupt](&ptr);
+            return;
+        }
+
         /* THROW PANIC */
         if (r->Interrupt  < 0 || r->Interrupt >= 32) 
         { 
@@ -141,12 +158,20 @@ extc
     {
         Registers32* r = (Registers32*)regs;
 
+        // the depth is kept per processor, the handler runs to the end on this cpu even when it switches threads
+        PMOS::HAL::Processor* cpu = PMOS::HAL::SMPManager::GetCurrent();
+        cpu->IRQDepth++;
         if (InterruptHandlers[r->Interrupt] != 0) 
         {
             ISR handler = InterruptHandlers[r->Interrupt];
             handler(&regs);
         }
+        cpu->IRQDepth--;
 
+        // software raised vectors have nothing to acknowledge, ipis and io apic irqs go to the local apic
+        if (r->Interrupt > IRQ15 && r->Interrupt < IRQ_SCHEDULE) { return regs; }
+        if (PMOS::Kernel::APIC.IsEnabled()) { PMOS::Kernel::APIC.EOI(); return regs; }
+        if (r->Interrupt > IRQ15) { return regs; }
         if (r->Interrupt >= 40) { PMOS::HAL::Ports::Write8(0xA0, 0x20); }
         PMOS::HAL::Ports::Write8(0x20, 0x20);
 
@@ -182,5 +207,8 @@ namespace PMOS
         // toggle interrupts
         void InterruptManager::EnableInterrupts()  { asm volatile("sti"); }
         void InterruptManager::DisableInterrupts() { asm volatile("cli"); }
+
+        // check if an irq handler is running
+        bool InterruptManager::InInterrupt() { return SMPManager::GetIRQDepth() > 0; }
 }
 }
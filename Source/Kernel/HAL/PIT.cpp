@@ -5,7 +5,7 @@ namespace PMOS
 {
     namespace HAL
     {
-        // initialize pit controller
+        // initialize pit controller as a periodic tick on irq 0
         void PITController::Initialize(uint freq, ISR callback)
         {
             // validate frequency
@@ -19,19 +19,12 @@ namespace PMOS
             if (freq > 5000) { Frequency = 5000; }
             else { Frequency = freq; }
 
-            // pack frequency
-            uint f = 1193180 / Frequency;
-            byte high = (byte)((f & 0xFF00) >> 8);
-            byte low  = (byte)((f & 0x00FF));
-
-            Milliseconds = 0;
-            TotalMilliseconds = 0;
-            MillisTick = 0;
+            Divisor = PIT_CLOCK / Frequency;
 
             // send frequency data to pit
             Ports::Write8(0x43, 0x36);
-            Ports::Write8(0x40, low);
-            Ports::Write8(0x40, high);
+            Ports::Write8(0x40, (byte)(Divisor & 0xFF));
+            Ports::Write8(0x40, (byte)((Divisor >> 8) & 0xFF));
 
             Kernel::Debug.Info("Initialized PIT(freq = %d, callback = 0x%8x)", freq, (uint)callback);
         }
@@ -41,38 +34,31 @@ namespace PMOS
         {
             // unregister interrupt
             Kernel::InterruptMgr.Unregister(IRQ0);
+
+            // a mode change without a new count leaves channel 0 waiting, so the tick the bios left running stops
+            Ports::Write8(0x43, 0x30);
             
             // reset properties
-            Frequency         = 0;
-            Milliseconds      = 0;
-            TotalMilliseconds = 0;
+            Frequency = 0;
         }
 
-        // calculate pit times
-        void PITController::CalculateMilliseconds()
+        // one countdown on channel 2 with the speaker disconnected, polled through port 0x61 so irq 0 and the interrupt flag are left alone
+        void PITController::StartCountdown(uint ms)
         {
-            // increment millis tick
-            MillisTick++;
-
-            // millisecond has passed
-            if (MillisTick >= Frequency / 1000)
-            {
-                Milliseconds++;
-                TotalMilliseconds++;
-                MillisTick = 0;
-            }
+            if (ms > PIT_COUNTDOWN_MAX) { ms = PIT_COUNTDOWN_MAX; }
+            uint count = (PIT_CLOCK * ms) / 1000;
 
-            // reset current millisecond timer
-            if (Milliseconds >= 1000) { Milliseconds = 0; MillisTick = 0; }
+            // gate channel 2 on, then load it in interrupt on terminal count mode
+            Ports::Write8(0x61, (Ports::Read8(0x61) & 0xFD) | 0x01);
+            Ports::Write8(0x43, 0xB0);
+            Ports::Write8(0x42, (byte)(count & 0xFF));
+            Ports::Write8(0x42, (byte)((count >> 8) & 0xFF));
         }
 
+        // output of channel 2 goes high once the countdown reached zero
+        bool PITController::CountdownExpired() { return (Ports::Read8(0x61) & 0x20) != 0; }
+
         // get currently set pit frequency
         uint PITController::GetFrequency() { return Frequency; }
-
-        // get current millisecond within pit second
-        uint PITController::GetMilliseconds() { return Milliseconds; }
-
-        // get total amount of passed milliseconds
-        ulong PITController::GetTotalMilliseconds() { return TotalMilliseconds; }
     }
-}
\ No newline at end of file
+}
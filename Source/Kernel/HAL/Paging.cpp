@@ -0,0 +1,301 @@
+#include <Kernel/HAL/Paging.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+extc
+{
+    // fault task stack of the boot processor, the others allocate theirs when they are started
+    byte FaultStack[PG_FAULT_STACK] __attribute__((aligned(16)));
+
+    void PageFaultHandler(uint error) { PMOS::Kernel::Paging.HandleFault(error); }
+}
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        void PagingManager::Initialize()
+        {
+            Enabled = false;
+
+            // memory is identity mapped with 4 MB pages, without them the page tables alone would take 4 MB
+            uint eax, ebx, ecx, edx;
+            asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "0"(1));
+            if (!(edx & (1 << 3))) { Kernel::Debug.Warning("CPU does not support 4 MB pages, paging disabled"); return; }
+
+            // any ram behind the stack window can no longer be reached
+            uint tables = PG_STACK_SIZE / 0x400000;
+            Kernel::FrameMgr.ReserveRange(PG_STACK_BASE, PG_STACK_SIZE);
+            Directory   = (uint*)Kernel::FrameMgr.AllocateFrames(1);
+            StackTables = (uint*)Kernel::FrameMgr.AllocateFrames(tables);
+            if (Directory == nullptr || StackTables == nullptr) { Kernel::Debug.Panic("Unable to allocate page tables"); return; }
+
+            Memory::Set(StackTables, 0, tables * PG_SIZE);
+            Memory::Set(StackUsed, 0, sizeof(StackUsed));
+            Memory::Set(StackGuard, 0, sizeof(StackGuard));
+            Memory::Set(StackRetired, 0, sizeof(StackRetired));
+            RetireCount[0]   = 0;
+            RetireCount[1]   = 0;
+            RetireRequest[0] = 0;
+            RetireRequest[1] = 0;
+            RetireOpen       = 0;
+            Committed   = 0;
+            PendingBase = 0;
+            PendingSize = 0;
+            StackLock.Initialize("paging");
+
+            for (uint i = 0; i < 1024; i++) { Directory[i] = (i << 22) | PG_LARGE | PG_WRITE | PG_PRESENT; }
+            for (uint i = 0; i < tables; i++) { Directory[(PG_STACK_BASE >> 22) + i] = ((uint)StackTables + (i * PG_SIZE)) | PG_WRITE | PG_PRESENT; }
+
+            // a fault while pushing onto an uncommitted stack cannot be delivered on that stack, so #PF goes through a task gate
+            SMPManager::GetCurrent()->FaultStack = FaultStack;
+            InitializeTasks(SMPManager::GetCurrent());
+            IDTSetTaskGate(14, TSS_FAULT);
+
+            // pse has to be on before the directory with large pages goes live
+            asm volatile("mov %0, %%cr3" : : "r"(Directory) : "memory");
+            asm volatile("mov %%cr4, %%eax; or $0x10, %%eax; mov %%eax, %%cr4" : : : "eax");
+            asm volatile("mov %%cr0, %%eax; or $0x80000000, %%eax; mov %%eax, %%cr0" : : : "eax", "memory");
+            Enabled = true;
+
+            Kernel::Debug.Info("PAGE DIRECTORY   0x%8x", (uint)Directory);
+            Kernel::Debug.Info("STACK WINDOW     0x%8x - 0x%8x", PG_STACK_BASE, PG_STACK_BASE + PG_STACK_SIZE);
+            Kernel::Debug.OK("Enabled paging");
+        }
+
+        // every processor runs as its own kernel task and has its own fault task, the descriptors live in its private gdt
+        void PagingManager::InitializeTasks(Processor* cpu)
+        {
+            TaskState* kernel = &cpu->KernelTask;
+            TaskState* fault  = &cpu->FaultTask;
+            Memory::Set(kernel, 0, sizeof(TaskState));
+            Memory::Set(fault, 0, sizeof(TaskState));
+            kernel->IOMap = sizeof(TaskState);
+            fault->IOMap  = sizeof(TaskState);
+            fault->CR3    = (uint)Directory;
+            fault->EIP    = (uint)PageFaultTask;
+            fault->EFlags = 0x02;
+            fault->ESP    = (uint)cpu->FaultStack + PG_FAULT_STACK;
+            fault->CS     = KERNEL_CS;
+            fault->DS     = fault->ES = fault->FS = fault->SS = 0x10;
+            fault->GS     = SMP_PERCPU_SEL;
+            SetTaskDescriptor(cpu->GDT, TSS_KERNEL, kernel);
+            SetTaskDescriptor(cpu->GDT, TSS_FAULT, fault);
+            asm volatile("ltr %%ax" : : "a"(TSS_KERNEL));
+        }
+
+        // runs on the fault task - commit the page if it belongs to a thread stack, otherwise panic with the faulting state
+        void PagingManager::HandleFault(uint error)
+        {
+            uint addr;
+            asm volatile("mov %%cr2, %0" : "=r"(addr));
+
+            bool window = addr >= PG_STACK_BASE && addr < PG_STACK_BASE + PG_STACK_SIZE;
+            uint page = (addr - PG_STACK_BASE) / PG_SIZE;
+            if (window && !(error & PG_PRESENT))
+            {
+                // the faulting code may hold the lock itself and stays stopped until this task returns, so it is borrowed rather than waited for
+                bool borrowed = StackLock.IsHeld();
+                if (!borrowed) { StackLock.Acquire(); }
+                bool committed = IsStackPage(page) && (IsMapped(addr) || Commit(addr & 0xFFFFF000, true));
+                if (!borrowed) { StackLock.Release(); }
+                if (committed) { return; }
+            }
+
+            TaskState* task = &SMPManager::GetCurrent()->KernelTask;
+            ISRRegs regs;
+            regs.DS        = task->DS;
+            regs.EDI       = task->EDI;
+            regs.ESI       = task->ESI;
+            regs.EBP       = task->EBP;
+            regs.Useless   = task->ESP;
+            regs.EBX       = task->EBX;
+            regs.EDX       = task->EDX;
+            regs.ECX       = task->ECX;
+            regs.EAX       = task->EAX;
+            regs.Interrupt = 14;
+            regs.ErrorCode = error;
+            regs.EIP       = task->EIP;
+            regs.CS        = task->CS;
+            regs.EFlags    = task->EFlags;
+            regs.UserESP   = task->ESP;
+            regs.SS        = task->SS;
+
+            Kernel::Debug.Error("Page fault at 0x%8x, EIP = 0x%8x", addr, task->EIP);
+            if (window && IsGuardPage(page)) { Kernel::Debug.Panic("Stack Overflow", &regs); }
+            else { Kernel::Debug.Panic("Page Fault", &regs); }
+        }
+
+        bool PagingManager::IsEnabled() { return Enabled; }
+
+        // reserve a stack with an unmapped guard page below it, only the top page is backed up front
+        void* PagingManager::ReserveStack(uint size)
+        {
+            if (!Enabled || size == 0) { return nullptr; }
+
+            StackLock.Acquire();
+            FlushPending();
+            Reclaim();
+
+            uint count = (size + PG_SIZE - 1) / PG_SIZE;
+            uint run = 0;
+            for (uint i = 0; i < PG_STACK_PAGES; i++)
+            {
+                if (StackUsed[i >> 5] & (1 << (i & 31))) { run = 0; continue; }
+                if (++run < count + 1) { continue; }
+
+                uint first = i - count;
+                for (uint j = first; j <= i; j++) { StackUsed[j >> 5] |= (1 << (j & 31)); }
+                StackGuard[first >> 5] |= (1 << (first & 31));
+
+                uint base = PG_STACK_BASE + ((first + 1) * PG_SIZE);
+                if (!Commit(base + ((count - 1) * PG_SIZE), false)) { FreeRange(base, size); break; }
+                StackLock.Release();
+                return (void*)base;
+            }
+
+            StackLock.Release();
+            Kernel::Debug.Error("Unable to reserve %d byte stack", size);
+            return nullptr;
+        }
+
+        // a thread disposing itself is still running on its stack, so that one is released on the next call instead
+        void PagingManager::ReleaseStack(void* base, uint size)
+        {
+            if (!Enabled || base == nullptr) { return; }
+
+            uint esp;
+            StackLock.Acquire();
+            asm volatile("mov %%esp, %0" : "=r"(esp));
+            FlushPending();
+
+            if (esp >= (uint)base && esp < (uint)base + size) { PendingBase = (uint)base; PendingSize = size; }
+            else { FreeRange((uint)base, size); }
+            Reclaim();
+            StackLock.Release();
+        }
+
+        // addresses outside the stack window are always mapped
+        bool PagingManager::IsMapped(uint addr)
+        {
+            if (!Enabled || addr < PG_STACK_BASE || addr >= PG_STACK_BASE + PG_STACK_SIZE) { return true; }
+            return (StackTables[(addr - PG_STACK_BASE) / PG_SIZE] & PG_PRESENT) != 0;
+        }
+
+        bool PagingManager::IsStackAddress(uint addr) { return Enabled && addr >= PG_STACK_BASE && addr < PG_STACK_BASE + PG_STACK_SIZE; }
+
+        uint PagingManager::GetCommittedBytes() { return Committed; }
+
+        // device registers must not be cached, the whole 4 MB page holding them is switched to uncached
+        void PagingManager::MapDevice(uint addr)
+        {
+            if (!Enabled) { return; }
+            StackLock.Acquire();
+            Directory[addr >> 22] |= PG_NOCACHE | PG_WRITETHROUGH;
+            asm volatile("invlpg (%0)" : : "r"(addr & 0xFFC00000) : "memory");
+            StackLock.Release();
+        }
+
+        void PagingManager::SetTaskDescriptor(uint* gdt, uint selector, TaskState* tss)
+        {
+            uint* desc  = gdt + (selector / 4);
+            uint  base  = (uint)tss;
+            uint  limit = sizeof(TaskState) - 1;
+            desc[0] = (limit & 0xFFFF) | ((base & 0xFFFF) << 16);
+            desc[1] = ((base >> 16) & 0xFF) | 0x8900 | (limit & 0xF0000) | (base & 0xFF000000);
+        }
+
+        // top up this processor's reserve from the scheduler tick, the frame allocator is never halfway through an update on this processor there
+        void PagingManager::Refill()
+        {
+            if (!Enabled) { return; }
+
+            Processor* cpu = SMPManager::GetCurrent();
+            while (cpu->FrameReserveCount < PG_FRAME_RESERVE && !Kernel::FrameMgr.IsBusy())
+            {
+                uint frame = Kernel::FrameMgr.AllocateFrames(1);
+                if (frame == 0) { return; }
+                cpu->FrameReserve[cpu->FrameReserveCount++] = frame;
+            }
+        }
+
+        // a fault can hit inside the frame allocator itself, so it takes from the reserve and only scans the bitmap when this processor is not in it
+        bool PagingManager::Commit(uint addr, bool fault)
+        {
+            Processor* cpu = SMPManager::GetCurrent();
+            uint frame = 0;
+            if (fault && cpu->FrameReserveCount > 0) { frame = cpu->FrameReserve[--cpu->FrameReserveCount]; }
+            else if (!Kernel::FrameMgr.IsBusy()) { frame = Kernel::FrameMgr.AllocateFrames(1); }
+            if (frame == 0) { return false; }
+
+            Memory::Set((void*)frame, 0, PG_SIZE);
+            StackTables[(addr - PG_STACK_BASE) / PG_SIZE] = frame | PG_WRITE | PG_PRESENT;
+            asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+            Committed += PG_SIZE;
+            return true;
+        }
+
+        // unmap a stack and its guard page - the frames and the addresses are only reused once every processor has flushed its tlb
+        void PagingManager::FreeRange(uint base, uint size)
+        {
+            uint first = (base - PG_STACK_BASE) / PG_SIZE - 1;
+            uint count = (size + PG_SIZE - 1) / PG_SIZE;
+            uint* retired = StackRetired[RetireOpen];
+
+            for (uint i = first; i <= first + count; i++)
+            {
+                retired[i >> 5] |= (1 << (i & 31));
+                if (StackTables[i] & PG_PRESENT) { StackTables[i] = (StackTables[i] & 0xFFFFF000) | PG_RETIRED; }
+            }
+            RetireCount[RetireOpen] += count + 1;
+
+            // raised after the entries are cleared, flushes this processor straight away and the others on their ipi
+            RetireRequest[RetireOpen] = Kernel::SMP.RequestFlush();
+        }
+
+        // pages retire into the open set while the closed one waits for its flush, a set is only closed once the previous one is back
+        void PagingManager::Reclaim()
+        {
+            uint closed = RetireOpen ^ 1;
+            if (RetireCount[closed] == 0 && RetireCount[RetireOpen] > 0) { RetireOpen = closed; closed ^= 1; }
+            if (RetireCount[closed] == 0 || !Kernel::SMP.IsFlushed(RetireRequest[closed])) { return; }
+
+            uint* retired = StackRetired[closed];
+            for (uint w = 0; w < PG_STACK_PAGES / 32; w++)
+            {
+                if (retired[w] == 0) { continue; }
+                for (uint b = 0; b < 32; b++)
+                {
+                    uint bit = 1 << b;
+                    if (!(retired[w] & bit)) { continue; }
+
+                    uint i = (w << 5) | b;
+                    if (StackTables[i] & PG_RETIRED) { Kernel::FrameMgr.FreeFrames(StackTables[i] & 0xFFFFF000); Committed -= PG_SIZE; }
+                    StackTables[i] = 0;
+                    StackUsed[w]  &= ~bit;
+                    StackGuard[w] &= ~bit;
+                }
+                retired[w] = 0;
+            }
+            RetireCount[closed] = 0;
+        }
+
+        void PagingManager::FlushPending()
+        {
+            if (PendingSize == 0) { return; }
+
+            uint esp;
+            asm volatile("mov %%esp, %0" : "=r"(esp));
+            if (esp >= PendingBase && esp < PendingBase + PendingSize) { return; }
+
+            FreeRange(PendingBase, PendingSize);
+            PendingBase = 0;
+            PendingSize = 0;
+        }
+
+        bool PagingManager::IsStackPage(uint page) { return (StackUsed[page >> 5] & (1 << (page & 31))) && !IsGuardPage(page) && !IsRetiredPage(page); }
+
+        bool PagingManager::IsGuardPage(uint page) { return (StackGuard[page >> 5] & (1 << (page & 31))) != 0; }
+
+        bool PagingManager::IsRetiredPage(uint page) { return ((StackRetired[0][page >> 5] | StackRetired[1][page >> 5]) & (1 << (page & 31))) != 0; }
+    }
+}
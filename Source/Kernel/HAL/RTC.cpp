@@ -22,31 +22,21 @@ namespace PMOS
             MilitaryTime = false;
             ShowSeconds = false;
 
-            // update
+            // the cmos is read once, from here on the date and time follow the clock
             Read();
+            Synced = GetEpoch();
+            Kernel::Clock.SetWallTime(Synced);
+            UpdateStrings();
 
             // message
             Kernel::Debug.OK("Initialized RTC controller - %s", TimeString);
         }
 
-        void RTCController::Update()
-        {
-            // increment tick
-            Tick++;
-
-            // half a second has passed
-            if (Tick >= Kernel::PIT.GetFrequency() / 2)
-            {
-                // read data from rtc controller
-                Read();
-
-                // reset tick value
-                Tick = 0;
-            }
-        }
-
         void RTCController::Read()
         {
+            // the registers are only consistent outside of an update cycle, which lasts about 2 ms
+            for (uint i = 0; i < 100000 && IsUpdating(); i++) { asm volatile("pause"); }
+
             // fetch time
             Second = GetRegister(0x00);
             Minute = GetRegister(0x02);
@@ -71,11 +61,52 @@ namespace PMOS
                 Year    = (Year & 0x0F) + (Year / 16) * 10;
             }
 
-            UpdateStrings();
+            // 12 hour mode keeps pm in the top bit and counts 12, 1 .. 11
+            if (!(bcd & 0x02) && (Hour & 0x80)) { Hour = ((Hour & 0x7F) % 12) + 12; }
+            else if (!(bcd & 0x02) && Hour == 12) { Hour = 0; }
+        }
+
+        // recompute the date and time from the clock's wall time, nothing to do within the same second
+        void RTCController::Sync()
+        {
+            uint now = Kernel::Clock.GetWallSeconds();
+            if (now == Synced) { return; }
+            Synced = now;
+
+            uint secs = now % 86400;
+            Second = secs % 60;
+            Minute = (secs / 60) % 60;
+            Hour   = secs / 3600;
+
+            // days since 1970 to a civil date, counted in 400 year eras starting on march 1st
+            uint days = (now / 86400) + 719468;
+            uint era  = days / 146097;
+            uint doe  = days - (era * 146097);
+            uint yoe  = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
+            uint doy  = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));
+            uint mp   = ((5 * doy) + 2) / 153;
+            uint year = yoe + (era * 400);
+            Day   = doy - (((153 * mp) + 2) / 5) + 1;
+            Month = (mp < 10) ? mp + 3 : mp - 9;
+            if (Month <= 2) { year++; }
+            Year  = year - 2000;
+        }
+
+        // seconds since 1970 of the last read, the rtc year is taken to be in this century
+        uint RTCController::GetEpoch()
+        {
+            uint year  = 2000 + Year - ((Month <= 2) ? 1 : 0);
+            uint era   = year / 400;
+            uint yoe   = year - (era * 400);
+            uint doy   = (((153 * ((Month > 2) ? Month - 3 : Month + 9)) + 2) / 5) + Day - 1;
+            uint doe   = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+            uint days  = (era * 146097) + doe - 719468;
+            return (days * 86400) + (Hour * 3600) + (Minute * 60) + Second;
         }
         
         void RTCController::UpdateStrings()
         {
+            Sync();
             StringUtil::Clear(TimeString);
             char num[64];
 
@@ -163,12 +194,12 @@ namespace PMOS
         }
 
         // return numeral values
-        byte RTCController::GetSecond() { return Second; }
-        byte RTCController::GetMinute() { return Minute; }
-        byte RTCController::GetHour() { return Hour; }
-        byte RTCController::GetDay() { return Day; }
-        byte RTCController::GetMonth() { return Month; }
-        byte RTCController::GetYear() { return Year; }
+        byte RTCController::GetSecond() { Sync(); return Second; }
+        byte RTCController::GetMinute() { Sync(); return Minute; }
+        byte RTCController::GetHour() { Sync(); return Hour; }
+        byte RTCController::GetDay() { Sync(); return Day; }
+        byte RTCController::GetMonth() { Sync(); return Month; }
+        byte RTCController::GetYear() { Sync(); return Year; }
 
         // return time string
         char* RTCController::GetTimeString(bool military, bool seconds)
@@ -71,6 +71,9 @@ section .text
         jmp INT32_BASE                         ; jump to new code location
     reloc: use32                               ; by Napalm
         mov  [REBASE(stack32_ptr)], esp        ; save 32bit stack pointer
+        mov  eax, cr0                          ; save cr0 so paging can be restored
+        mov  [REBASE(cr0_32)], eax
+        mov  [REBASE(gs_32)], gs               ; save the per processor segment selector
         sidt [REBASE(idt32_ptr)]               ; save 32bit idt pointer
         sgdt [REBASE(gdt32_ptr)]               ; save 32bit gdt pointer
         lgdt [REBASE(gdt16_ptr)]               ; load 16bit gdt pointer
@@ -91,7 +94,7 @@ section .text
         mov  gs, ax                            ; set gs to 16bit selector
         mov  ss, ax                            ; set ss to 16bit selector
         mov  eax, cr0                          ; get cr0 so we can modify it
-        and  al,  ~0x01                        ; mask off PE bit to turn off protected mode
+        and  eax, 0x7FFFFFFE                   ; mask off PG and PE bits to turn off paging and protected mode
         mov  cr0, eax                          ; set cr0 to result
         jmp  word 0x0000:REBASE(r_mode16)      ; finally set cs:ip to enter real-mode
     r_mode16: use16
@@ -121,8 +124,9 @@ section .text
         pusha                                  ; save general purpose registers to 16bit stack
         mov  bx, 0x2028                        ; master 32 and slave 40
         call resetpic                          ; restore the pic's to protected mode settings
-        mov  eax, cr0                          ; get cr0 so we can modify it
-        inc  eax                               ; set PE bit to turn on protected mode
+        xor  ax, ax                            ; the bios may have changed ds
+        mov  ds, ax                            ; set ds so we can read the saved cr0
+        mov  eax, [REBASE(cr0_32)]             ; get saved cr0 with the PE bit, and PG if paging was on
         mov  cr0, eax                          ; set cr0 to result
         jmp  dword CODE32:REBASE(p_mode32)     ; switch to 32bit selector (32bit protected mode)
     p_mode32: use32
@@ -133,6 +137,7 @@ section .text
         mov  gs, ax                            ; reset gs selector
         mov  ss, ax                            ; reset ss selector
         lgdt [REBASE(gdt32_ptr)]               ; restore 32bit gdt pointer
+        mov  gs, [REBASE(gs_32)]               ; the per processor segment only exists in the restored gdt
         lidt [REBASE(idt32_ptr)]               ; restore 32bit idt pointer
         mov  esp, [REBASE(stack32_ptr)]        ; restore 32bit stack pointer
         mov  esi, STACK16                      ; set copy source to 16bit stack
@@ -167,6 +172,12 @@ section .text
     stack32_ptr:                               ; address in 32bit stack after we
         dd 0x00000000                          ;   save all general purpose registers
          
+    cr0_32:                                    ; cr0 at the time of the call
+        dd 0x00000000
+         
+    gs_32:                                     ; gs at the time of the call
+        dw 0x0000
+         
     idt32_ptr:                                 ; IDT table pointer for 32bit access
         dw 0x0000                              ; table limit (size)
         dd 0x00000000                          ; table base address
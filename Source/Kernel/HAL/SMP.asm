@@ -0,0 +1,71 @@
+; Application processor start up code.
+; Copied to SMP_TRAMPOLINE before each processor is woken with INIT-SIPI-SIPI, the processor
+; starts here in real mode, switches to protected mode with the boot processor's page directory
+; and calls SMPEntry on the stack it was given. The parameters at the end are filled in by the
+; boot processor on the copy, one processor is started at a time.
+[bits 16]
+
+global SMPTrampoline
+global SMPTrampolineEnd
+global SMPParamCR3
+global SMPParamStack
+global SMPParamCPU
+extern SMPEntry
+
+%define SMP_BASE  0x8000
+%define REBASE(x) (((x) - SMPTrampoline) + SMP_BASE)
+
+section .text
+SMPTrampoline:
+    cli
+    cld
+    xor  ax, ax
+    mov  ds, ax                                ; the copy is addressed absolutely below 64 KB
+    lgdt [REBASE(smp_gdt_ptr)]                 ; temporary flat gdt, replaced by the processor's own in SMPEntry
+    mov  eax, cr0
+    or   eax, 0x01                             ; protected mode
+    mov  cr0, eax
+    jmp  dword 0x08:REBASE(smp_pmode)
+
+[bits 32]
+smp_pmode:
+    mov  ax, 0x10
+    mov  ds, ax
+    mov  es, ax
+    mov  fs, ax
+    mov  gs, ax
+    mov  ss, ax
+    mov  eax, cr4                              ; 4 MB pages have to be on before the directory goes live
+    or   eax, 0x10
+    mov  cr4, eax
+    mov  eax, [REBASE(SMPParamCR3)]
+    mov  cr3, eax
+    mov  eax, cr0
+    or   eax, 0x80000000                       ; paging
+    mov  cr0, eax
+    mov  esp, [REBASE(SMPParamStack)]
+    xor  ebp, ebp
+    push dword [REBASE(SMPParamCPU)]
+    mov  eax, SMPEntry                         ; absolute, the copy is not where the code was linked
+    call eax
+.halt:
+    cli
+    hlt
+    jmp  .halt
+
+align 8
+smp_gdt:
+    dq 0x0000000000000000                      ; null
+    dq 0x00CF9A000000FFFF                      ; 0x08 - flat code
+    dq 0x00CF92000000FFFF                      ; 0x10 - flat data
+smp_gdt_ptr:
+    dw smp_gdt_ptr - smp_gdt - 1
+    dd REBASE(smp_gdt)
+
+SMPParamCR3:                                   ; page directory to load
+    dd 0x00000000
+SMPParamStack:                                 ; top of the boot stack
+    dd 0x00000000
+SMPParamCPU:                                   ; Processor block passed to SMPEntry
+    dd 0x00000000
+SMPTrampolineEnd:
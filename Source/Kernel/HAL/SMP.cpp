@@ -0,0 +1,230 @@
+#include <Kernel/HAL/SMP.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+extc
+{
+    // jumped to by the trampoline once the processor runs with paging on its boot stack
+    void SMPEntry(PMOS::HAL::Processor* cpu) { PMOS::Kernel::SMP.EnterProcessor(cpu); }
+}
+
+namespace PMOS
+{
+    namespace HAL
+    {
+        // the boot processor gets its processor block before anything else can ask for it
+        void SMPManager::Initialize()
+        {
+            Memory::Set(CPUs, 0, sizeof(CPUs));
+            Count        = 1;
+            FlushRequest = 0;
+            Halting      = false;
+
+            Processor* bsp = &CPUs[0];
+            bsp->Index  = 0;
+            bsp->Online = true;
+            LoadSegments(bsp);
+
+            // nmi doubles as the halt signal of a panicking processor, the flush ipi drops stale stack mappings
+            Kernel::InterruptMgr.Register(2, HaltCallback);
+            Kernel::InterruptMgr.Register(IRQ_FLUSH, FlushCallback);
+
+            Kernel::Debug.OK("Initialized processor 0");
+        }
+
+        // wake every other enabled processor from the madt, one at a time since they share the trampoline
+        void SMPManager::Start()
+        {
+            if (!Kernel::APIC.IsEnabled()) { return; }
+
+            uint bsp = Kernel::APIC.GetID();
+            CPUs[0].APICID = bsp;
+
+            for (uint i = 0; i < Kernel::ACPI.GetProcessorCount() && Count < SMP_MAX_CPUS; i++)
+            {
+                uint apic = Kernel::ACPI.GetAPICID(i);
+                if (apic == bsp) { continue; }
+
+                Processor* cpu = &CPUs[Count];
+                Memory::Set(cpu, 0, sizeof(Processor));
+                cpu->Index      = Count;
+                cpu->APICID     = apic;
+                cpu->BootStack  = (byte*)MemAlloc(SMP_STACK_SIZE, false, AllocationType::System);
+                cpu->FaultStack = (byte*)MemAlloc(PG_FAULT_STACK, false, AllocationType::System);
+
+                if (!StartProcessor(cpu))
+                {
+                    // park it again so a late start cannot run on a freed stack
+                    Kernel::APIC.SendInit(apic);
+                    MemFree(cpu->BootStack);
+                    MemFree(cpu->FaultStack);
+                    Kernel::Debug.Warning("Processor with APIC id %d did not start", apic);
+                    continue;
+                }
+                Count++;
+                Kernel::Debug.OK("Started processor %d(apic id = %d)", cpu->Index, apic);
+            }
+
+            if (Count > 1) { Kernel::Debug.Info("Running on %d processors", Count); }
+        }
+
+        void SMPManager::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("PROCESSORS", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" --------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("CPU   APIC   READY   STEALS      THREAD\n", Col4::DarkGray);
+
+            for (uint i = 0; i < Count; i++)
+            {
+                Processor* cpu = &CPUs[i];
+                Threading::Thread* t = cpu->CurrentThread;
+                Kernel::Debug.Write("%d     ", i);
+                Kernel::Debug.Write("0x%2x   ", cpu->APICID);
+                Kernel::Debug.Write("%d       ", Kernel::ThreadMgr.GetReadyCount(i));
+                Kernel::Debug.Write("0x%8x  ", cpu->Steals);
+                Kernel::Debug.WriteLine("%s", (t != nullptr) ? t->GetName() : "-");
+            }
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // first code of an application processor in c++, it becomes an idle processor and waits for the scheduler
+        void SMPManager::EnterProcessor(Processor* cpu)
+        {
+            LoadSegments(cpu);
+            FlushLocal();
+            IDTSet();
+            Kernel::Paging.InitializeTasks(cpu);
+            if (Kernel::CPU.EnableSSE()) { asm volatile("mov %%cr0, %%eax; or $0x08, %%eax; mov %%eax, %%cr0" : : : "eax"); }
+            Kernel::APIC.InitializeLocal();
+            Kernel::APICTimer.InitializeLocal();
+            cpu->SwitchStamp = Kernel::CPU.ReadCycles();
+
+            // pinned so no other processor ever runs it
+            Threading::Thread* idle = Kernel::ThreadMgr.Create("idle", 8192, ThreadPriority::Low, Kernel::IdleThreadCallback);
+            cpu->IdleThread = idle;
+            idle->StartOn(cpu->Index);
+
+            // the boot stack is left behind at the first switch
+            cpu->Online = true;
+            asm volatile("sti");
+            while (true) { asm volatile("hlt"); }
+        }
+
+        void SMPManager::SendOthers(byte vector)
+        {
+            uint self = GetIndex();
+            for (uint i = 0; i < Count; i++) { if (i != self && CPUs[i].Online) { Kernel::APIC.SendIPI(CPUs[i].APICID, vector); } }
+        }
+
+        // ask every processor to drop mappings removed before this call, this one included - not waited for, IsFlushed tells when all have
+        uint SMPManager::RequestFlush()
+        {
+            uint request = __atomic_add_fetch(&FlushRequest, 1, __ATOMIC_SEQ_CST);
+            FlushLocal();
+            if (Count > 1) { SendOthers(IRQ_FLUSH); }
+            return request;
+        }
+
+        // true once every online processor flushed at or after the request, wrap safe
+        bool SMPManager::IsFlushed(uint request)
+        {
+            for (uint i = 0; i < Count; i++) { if (CPUs[i].Online && (int)(CPUs[i].FlushDone - request) < 0) { return false; } }
+            return true;
+        }
+
+        // stop every other processor, used by panics so the screen and serial output stay readable
+        void SMPManager::HaltOthers()
+        {
+            if (Count <= 1 || Halting) { return; }
+            Halting = true;
+            Kernel::APIC.BroadcastNMI();
+        }
+
+        uint SMPManager::GetCount() { return Count; }
+
+        Processor* SMPManager::Get(uint index) { return (index < Count) ? &CPUs[index] : nullptr; }
+
+        bool SMPManager::IsHalting() { return Halting; }
+
+        bool SMPManager::StartProcessor(Processor* cpu)
+        {
+            // parameters are written into the copy, the linked trampoline stays untouched
+            uint size = (uint)SMPTrampolineEnd - (uint)SMPTrampoline;
+            uint copy = SMP_TRAMPOLINE - (uint)SMPTrampoline;
+            uint cr3;
+            asm volatile("mov %%cr3, %0" : "=r"(cr3));
+            Memory::Copy((void*)SMP_TRAMPOLINE, SMPTrampoline, size);
+            *(uint*)(copy + (uint)&SMPParamCR3)   = cr3;
+            *(uint*)(copy + (uint)&SMPParamStack) = (uint)cpu->BootStack + SMP_STACK_SIZE;
+            *(uint*)(copy + (uint)&SMPParamCPU)   = (uint)cpu;
+
+            // the second startup ipi is only needed if the first one was missed
+            Kernel::APIC.SendInit(cpu->APICID);
+            Delay(10000);
+            for (uint i = 0; i < 2 && !cpu->Online; i++)
+            {
+                Kernel::APIC.SendStartup(cpu->APICID, SMP_TRAMPOLINE);
+                Delay(200);
+            }
+
+            for (uint i = 0; i < 1000 && !cpu->Online; i++) { Delay(100); }
+            return cpu->Online;
+        }
+
+        // own copy of the boot gdt entries, the task state segments are added by paging and gs points at the processor block
+        void SMPManager::LoadSegments(Processor* cpu)
+        {
+            cpu->Self   = cpu;
+            cpu->GDT[0] = 0;
+            cpu->GDT[1] = 0;
+            cpu->GDT[2] = 0x0000FFFF;
+            cpu->GDT[3] = 0x00CF9A00;
+            cpu->GDT[4] = 0x0000FFFF;
+            cpu->GDT[5] = 0x00CF9200;
+
+            uint base  = (uint)cpu;
+            uint limit = sizeof(Processor) - 1;
+            cpu->GDT[(SMP_PERCPU_SEL / 4)]     = (limit & 0xFFFF) | ((base & 0xFFFF) << 16);
+            cpu->GDT[(SMP_PERCPU_SEL / 4) + 1] = ((base >> 16) & 0xFF) | 0x409200 | (limit & 0xF0000) | (base & 0xFF000000);
+
+            GDTRegister reg;
+            reg.Limit = sizeof(cpu->GDT) - 1;
+            reg.Base  = (uint)cpu->GDT;
+            asm volatile("lgdt (%0)" : : "r"(&reg) : "memory");
+            asm volatile("mov %w0, %%gs" : : "r"(SMP_PERCPU_SEL));
+        }
+
+        // busy wait on the time stamp counter, each write to the post code port takes about a microsecond without one
+        void SMPManager::Delay(uint us)
+        {
+            uint khz = Kernel::CPU.GetTSCFrequency();
+            if (khz == 0) { for (uint i = 0; i < us; i++) { Ports::Write8(0x80, 0); } return; }
+
+            ulonglong end = Kernel::CPU.ReadCycles() + (((ulonglong)us * khz) / 1000);
+            while (Kernel::CPU.ReadCycles() < end) { asm volatile("pause"); }
+        }
+
+        // the request is read before the reload, so every mapping removed before it was raised is gone once it is acknowledged
+        void SMPManager::FlushLocal()
+        {
+            Processor* cpu = GetCurrent();
+            uint request = __atomic_load_n(&Kernel::SMP.FlushRequest, __ATOMIC_ACQUIRE);
+            asm volatile("mov %%cr3, %%eax; mov %%eax, %%cr3" : : : "eax", "memory");
+            __atomic_store_n(&cpu->FlushDone, request, __ATOMIC_RELEASE);
+        }
+
+        // the freed stack pages are few, reloading cr3 is cheaper than a list of invlpgs
+        void SMPManager::FlushCallback(uint* regs) { UNUSED(regs); FlushLocal(); }
+
+        void SMPManager::HaltCallback(uint* regs)
+        {
+            if (Kernel::SMP.IsHalting()) { while (true) { asm volatile("cli; hlt"); } }
+            Kernel::Debug.Panic("Non Maskable Interrupt", (ISRRegs*)*regs);
+        }
+    }
+}
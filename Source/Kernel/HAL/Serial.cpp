@@ -66,6 +66,13 @@ namespace PMOS
             Ports::Write8((ushort)CurrentPort, c);
         }
 
+        // raw binary output, no colour codes
+        void SerialController::WriteBytes(byte* data, uint length)
+        {
+            if (CurrentPort == SerialPort::Disabled) { return; }
+            for (uint i = 0; i < length; i++) { WriteChar((char)data[i]); }
+        }
+
         void SerialController::WriteChar(char c, Col4 fg)
         {
             if (CurrentPort == SerialPort::Disabled) { return; }
@@ -14,10 +14,19 @@ namespace PMOS
         // handle thread
         void ThreadEntry()
         {
-            Kernel::ThreadMgr.CurrentThread->Protocol(Kernel::ThreadMgr.CurrentThread);
-            Kernel::ThreadMgr.CurrentThread->SetState(ThreadState::Halted);
-            Kernel::ThreadMgr.Unload(Kernel::ThreadMgr.CurrentThread);
-            while (true);
+            Thread* t = Kernel::ThreadMgr.GetCurrentThread();
+            t->Protocol(t);
+
+            // the scheduler unloads halted threads, the processor moves on to the next ready one right away instead of spinning out the slice
+            t->SetState(ThreadState::Halted);
+            while (true) { Kernel::ThreadMgr.Yield(); }
+        }
+
+        // sleep timer expired - put the thread back on the ready queue
+        void ThreadWake(Services::KernelTimer* timer)
+        {
+            Thread* t = (Thread*)timer->Data;
+            if (t->GetState() == ThreadState::Sleeping) { t->SetState(ThreadState::Running); }
         }
 
         // --------------------------------------------------------------------------------------------------
@@ -31,31 +40,14 @@ namespace PMOS
             // set stack size
             StackSize = STACK_SIZE;
 
-            // create stack
-            Stack = (byte*)MemAlloc(StackSize, true, AllocationType::ThreadStack);
-
-            // set registers pointer
-            Registers = (ISRRegs*)(((uint)Stack + StackSize) - sizeof(ISRRegs));
-
-            // copy name
-            for (uint i = 0; i < 64; i++) { if (i < StringUtil::Length(name)) { Properties.Name[i] = name[i]; } }
-            
-            // set properties
-            Properties.Priority = priority;
-            Properties.ID       = ThreadID++;
-            Properties.State    = ThreadState::Initialized;
-
-            // set protocol
-            Protocol = protocol;
-
-            // clear stack
-            ClearStack();
+            // reserve stack, pages are committed as the thread touches them
+            Stack = (byte*)Kernel::Paging.ReserveStack(StackSize);
+            if (Stack == nullptr) { Stack = (byte*)MemAlloc(StackSize, false, AllocationType::ThreadStack); }
 
-            // set registers
-            Registers->EIP    = (uint)ThreadEntry;
-            Registers->CS     = KERNEL_CS;
-            Registers->EFlags = 0x202;
+            // fpu save area, allocated up front since the #NM handler may run while this processor holds the heap lock
+            FPUState = (byte*)MemAlloc(FPU_STATE_SIZE, false, AllocationType::Thread);
 
+            Setup(name, priority, protocol);
             Kernel::Debug.Info("Created thread %s", Properties.Name);
         }
 
@@ -65,9 +57,33 @@ namespace PMOS
             // set stack size
             StackSize = stack;
 
-            // create stack
-            Stack = (byte*)MemAlloc(StackSize, true, AllocationType::ThreadStack);
+            // reserve stack, pages are committed as the thread touches them
+            Stack = (byte*)Kernel::Paging.ReserveStack(StackSize);
+            if (Stack == nullptr) { Stack = (byte*)MemAlloc(StackSize, false, AllocationType::ThreadStack); }
+
+            // fpu save area, allocated up front since the #NM handler may run while this processor holds the heap lock
+            FPUState = (byte*)MemAlloc(FPU_STATE_SIZE, false, AllocationType::Thread);
 
+            Setup(name, priority, protocol);
+        }
+
+        // dispose thread and contents
+        void Thread::Dispose()
+        {
+            Detach();
+            if (FPUState != nullptr) { MemFree(FPUState); FPUState = nullptr; }
+
+            // free stack memory
+            if (Kernel::Paging.IsStackAddress((uint)Stack)) { Kernel::Paging.ReleaseStack(Stack, StackSize); }
+            else { MemFree(Stack); }
+
+            // free thread
+            MemFree(this);
+        }
+
+        // fresh properties and initial register frame on top of an allocated stack
+        void Thread::Setup(char* name, ThreadPriority priority, void protocol(Thread*))
+        {
             // set registers pointer
             Registers = (ISRRegs*)(((uint)Stack + StackSize) - sizeof(ISRRegs));
 
@@ -82,8 +98,8 @@ namespace PMOS
             // set protocol
             Protocol = protocol;
 
-            // clear stack
-            ClearStack();
+            // clear initial register frame, the rest of the stack does not need to be zeroed
+            Memory::Set(Registers, 0, sizeof(ISRRegs));
 
             // set registers
             Registers->EIP    = (uint)ThreadEntry;
@@ -91,26 +107,35 @@ namespace PMOS
             Registers->EFlags = 0x202;
         }
 
-        // dispose thread and contents
-        void Thread::Dispose()
+        // turn a pooled thread into a new one, the stack and fpu area are all that is kept
+        void Thread::Reset(char* name, ThreadPriority priority, void protocol(Thread*))
         {
-            // free stack memory
-            MemFree(Stack);
-
-            // free thread
-            MemFree(this);
+            byte* stack = Stack;
+            uint  size  = StackSize;
+            byte* fpu   = FPUState;
+
+            Memory::Set(this, 0, sizeof(Thread));
+            Stack     = stack;
+            StackSize = size;
+            FPUState  = fpu;
+            Setup(name, priority, protocol);
         }
 
-        // calculate ticks per second of thread
-        void Thread::CalculateTPS()
+        // let go of everything the thread holds besides its own memory
+        void Thread::Detach()
         {
-            TPSTick++;
-            Time = Kernel::RTC.GetSecond();
-            if (LastTime != Time)
+            // a pending wake-up would touch freed memory
+            Kernel::TimerMgr.Stop(&SleepTimer);
+
+            // hand cached heap objects back
+            Kernel::MemoryMgr.ReleaseMagazines(Magazines);
+            Magazines = nullptr;
+
+            // the fpu of the processor it last ran on may still hold this thread's state
+            for (uint i = 0; i < Kernel::SMP.GetCount(); i++)
             {
-                TPS = TPSTick;
-                TPSTick = 0;
-                LastTime = Time;
+                HAL::Processor* cpu = Kernel::SMP.Get(i);
+                if (cpu->FPUOwner == this) { cpu->FPUOwner = nullptr; }
             }
         }
 
@@ -121,46 +146,78 @@ namespace PMOS
             if (Properties.State != ThreadState::Initialized) { return false; }
 
             // disable interrupts
-            asm volatile("cli");
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
 
-            // load thread
+            // load thread, unpinned threads start on the processor with the fewest ready threads
             Kernel::ThreadMgr.Load(this);
+            if (!Pinned) { CPU = Kernel::ThreadMgr.GetIdlestCPU(); }
 
-            // set state
-            Properties.State = ThreadState::Running;
+            // set state, this puts it on the ready queue
+            SetState(ThreadState::Running);
 
             // message
             Kernel::Debug.Info("Started thread: NAME = %s ID = %d, STACK_SIZE = %d PRIORITY = 0x%2x", Properties.Name, Properties.ID, StackSize, (uint)Properties.Priority);
 
-            // re-enable interrupts and return success
-            asm volatile("sti");
+            // restore interrupts and return success
+            if (flags & 0x200) { asm volatile("sti"); }
             return true;
         }
 
+        // start thread on one processor and keep it there
+        bool Thread::StartOn(uint cpu)
+        {
+            if (Properties.State != ThreadState::Initialized || cpu >= SMP_MAX_CPUS) { return false; }
+            Pinned         = true;
+            DeadlinePinned = false;
+            CPU            = cpu;
+            return Start();
+        }
+
         // stop thread
         bool Thread::Stop()
         {
             // validate state
-            if (Properties.State != ThreadState::Running) { return false; }
+            ThreadState state = Properties.State;
+            if (state != ThreadState::Running && state != ThreadState::Sleeping && state != ThreadState::Blocked) { return false; }
         
-            // disable interrtups
-            asm volatile("cli");
+            // disable interrupts, a sleeping or blocked thread must not be woken once it is halted
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            Kernel::TimerMgr.Stop(&SleepTimer);
+            Kernel::ThreadMgr.Unwait(this);
 
             // message
             Kernel::Debug.Info("Stopped thread: NAME = %s ID = %d, STACK_SIZE = %d PRIORITY = 0x%2x", Properties.Name, Properties.ID, StackSize, (uint)Properties.Priority);
 
-            // set state
-            Properties.State = ThreadState::Halted;
+            // set state, the scheduler unloads it on its next tick
+            SetState(ThreadState::Halted);
 
-            // enable interrupts and return
-            asm volatile("sti");
+            // restore interrupts and return
+            if (flags & 0x200) { asm volatile("sti"); }
 
             return true;
         }
 
+        // block for at least ms milliseconds, sleeping threads are off the ready queues until their timer fires
         void Thread::Sleep(uint ms)
         {
-            return;
+            if (Properties.State != ThreadState::Running) { return; }
+            bool current = Kernel::ThreadMgr.GetCurrentThread() == this;
+
+            if (ms == 0) { if (current) { Kernel::ThreadMgr.Yield(); } return; }
+
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            SetState(ThreadState::Sleeping);
+            Kernel::TimerMgr.Start(&SleepTimer, ms, ThreadWake, this);
+            if (flags & 0x200) { asm volatile("sti"); }
+
+            // another thread put to sleep is simply skipped from its next tick on
+            if (!current) { return; }
+
+            // with nothing else ready the scheduler hands the cpu straight back, so keep yielding until woken
+            while (Properties.State == ThreadState::Sleeping) { Kernel::ThreadMgr.Yield(); }
         }
 
         // on unhandled exception within thread execution
@@ -171,13 +228,70 @@ namespace PMOS
         }
 
         // set thread priority
-        void Thread::SetPriority(ThreadPriority priority) { Properties.Priority = priority; }
+        void Thread::SetPriority(ThreadPriority priority)
+        {
+            // requeue so the thread lands in the queue of its new priority
+            RunQueue* rq = Kernel::ThreadMgr.LockQueue(this);
+            bool queued = Queued;
+            if (queued) { Kernel::ThreadMgr.Dequeue(rq, this); }
+            Properties.Priority = priority;
+            if (queued) { Kernel::ThreadMgr.Enqueue(rq, this, rq->Active); }
+            rq->Lock.Release();
+        }
+
+        // run budget milliseconds out of every period ahead of all priorities, or go back to round robin with a period of 0
+        // the processor has to have the bandwidth left, and the thread stays on it from now on
+        bool Thread::SetDeadline(uint period, uint budget)
+        {
+            if (period > 0 && (budget == 0 || budget > period)) { Kernel::Debug.Error("Invalid deadline of %d/%d ms for thread %s", budget, period, Properties.Name); return false; }
+            uint load = (period > 0) ? (budget * 1000) / period : 0;
+
+            RunQueue* rq = Kernel::ThreadMgr.LockQueue(this);
+            if (rq->DeadlineLoad - Load + load > THREAD_DEADLINE_LOAD)
+            {
+                rq->Lock.Release();
+                Kernel::Debug.Warning("Deadline of %d/%d ms for thread %s does not fit on processor %d", budget, period, Properties.Name, CPU);
+                return false;
+            }
+
+            bool queued = Queued;
+            if (queued) { Kernel::ThreadMgr.Dequeue(rq, this); }
+            rq->DeadlineLoad = rq->DeadlineLoad - Load + load;
+            Load   = load;
+            Period = period;
+            Budget = (budget * Kernel::APICTimer.GetFrequency()) / 1000;
+            if (Budget == 0 && period > 0) { Budget = 1; }
+
+            // the next enqueue starts a fresh period
+            Remaining = 0;
+            Deadline  = (uint)Kernel::Clock.GetMilliseconds();
+            Misses    = 0;
+            Slice     = Kernel::ThreadMgr.GetTimeSlice(this);
+
+            // a budget is only accounted on one processor, the thread goes back to moving freely unless StartOn put it there
+            if (period > 0 && !Pinned) { Pinned = true; DeadlinePinned = true; }
+            if (period == 0 && DeadlinePinned) { Pinned = false; DeadlinePinned = false; }
+            if (queued) { Kernel::ThreadMgr.Enqueue(rq, this, rq->Active); }
+            rq->Lock.Release();
+            return true;
+        }
 
         // set thread state
-        void Thread::SetState(ThreadState state) { Properties.State = state; }
+        void Thread::SetState(ThreadState state)
+        {
+            Properties.State = state;
+            Kernel::ThreadMgr.UpdateQueue(this);
+        }
 
-        // clear thread stack
-        void Thread::ClearStack() { Memory::Set(Stack, 0, StackSize); }
+        // clear thread stack, pages that were never committed are already zero
+        void Thread::ClearStack()
+        {
+            for (uint i = 0; i < StackSize; i += PG_SIZE)
+            {
+                uint len = (StackSize - i < PG_SIZE) ? StackSize - i : PG_SIZE;
+                if (Kernel::Paging.IsMapped((uint)Stack + i)) { Memory::Set(Stack + i, 0, len); }
+            }
+        }
 
         // set thread registers
         void Thread::SetRegisters(ISRRegs* regs) { Registers = regs; }
@@ -194,7 +308,23 @@ namespace PMOS
         // get thread priority
         ThreadPriority Thread::GetPriority() { return Properties.Priority; }
 
-        // get current ticks per second
-        uint Thread::GetTPS() { return TPS; }
+        // get deadline period in milliseconds, 0 unless the thread is in the deadline class
+        uint Thread::GetPeriod() { return Period; }
+
+        // get processor the thread is queued on
+        uint Thread::GetCPU() { return CPU; }
+
+        // get time stamp counter cycles spent running this thread
+        ulonglong Thread::GetCycles() { return Cycles; }
+
+        // get milliseconds spent running this thread
+        uint Thread::GetCPUTime()
+        {
+            uint khz = Kernel::CPU.GetTSCFrequency();
+            return (khz == 0) ? 0 : (uint)(Cycles / khz);
+        }
+
+        // get share of the cpu over the last usage sample
+        float Thread::GetCPUUsage() { return CPUUsage; }
     }
 }
\ No newline at end of file
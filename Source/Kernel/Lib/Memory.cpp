@@ -2,26 +2,36 @@
 #include <Kernel/Core/Kernel.hpp>
 
 // memory management overloads
-void* operator new(size_t size) { return PMOS::Kernel::MemoryMgr.Allocate((uint)size); }
-void* operator new[](size_t size) { return PMOS::Kernel::MemoryMgr.Allocate((uint)size); }
-void operator delete(void *p) { PMOS::Kernel::MemoryMgr.Free(p); }
-void operator delete(void *p, size_t size) { PMOS::Kernel::MemoryMgr.Free(p); UNUSED(size); }
-void operator delete[](void *p) { PMOS::Kernel::MemoryMgr.Free(p); }
-void operator delete[](void *p, size_t size) { PMOS::Kernel::MemoryMgr.Free(p); UNUSED(size); }
+// the wrappers pass their own return address so heap traces point at the real call site
+void* operator new(size_t size) { return PMOS::Kernel::MemoryMgr.Allocate((uint)size, true, PMOS::AllocationType::Default, __builtin_return_address(0)); }
+void* operator new[](size_t size) { return PMOS::Kernel::MemoryMgr.Allocate((uint)size, true, PMOS::AllocationType::Default, __builtin_return_address(0)); }
+void operator delete(void *p) { PMOS::Kernel::MemoryMgr.Free(p, __builtin_return_address(0)); }
+void operator delete(void *p, size_t size) { PMOS::Kernel::MemoryMgr.Free(p, __builtin_return_address(0)); UNUSED(size); }
+void operator delete[](void *p) { PMOS::Kernel::MemoryMgr.Free(p, __builtin_return_address(0)); }
+void operator delete[](void *p, size_t size) { PMOS::Kernel::MemoryMgr.Free(p, __builtin_return_address(0)); UNUSED(size); }
+
+// gcc lowers large struct copies and clears to these even in a freestanding build, rep strings so nothing here is turned back into a call
+extc void* memset(void* dest, int data, __SIZE_TYPE__ size) { uint ecx, edi; asm volatile("rep stosb" : "=&c"(ecx), "=&D"(edi) : "a"(data), "0"(size), "1"(dest) : "memory"); return dest; }
+extc void* memcpy(void* dest, const void* src, __SIZE_TYPE__ size) { uint ecx, edi, esi; asm volatile("rep movsb" : "=&c"(ecx), "=&D"(edi), "=&S"(esi) : "0"(size), "1"(dest), "2"(src) : "memory"); return dest; }
 
 void* MemAlloc(size_t size)
 {
-    return PMOS::Kernel::MemoryMgr.Allocate(size);
+    return PMOS::Kernel::MemoryMgr.Allocate(size, true, PMOS::AllocationType::Default, __builtin_return_address(0));
 }
 
 void* MemAlloc(size_t size, bool clear, PMOS::AllocationType type)
 {
-    return PMOS::Kernel::MemoryMgr.Allocate(size, clear, type);
+    return PMOS::Kernel::MemoryMgr.Allocate(size, clear, type, __builtin_return_address(0));
+}
+
+void* MemRealloc(void* ptr, size_t size)
+{
+    return PMOS::Kernel::MemoryMgr.Reallocate(ptr, size, __builtin_return_address(0));
 }
 
 void MemFree(void* ptr)
 {
-    PMOS::Kernel::MemoryMgr.Free(ptr);
+    PMOS::Kernel::MemoryMgr.Free(ptr, __builtin_return_address(0));
 }
 
 void MemFreeArray(void** arr, size_t len)
@@ -29,4 +39,83 @@ void MemFreeArray(void** arr, size_t len)
     if (arr == nullptr) { return; }
     for (size_t i = 0; i < len; i++) { if (arr[i] != nullptr) { PMOS::Kernel::MemoryMgr.Free(arr[i]); } }
     PMOS::Kernel::MemoryMgr.Free(arr);
-}
\ No newline at end of file
+}
+
+namespace PMOS
+{
+    namespace Memory
+    {
+        CopyMethod CopyBlock = CopyRep;
+        SetMethod  SetBlock  = SetRep;
+
+        void Initialize(bool sse2)
+        {
+            CopyBlock = sse2 ? CopyStream : CopyRep;
+            SetBlock  = sse2 ? SetStream : SetRep;
+            Kernel::Debug.Info("Using %s memory routines", sse2 ? "SSE2" : "rep string");
+        }
+
+        void* CopyRep(void* dest, void* src, uint size)
+        {
+            uint ecx, edi, esi;
+            asm volatile("rep movsl; mov %4, %%ecx; rep movsb" : "=&c"(ecx), "=&D"(edi), "=&S"(esi) : "0"(size / 4), "r"(size & 3), "1"(dest), "2"(src) : "memory");
+            return dest;
+        }
+
+        void* SetRep(void* dest, int data, uint size)
+        {
+            uint ecx, edi;
+            uint val = (byte)data;
+            val |= (val << 8) | (val << 16) | (val << 24);
+            asm volatile("rep stosl; mov %3, %%ecx; rep stosb" : "=&c"(ecx), "=&D"(edi) : "a"(val), "r"(size & 3), "0"(size / 4), "1"(dest) : "memory");
+            return dest;
+        }
+
+        // large copies bypass the cache with movntdq, mostly frame buffer blits
+        // the kernel is built without sse so the compiler never keeps anything in xmm registers, and the
+        // scheduler saves them lazily for threads that use them - irq handlers must not stream
+        void* CopyStream(void* dest, void* src, uint size)
+        {
+            if (size < MEM_STREAM_MIN) { return CopyRep(dest, src, size); }
+
+            // align the destination for the streaming stores
+            byte* d = (byte*)dest;
+            byte* s = (byte*)src;
+            uint head = (16 - ((uint)d & 15)) & 15;
+            CopyRep(d, s, head);
+            d += head; s += head; size -= head;
+
+            uint blocks = size / 64;
+            size -= blocks * 64;
+            asm volatile("1: movdqu (%1), %%xmm0; movdqu 16(%1), %%xmm1; movdqu 32(%1), %%xmm2; movdqu 48(%1), %%xmm3;"
+                         "movntdq %%xmm0, (%0); movntdq %%xmm1, 16(%0); movntdq %%xmm2, 32(%0); movntdq %%xmm3, 48(%0);"
+                         "add $64, %0; add $64, %1; dec %2; jnz 1b; sfence"
+                         : "+r"(d), "+r"(s), "+r"(blocks) : : "memory");
+
+            CopyRep(d, s, size);
+            return dest;
+        }
+
+        void* SetStream(void* dest, int data, uint size)
+        {
+            if (size < MEM_STREAM_MIN) { return SetRep(dest, data, size); }
+
+            byte* d = (byte*)dest;
+            uint head = (16 - ((uint)d & 15)) & 15;
+            SetRep(d, data, head);
+            d += head; size -= head;
+
+            uint val = (byte)data;
+            val |= (val << 8) | (val << 16) | (val << 24);
+            uint blocks = size / 64;
+            size -= blocks * 64;
+            asm volatile("movd %2, %%xmm0; pshufd $0, %%xmm0, %%xmm0;"
+                         "1: movntdq %%xmm0, (%0); movntdq %%xmm0, 16(%0); movntdq %%xmm0, 32(%0); movntdq %%xmm0, 48(%0);"
+                         "add $64, %0; dec %1; jnz 1b; sfence"
+                         : "+r"(d), "+r"(blocks) : "r"(val) : "memory");
+
+            SetRep(d, data, size);
+            return dest;
+        }
+    }
+}
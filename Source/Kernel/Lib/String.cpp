@@ -470,7 +470,7 @@ namespace PMOS
 
         Clear();
         Length = StringUtil::Length(str);
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str, Length);
     }
 
@@ -478,7 +478,7 @@ namespace PMOS
     {
         Clear();
         Length = str.Length;
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str.Data, Length);
     }
 
@@ -486,7 +486,7 @@ namespace PMOS
     {
         Clear();
         Length = str.Length;
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str.Data, Length);
     }
 
@@ -516,7 +516,7 @@ namespace PMOS
         Dispose();
         if (str == nullptr) { Length = 0; return; }
         Length = StringUtil::Length(str);
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str, Length);
     }
 
@@ -526,7 +526,7 @@ namespace PMOS
         if (&str == nullptr) { Length = 0; return; }
         if (str.Data == nullptr) { Length = 0; return; }
         Length = str.Length;
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str.Data, Length);
     }
 
@@ -536,54 +536,51 @@ namespace PMOS
         if (&str == nullptr) { Length = 0; return; }
         if (str.Data == nullptr) { Length = 0; return; }
         Length = str.Length;
-        Data = (char*)MemAlloc(Length, true, AllocationType::String);
+        Data = (char*)MemAlloc(Length + 1, true, AllocationType::String);
         Memory::Copy(Data, str.Data, Length);
     }
 
     void String::Append(char c)
     {
-        uint oldLen = Length;
-        char* data = (char*)MemAlloc(oldLen + 1, true, AllocationType::String);
-        Memory::Copy(data, Data, oldLen);
-        StringUtil::Append(data, c);
-        Dispose();
-        Length = oldLen + 1;
-        Data = data;
+        if (Data == nullptr) { Data = (char*)MemAlloc(2, true, AllocationType::String); Length = 0; }
+        else { Data = (char*)MemRealloc(Data, Length + 2); }
+        Data[Length++] = c;
+        Data[Length] = 0;
     }
 
     void String::Append(char* str)
     {
         if (Length == 0 || Data == nullptr) { Set(str); return; }
+        if (str == nullptr) { return; }
 
         uint len = StringUtil::Length(str);
-        char* data = (char*)MemAlloc(Length + len, true, AllocationType::String);
-        Memory::Copy(data, Data, Length);
-        StringUtil::Append(data, str);
-        Dispose();
+        Data = (char*)MemRealloc(Data, Length + len + 1);
+        Memory::Copy(Data + Length, str, len + 1);
         Length += len;
-        Data = data;
     }
 
     void String::Append(const String& str)
     {
+        if (str.Data == nullptr || str.Length == 0) { return; }
+        if (Data == nullptr) { Set(str); return; }
+
         uint len = str.Length;
-        char* data = (char*)MemAlloc(Length + len, true, AllocationType::String);
-        Memory::Copy(data, Data, Length);
-        StringUtil::Append(data, str.Data);
-        Dispose();
+        Data = (char*)MemRealloc(Data, Length + len + 1);
+        Memory::Copy(Data + Length, str.Data, len);
         Length += len;
-        Data = data;
+        Data[Length] = 0;
     }
 
     void String::Append(String&& str)
     {
+        if (str.Data == nullptr || str.Length == 0) { return; }
+        if (Data == nullptr) { Set(str); return; }
+
         uint len = str.Length;
-        char* data = (char*)MemAlloc(Length + len, true, AllocationType::String);
-        Memory::Copy(data, Data, Length);
-        StringUtil::Append(data, str.Data);
-        Dispose();
+        Data = (char*)MemRealloc(Data, Length + len + 1);
+        Memory::Copy(Data + Length, str.Data, len);
         Length += len;
-        Data = data;
+        Data[Length] = 0;
     }
 
     bool String::Equals(char* str)
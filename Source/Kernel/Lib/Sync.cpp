@@ -0,0 +1,323 @@
+#include <Kernel/Lib/Sync.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace Threading
+    {
+        // every named lock, newest first
+        LockInfo* LockList = nullptr;
+
+        // reset the counters and list the lock if it has a name
+        void RegisterLock(LockInfo* info, char* name)
+        {
+            info->Name        = name;
+            info->Acquires    = 0;
+            info->Contentions = 0;
+            info->Next        = nullptr;
+            if (name == nullptr) { return; }
+
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            info->Next = LockList;
+            LockList   = info;
+            if (flags & 0x200) { asm volatile("sti"); }
+        }
+
+        void PrintLocks(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("LOCKS", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" -------------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("ACQUIRES    CONTENDED   NAME\n", Col4::DarkGray);
+
+            for (LockInfo* info = LockList; info != nullptr; info = info->Next)
+            {
+                Kernel::Debug.Write("0x%8x  ", info->Acquires);
+                Kernel::Debug.Write("0x%8x  ", info->Contentions);
+                Kernel::Debug.WriteLine("%s", info->Name);
+            }
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // --------------------------------------------------------------------------------------------------
+
+        void Spinlock::Initialize(char* name)
+        {
+            Locked = 0;
+            Flags  = 0;
+            Holder = 0;
+            RegisterLock(&Info, name);
+        }
+
+        void Spinlock::Acquire()
+        {
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            uint self = HAL::SMPManager::GetIndex() + 1;
+            if (__sync_lock_test_and_set(&Locked, 1))
+            {
+                // with interrupts off only this processor could release it, so waiting would never end
+                if (Holder == self) { Kernel::Debug.Panic("Spinlock acquired twice on the same processor"); }
+
+                // spin on a plain read so the cache line is not bounced by the exchange
+                Info.Contentions++;
+                do { while (Locked) { asm volatile("pause"); } } while (__sync_lock_test_and_set(&Locked, 1));
+            }
+            Holder = self;
+            Flags  = flags;
+            Info.Acquires++;
+        }
+
+        bool Spinlock::TryAcquire()
+        {
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            if (__sync_lock_test_and_set(&Locked, 1))
+            {
+                Info.Contentions++;
+                if (flags & 0x200) { asm volatile("sti"); }
+                return false;
+            }
+            Holder = HAL::SMPManager::GetIndex() + 1;
+            Flags  = flags;
+            Info.Acquires++;
+            return true;
+        }
+
+        void Spinlock::Release()
+        {
+            uint flags = Flags;
+            Holder = 0;
+            __sync_lock_release(&Locked);
+            if (flags & 0x200) { asm volatile("sti"); }
+        }
+
+        bool Spinlock::IsLocked() { return Locked != 0; }
+
+        // held by the processor asking, only an exception raised inside the locked section can see this
+        bool Spinlock::IsHeld() { return Locked != 0 && Holder == HAL::SMPManager::GetIndex() + 1; }
+
+        // --------------------------------------------------------------------------------------------------
+
+        void Mutex::Initialize(char* name)
+        {
+            Guard.Initialize(nullptr);
+            Waiters.Head = Waiters.Tail = nullptr;
+            Owner = nullptr;
+            Depth = 0;
+            RegisterLock(&Info, name);
+        }
+
+        void Mutex::Lock()
+        {
+            if (Kernel::InterruptMgr.InInterrupt()) { Kernel::Debug.Panic("Mutex locked from an interrupt handler"); return; }
+
+            Guard.Acquire();
+            Thread* self = Kernel::ThreadMgr.GetCurrentThread();
+            Info.Acquires++;
+            if (Depth == 0 || Owner == self)
+            {
+                Owner = self;
+                Depth++;
+                Guard.Release();
+                return;
+            }
+
+            // ownership is handed over by Unlock, so there is nothing to retry once woken
+            Info.Contentions++;
+            Kernel::ThreadMgr.Block(&Waiters, &Guard);
+        }
+
+        bool Mutex::TryLock()
+        {
+            Guard.Acquire();
+            Thread* self = Kernel::ThreadMgr.GetCurrentThread();
+            bool success = Depth == 0 || Owner == self;
+            if (success) { Owner = self; Depth++; Info.Acquires++; } else { Info.Contentions++; }
+            Guard.Release();
+            return success;
+        }
+
+        void Mutex::Unlock()
+        {
+            Guard.Acquire();
+            if (Depth == 0 || Owner != Kernel::ThreadMgr.GetCurrentThread()) { Guard.Release(); Kernel::Debug.Error("Mutex unlocked by a thread that does not own it"); return; }
+            if (--Depth > 0) { Guard.Release(); return; }
+
+            Thread* next = Kernel::ThreadMgr.WakeOne(&Waiters);
+            Owner = next;
+            Depth = (next != nullptr) ? 1 : 0;
+            Guard.Release();
+        }
+
+        bool Mutex::IsLocked() { return Depth > 0; }
+
+        Thread* Mutex::GetOwner() { return Owner; }
+
+        // --------------------------------------------------------------------------------------------------
+
+        void Semaphore::Initialize(char* name, uint count)
+        {
+            Guard.Initialize(nullptr);
+            Waiters.Head = Waiters.Tail = nullptr;
+            Count = count;
+            RegisterLock(&Info, name);
+        }
+
+        void Semaphore::Wait()
+        {
+            Guard.Acquire();
+            Info.Acquires++;
+            if (Count > 0) { Count--; Guard.Release(); return; }
+
+            // the signal that wakes us carries the count with it
+            Info.Contentions++;
+            Kernel::ThreadMgr.Block(&Waiters, &Guard);
+        }
+
+        bool Semaphore::TryWait()
+        {
+            Guard.Acquire();
+            bool success = Count > 0;
+            if (success) { Count--; Info.Acquires++; } else { Info.Contentions++; }
+            Guard.Release();
+            return success;
+        }
+
+        // safe from irq handlers, waking a thread never blocks
+        void Semaphore::Signal()
+        {
+            Guard.Acquire();
+            if (Kernel::ThreadMgr.WakeOne(&Waiters) == nullptr) { Count++; }
+            Guard.Release();
+        }
+
+        uint Semaphore::GetCount() { return Count; }
+
+        // --------------------------------------------------------------------------------------------------
+
+        void ConditionVariable::Initialize(char* name)
+        {
+            Guard.Initialize(nullptr);
+            Waiters.Head = Waiters.Tail = nullptr;
+            RegisterLock(&Info, name);
+        }
+
+        // the mutex must be held exactly once, it is released only after this thread is queued so no signal is lost
+        void ConditionVariable::Wait(Mutex* mutex)
+        {
+            Guard.Acquire();
+            Info.Acquires++;
+            if (Waiters.Head != nullptr) { Info.Contentions++; }
+            mutex->Unlock();
+            Kernel::ThreadMgr.Block(&Waiters, &Guard);
+            mutex->Lock();
+        }
+
+        void ConditionVariable::Signal()
+        {
+            Guard.Acquire();
+            Kernel::ThreadMgr.WakeOne(&Waiters);
+            Guard.Release();
+        }
+
+        void ConditionVariable::Broadcast()
+        {
+            Guard.Acquire();
+            Kernel::ThreadMgr.WakeAll(&Waiters);
+            Guard.Release();
+        }
+
+        // --------------------------------------------------------------------------------------------------
+
+        void Event::Initialize(char* name, bool autoReset)
+        {
+            Guard.Initialize(nullptr);
+            Waiters.Head = Waiters.Tail = nullptr;
+            Tasks     = nullptr;
+            Signaled  = false;
+            AutoReset = autoReset;
+            RegisterLock(&Info, name);
+        }
+
+        void Event::Wait()
+        {
+            Guard.Acquire();
+            Info.Acquires++;
+            if (Signaled) { if (AutoReset) { Signaled = false; } Guard.Release(); return; }
+
+            Info.Contentions++;
+            Kernel::ThreadMgr.Block(&Waiters, &Guard);
+        }
+
+        // waiting threads go before waiting tasks, a task whose timeout already fired is passed over
+        void Event::Set()
+        {
+            Guard.Acquire();
+            if (AutoReset)
+            {
+                bool woken = Kernel::ThreadMgr.WakeOne(&Waiters) != nullptr;
+                while (!woken && Tasks != nullptr)
+                {
+                    Services::LoopTask* task = Tasks;
+                    Tasks = task->EventNext;
+                    task->EventNext = nullptr;
+                    task->Waiting   = nullptr;
+                    woken = Services::EventLoop::Wake(task, false);
+                }
+                if (!woken) { Signaled = true; }
+            }
+            else
+            {
+                Signaled = true;
+                Kernel::ThreadMgr.WakeAll(&Waiters);
+                while (Tasks != nullptr)
+                {
+                    Services::LoopTask* task = Tasks;
+                    Tasks = task->EventNext;
+                    task->EventNext = nullptr;
+                    task->Waiting   = nullptr;
+                    Services::EventLoop::Wake(task, false);
+                }
+            }
+            Guard.Release();
+        }
+
+        void Event::Reset() { Signaled = false; }
+
+        bool Event::IsSet() { return Signaled; }
+
+        // true if the event was already set, the task is then not queued and runs right away
+        bool Event::Subscribe(Services::LoopTask* task)
+        {
+            Guard.Acquire();
+            Info.Acquires++;
+            if (Signaled) { if (AutoReset) { Signaled = false; } Guard.Release(); return true; }
+
+            task->EventNext = nullptr;
+            task->Waiting   = this;
+            Services::LoopTask** link = &Tasks;
+            while (*link != nullptr) { link = &(*link)->EventNext; }
+            *link = task;
+            Guard.Release();
+            return false;
+        }
+
+        void Event::Unsubscribe(Services::LoopTask* task)
+        {
+            Guard.Acquire();
+            Services::LoopTask** link = &Tasks;
+            while (*link != nullptr && *link != task) { link = &(*link)->EventNext; }
+            if (*link == task) { *link = task->EventNext; }
+            task->EventNext = nullptr;
+            task->Waiting   = nullptr;
+            Guard.Release();
+        }
+    }
+}
@@ -15,6 +15,7 @@ namespace PMOS
             Service::Initialize();
 
             Debug.SetMode(DebugMode::Terminal);
+            InputReady.Initialize("clihost", true);
             Kernel::ServiceMgr.Register(this);
             Kernel::ServiceMgr.Start(this);
         }
@@ -38,10 +39,21 @@ namespace PMOS
             RegisterCommand(Command("HELP", "Show list of commands", "help", CommandMethods::HELP));
             RegisterCommand(Command("ECHO", "Print a string of text", "echo [text] ", CommandMethods::ECHO));
             RegisterCommand(Command("HEAP", "Show list of heap allocations", "heap", CommandMethods::HEAP));
+            RegisterCommand(Command("SLABS", "Show slab allocator size classes", "slabs", CommandMethods::SLABS));
+            RegisterCommand(Command("HEAPSTAT", "Show heap usage and latency statistics", "heapstat", CommandMethods::HEAPSTAT));
+            RegisterCommand(Command("HEAPTRACE", "Stream heap allocations over COM1", "heaptrace [on/off]", CommandMethods::HEAPTRACE));
+            RegisterCommand(Command("FRAMES", "Show free physical memory runs", "frames", CommandMethods::FRAMES));
             RegisterCommand(Command("MMAP", "Show multiboot memory map entries", "mmap", CommandMethods::MMAP));
             RegisterCommand(Command("SERVICES", "Show list of registered services", "services", CommandMethods::SERVICES));
             RegisterCommand(Command("ENDLESS", "Increment a number forever to test performance", "endless", CommandMethods::ENDLESS));
             RegisterCommand(Command("THREADS", "Show list of running threads", "threads", CommandMethods::THREADS));
+            RegisterCommand(Command("THREADPOOL", "Show or set the thread pool limits", "threadpool [low] [high]", CommandMethods::THREADPOOL));
+            RegisterCommand(Command("DEADLINES", "Show deadline scheduled threads and processor bandwidth", "deadlines", CommandMethods::DEADLINES));
+            RegisterCommand(Command("TIMERS", "Show list of pending kernel timers", "timers", CommandMethods::TIMERS));
+            RegisterCommand(Command("WORKQ", "Show deferred work queue statistics", "workq", CommandMethods::WORKQ));
+            RegisterCommand(Command("LOOPS", "Show event loops and their task counters", "loops", CommandMethods::LOOPS));
+            RegisterCommand(Command("LOCKS", "Show lock acquire and contention counters", "locks", CommandMethods::LOCKS));
+            RegisterCommand(Command("CPUS", "Show processors and their run queues", "cpus", CommandMethods::CPUS));
             RegisterCommand(Command("TIME", "Get current date and time information", "time", CommandMethods::TIME));
             RegisterCommand(Command("INFO", "Show operating system information", "info", CommandMethods::INFO));
             RegisterCommand(Command("SYSINFO", "Show hardware information", "sysinfo", CommandMethods::SYSINFO));
@@ -65,12 +77,16 @@ namespace PMOS
             Kernel::Keyboard->TerminalOutput = true;
             Kernel::Keyboard->OnEnterPressed = OnEnterPressed;
 
+            Kernel::MainLoop.Attach(&InputTask, OnInput, this);
+            Kernel::MainLoop.WaitFor(&InputTask, &InputReady, 0);
+
             Kernel::Debug.OK("Started command line interface");
         }
 
         void CommandLine::Stop()
         {
             Service::Stop();
+            Kernel::MainLoop.Cancel(&InputTask);
 
             if (Commands != nullptr) 
             { 
@@ -101,6 +117,17 @@ namespace PMOS
             Kernel::CLI->PushCommand((char*)input->Data);
             Memory::Set(input->Data, 0, input->GetSize());
             input->Seek(0);
+            Kernel::CLI->InputReady.Set();
+        }
+
+        // runs on the main loop once a command was entered, the command line is stopped here when the xserver takes over
+        void CommandLine::OnInput(LoopTask* task)
+        {
+            CommandLine* cli = (CommandLine*)task->Data;
+            cli->Execute();
+
+            if (cli->Terminated) { Kernel::ServiceMgr.Stop(cli); cli->Terminated = false; return; }
+            Kernel::MainLoop.WaitFor(task, &cli->InputReady, 0);
         }
 
         void CommandLine::RegisterCommand(Command cmd)
@@ -156,17 +183,20 @@ namespace PMOS
                 char* input = CommandBuffer[pos];
                 if (StringUtil::Length(input) == 0) { PopCommand(); pos++; continue; }
 
-                if (CommandArgs != nullptr)
+                // parsed arguments live in a per-command arena released once the command returns
+                HeapArena* arena = Kernel::MemoryMgr.CreateArena(AllocationType::String);
+                HeapArena* previous = Kernel::MemoryMgr.PushArena(arena);
+                CommandArgs = StringUtil::Split(input, ' ', &CommandArgsCount);
+                char* cmd = nullptr;
+                if (CommandArgsCount > 0)
                 {
-                    for (size_t i = 0; i < CommandArgsCount; i++) { MemFree(CommandArgs[i]); }
-                    MemFree(CommandArgs);
+                    cmd = (char*)MemAlloc(StringUtil::Length(CommandArgs[0]) + 1, true, AllocationType::String);
+                    StringUtil::Copy(cmd, CommandArgs[0]);
+                    StringUtil::ToUpper(cmd);
                 }
-                CommandArgs = StringUtil::Split(input, ' ', &CommandArgsCount);
-                if (CommandArgsCount == 0) { PopCommand(); pos++; continue; }
+                Kernel::MemoryMgr.PopArena(previous);
 
-                char* cmd = (char*)MemAlloc(StringUtil::Length(CommandArgs[0]), true, AllocationType::String);
-                StringUtil::Copy(cmd, CommandArgs[0]);
-                StringUtil::ToUpper(cmd);
+                if (CommandArgsCount == 0) { Kernel::MemoryMgr.ReleaseArena(arena); CommandArgs = nullptr; PopCommand(); pos++; continue; }
 
                 bool exec = false;
                 for (size_t i = 0; i < MaxCommandCount; i++)
@@ -176,19 +206,20 @@ namespace PMOS
                     {
                         Array<char**> arr = Array<char**>(CommandArgs, CommandArgsCount);
                         Commands[i]->Execute(input, arr);
-                        MemFree(cmd);
                         exec = true;
                         pos++;
                         PopCommand();
                         break;
                     }
                 }
+                Kernel::MemoryMgr.ReleaseArena(arena);
+                CommandArgs = nullptr;
+                CommandArgsCount = 0;
                 if (exec) { continue; }
 
                 pos++;
                 PopCommand();
                 Debug.Error("Invalid command");
-                MemFree(cmd);
             }
 
             FreeCommands();    
@@ -218,13 +249,20 @@ namespace PMOS
             {
                 if (lines[i] == nullptr) { continue; }
                 if (StringUtil::Length(lines[i]) == 0) { continue; }
+
+                HeapArena* arena = Kernel::MemoryMgr.CreateArena(AllocationType::String);
+                HeapArena* previous = Kernel::MemoryMgr.PushArena(arena);
                 uint args_count = 0;
                 char** args = StringUtil::Split(lines[i], 0x20, &args_count);
-                if (args_count == 0) { continue; }
-
-                char* cmd = (char*)MemAlloc(StringUtil::Length(args[0]), true, AllocationType::String);
-                StringUtil::Copy(cmd, args[0]);
-                StringUtil::ToUpper(cmd);
+                char* cmd = nullptr;
+                if (args_count > 0)
+                {
+                    cmd = (char*)MemAlloc(StringUtil::Length(args[0]) + 1, true, AllocationType::String);
+                    StringUtil::Copy(cmd, args[0]);
+                    StringUtil::ToUpper(cmd);
+                }
+                Kernel::MemoryMgr.PopArena(previous);
+                if (args_count == 0) { Kernel::MemoryMgr.ReleaseArena(arena); continue; }
 
                 bool success = false;
                 for (size_t j = 0; j < MaxCommandCount; j++)
@@ -239,9 +277,7 @@ namespace PMOS
                 }
 
                 if (!success) { Debug.Error("Invalid command"); }
-
-                MemFreeArray((void**)args, args_count);
-                MemFree(cmd);
+                Kernel::MemoryMgr.ReleaseArena(arena);
             }
 
             MemFreeArray((void**)lines, lines_count);
@@ -262,7 +298,7 @@ namespace PMOS
             // path is a full path
             if (path[0] == '/')
             {
-                char* output = (char*)MemAlloc(StringUtil::Length(path), true, AllocationType::String);
+                char* output = (char*)MemAlloc(StringUtil::Length(path) + 1, true, AllocationType::String);
                 StringUtil::Copy(output, path);
                 if (output[StringUtil::Length(output) - 1] == ' ') { StringUtil::Delete(output); }
                 return output;
@@ -324,6 +360,32 @@ namespace PMOS
             Kernel::MemoryMgr.PrintTable(DebugMode::Terminal);
         }
 
+        void SLABS(char* input, Array<char**> args)
+        {
+            Kernel::MemoryMgr.PrintSlabs(DebugMode::Terminal);
+        }
+
+        void HEAPSTAT(char* input, Array<char**> args)
+        {
+            Kernel::MemoryMgr.PrintStats(DebugMode::Terminal);
+        }
+
+        void HEAPTRACE(char* input, Array<char**> args)
+        {
+            if (args.Count < 2) { Kernel::CLI->Debug.WriteLine("Heap tracing is %s", Kernel::MemoryMgr.IsTracing() ? "on" : "off"); return; }
+
+            char* state = args.Data[1];
+            StringUtil::ToLower(state);
+            if (StringUtil::Equals(state, "on")) { Kernel::MemoryMgr.StartTrace(); Kernel::CLI->Debug.WriteLine("Heap tracing started on %s", HAL::SerialController::SerialPortToString(Kernel::Serial.GetPort())); }
+            else if (StringUtil::Equals(state, "off")) { Kernel::MemoryMgr.StopTrace(); Kernel::CLI->Debug.WriteLine("Heap tracing stopped"); }
+            else { Kernel::CLI->Debug.Error("Expected on or off"); }
+        }
+
+        void FRAMES(char* input, Array<char**> args)
+        {
+            Kernel::FrameMgr.Print(DebugMode::Terminal);
+        }
+
         void SERVICES(char* input, Array<char**> args)
         {
             Kernel::ServiceMgr.Print(DebugMode::Terminal);
@@ -334,6 +396,44 @@ namespace PMOS
             Kernel::ThreadMgr.Print(DebugMode::Terminal);
         }
 
+        void THREADPOOL(char* input, Array<char**> args)
+        {
+            if (args.Count == 2) { Kernel::CLI->Debug.Error("Expected high mark"); return; }
+            if (args.Count >= 3) { Kernel::ThreadMgr.SetPoolLimits(StringUtil::ToDecimal(args.Data[1]), StringUtil::ToDecimal(args.Data[2])); }
+            Kernel::ThreadMgr.PrintPool(DebugMode::Terminal);
+        }
+
+        void DEADLINES(char* input, Array<char**> args)
+        {
+            Kernel::ThreadMgr.PrintDeadlines(DebugMode::Terminal);
+        }
+
+        void TIMERS(char* input, Array<char**> args)
+        {
+            Kernel::TimerMgr.Print(DebugMode::Terminal);
+        }
+
+        void WORKQ(char* input, Array<char**> args)
+        {
+            Kernel::WorkMgr.Print(DebugMode::Terminal);
+        }
+
+        void LOOPS(char* input, Array<char**> args)
+        {
+            Services::EventLoop::Print(DebugMode::Terminal);
+        }
+
+        void LOCKS(char* input, Array<char**> args)
+        {
+            Threading::PrintLocks(DebugMode::Terminal);
+        }
+
+        void CPUS(char* input, Array<char**> args)
+        {
+            Kernel::SMP.Print(DebugMode::Terminal);
+            Kernel::ACPI.Print(DebugMode::Terminal);
+        }
+
         void MMAP(char* input, Array<char**> args)
         {
             Kernel::MemoryMgr.PrintMemoryMap(DebugMode::Terminal);
@@ -355,6 +455,7 @@ namespace PMOS
         {
             char* time = Kernel::RTC.GetTimeString(false, true);
             Kernel::Terminal->WriteLine(time);
+            Kernel::CLI->Debug.WriteLine("UPTIME        %d ms", (uint)Kernel::Clock.GetMilliseconds());
         }
 
         void INFO(char* input, Array<char**> args)
@@ -381,15 +482,22 @@ namespace PMOS
             Kernel::CLI->Debug.WriteUnformatted("%)\n");
             Kernel::CLI->Debug.WriteLine("USABLE      %d MB", usable / 1024 / 1024);
             Kernel::CLI->Debug.WriteLine("TOTAL       %d MB", installed / 1024 / 1024);
+            Kernel::CLI->Debug.WriteLine("STACKS      %d KB committed", Kernel::Paging.GetCommittedBytes() / 1024);
         }
 
         void PERF(char* input, Array<char**> args)
         {
             Kernel::ThreadMgr.CalculateCPUUsage();
-            float cpu = Kernel::ThreadMgr.GetCPUUsage();
 
-            Kernel::CLI->Debug.Write("CPU USAGE:    %f", (double)cpu);
-            Kernel::CLI->Debug.WriteUnformatted("%\n");
+            char usage[16];
+            Kernel::CLI->Debug.WriteLine("CPU USAGE:    %s", Threading::ThreadManager::FormatUsage(Kernel::ThreadMgr.GetCPUUsage(), usage));
+            if (Kernel::CPU.GetTSCFrequency() > 0) { Kernel::CLI->Debug.WriteLine("TSC:          %d MHz", Kernel::CPU.GetTSCFrequency() / 1000); }
+            for (uint i = 0; i < Kernel::ThreadMgr.MaxCount; i++)
+            {
+                Threading::Thread* t = Kernel::ThreadMgr.Threads[i];
+                if (t == nullptr) { continue; }
+                Kernel::CLI->Debug.WriteLine("  %s: %s, %d ms", t->GetName(), Threading::ThreadManager::FormatUsage(t->GetCPUUsage(), usage), t->GetCPUTime());
+            }
             Kernel::CLI->Debug.WriteLine("RAM USAGE:    %d MB(%d bytes)", Kernel::MemoryMgr.GetRAMUsed() / 1024 / 1024, Kernel::MemoryMgr.GetRAMUsed());
             Kernel::CLI->Debug.WriteLine("HEAP ENTRIES: %d USED/%d TOTAL", Kernel::MemoryMgr.GetUsedHeapCount(), Kernel::MemoryMgr.GetHeapCount());
         }
@@ -435,10 +543,10 @@ namespace PMOS
 
         void RUN(char* input, Array<char**> args)
         {
-            VirtualMachine::RuntimeHost runtime;
-            runtime.Initialize("TestVM");
-            runtime.LoadTestProgram();
-            runtime.Run();
+            VirtualMachine::RuntimeHost* runtime = new VirtualMachine::RuntimeHost();
+            runtime->Initialize("TestVM");
+            runtime->LoadTestProgram();
+            runtime->Run();
         }
 
         void SCRIPT(char* input, Array<char**> args)
@@ -471,7 +579,7 @@ namespace PMOS
 
         void CD(char* input, Array<char**> args)
         {
-            char* dirname = (char*)MemAlloc(StringUtil::Length(input), true, AllocationType::String);
+            char* dirname = (char*)MemAlloc(StringUtil::Length(input) + 1, true, AllocationType::String);
             dirname = StringUtil::Copy(dirname, (char*)(input + 3));
             if (dirname == nullptr) { return; }
             if (StringUtil::Length(dirname) == 0) { MemFree(dirname); return; }
@@ -512,7 +620,7 @@ namespace PMOS
             // no path provided
             if (StringUtil::Length(input) < 5) { Kernel::FileSys->PrintDirectoryContents(Kernel::CLI->CurrentPath); return; }
 
-            char* dirname = (char*)MemAlloc(StringUtil::Length(input), true, AllocationType::String);
+            char* dirname = (char*)MemAlloc(StringUtil::Length(input) + 1, true, AllocationType::String);
             dirname = StringUtil::Copy(dirname, (char*)(input + 4));
             if (dirname[StringUtil::Length(dirname) - 1] == 0x20) { StringUtil::Delete(dirname); }
 
@@ -539,7 +647,7 @@ namespace PMOS
         {
             if (args.Count < 2) { Kernel::CLI->Debug.Error("Please specify a file"); return; }
            
-            char* filename = (char*)MemAlloc(StringUtil::Length(input), true, AllocationType::String);
+            char* filename = (char*)MemAlloc(StringUtil::Length(input) + 1, true, AllocationType::String);
             filename = StringUtil::Copy(filename, (char*)(input + 6));
             if (filename[StringUtil::Length(filename) - 1] == 0x20) { StringUtil::Delete(filename); }
 
@@ -578,7 +686,7 @@ namespace PMOS
         {
             if (args.Count < 2) { Kernel::CLI->Debug.Error("Please specify a file or directory"); return; }
            
-            char* filename = (char*)MemAlloc(StringUtil::Length(input), true, AllocationType::String);
+            char* filename = (char*)MemAlloc(StringUtil::Length(input) + 1, true, AllocationType::String);
             filename = StringUtil::Copy(filename, (char*)(input + 7));
             if (filename[StringUtil::Length(filename) - 1] == 0x20) { StringUtil::Delete(filename); }
 
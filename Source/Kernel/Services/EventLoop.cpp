@@ -0,0 +1,211 @@
+#include <Kernel/Services/EventLoop.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace Services
+    {
+        // every initialized loop, newest first - lets a loop thread find its loop and the LOOPS command list them
+        EventLoop* LoopList = nullptr;
+
+        void EventLoop::Initialize(char* name)
+        {
+            Name     = name;
+            Head     = nullptr;
+            Tail     = nullptr;
+            Host     = nullptr;
+            Tasks    = 0;
+            Runs     = 0;
+            Sleeps   = 0;
+            Timeouts = 0;
+            Guard.Initialize(nullptr);
+            Wakeup.Initialize(name, true);
+
+            Next     = LoopList;
+            LoopList = this;
+            Kernel::Debug.OK("Initialized event loop '%s'", name);
+        }
+
+        // give the loop a thread of its own
+        void EventLoop::Start(ThreadPriority priority)
+        {
+            if (Host != nullptr) { return; }
+            Host = Kernel::ThreadMgr.Create(Name, 16384, priority, ThreadMain);
+            Host->Start();
+        }
+
+        // run tasks on the calling thread forever, it only sleeps while no task is ready
+        void EventLoop::Run()
+        {
+            Host = Kernel::ThreadMgr.GetCurrentThread();
+            while (true)
+            {
+                LoopTask* task = Pop();
+                if (task == nullptr) { Sleeps++; Wakeup.Wait(); continue; }
+
+                // whichever of the timer and the event did not wake the task is dropped
+                Kernel::TimerMgr.Stop(&task->Timer);
+                Threading::Event* event = task->Waiting;
+                if (event != nullptr) { event->Unsubscribe(task); }
+
+                // cancelled after it was queued
+                if (__sync_val_compare_and_swap(&task->State, LOOP_TASK_READY, LOOP_TASK_IDLE) != LOOP_TASK_READY) { continue; }
+
+                if (task->TimedOut) { Timeouts++; }
+                Runs++;
+
+                // the callback may free the task, it is not touched again
+                task->Callback(task);
+            }
+        }
+
+        void EventLoop::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("EVENT LOOPS", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" -------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("TASKS   RUNS        SLEEPS      TIMEOUTS    NAME\n", Col4::DarkGray);
+
+            for (EventLoop* loop = LoopList; loop != nullptr; loop = loop->Next)
+            {
+                Kernel::Debug.Write("%d       ", loop->Tasks);
+                Kernel::Debug.Write("0x%8x  ", loop->Runs);
+                Kernel::Debug.Write("0x%8x  ", loop->Sleeps);
+                Kernel::Debug.Write("0x%8x  ", loop->Timeouts);
+                Kernel::Debug.WriteLine("%s", loop->Name);
+            }
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // bind a task to this loop, it does not run until it is posted or starts waiting
+        void EventLoop::Attach(LoopTask* task, TaskCallback callback, void* data)
+        {
+            Memory::Set(task, 0, sizeof(LoopTask));
+            task->Loop     = this;
+            task->Callback = callback;
+            task->Data     = data;
+            task->State    = LOOP_TASK_IDLE;
+            __atomic_fetch_add(&Tasks, 1, __ATOMIC_RELAXED);
+        }
+
+        // run the task on the next pass of the loop, a pending wait is given up
+        void EventLoop::Post(LoopTask* task)
+        {
+            if (task->Loop != this) { return; }
+
+            uint state = task->State;
+            while (state != LOOP_TASK_READY)
+            {
+                uint seen = __sync_val_compare_and_swap(&task->State, state, LOOP_TASK_READY);
+                if (seen == state) { task->TimedOut = false; Push(task); return; }
+                state = seen;
+            }
+        }
+
+        // run the task once the event is set, or after timeout milliseconds with TimedOut set - no timeout if 0
+        // called from the task's own callback or before it was ever queued, never while it may be running
+        void EventLoop::WaitFor(LoopTask* task, Threading::Event* event, uint timeout)
+        {
+            if (task->Loop != this) { return; }
+
+            task->TimedOut = false;
+            task->State    = LOOP_TASK_WAITING;
+            if (timeout > 0) { Kernel::TimerMgr.Start(&task->Timer, timeout, TimerExpired, task); }
+
+            // an event that was already set is consumed here, if the timer beat us to it the task still saw the event
+            if (event->Subscribe(task) && !Wake(task, false)) { task->TimedOut = false; }
+        }
+
+        // run the task again after at least ms milliseconds
+        void EventLoop::Delay(LoopTask* task, uint ms)
+        {
+            if (task->Loop != this) { return; }
+            if (ms == 0) { Post(task); return; }
+
+            task->TimedOut = false;
+            task->State    = LOOP_TASK_WAITING;
+            Kernel::TimerMgr.Start(&task->Timer, ms, TimerExpired, task);
+        }
+
+        // detach the task from the loop, whatever it was waiting for no longer wakes it
+        void EventLoop::Cancel(LoopTask* task)
+        {
+            if (task->Loop != this) { return; }
+
+            task->Loop = nullptr;
+            uint state = __sync_lock_test_and_set(&task->State, LOOP_TASK_IDLE);
+            Kernel::TimerMgr.Stop(&task->Timer);
+            Threading::Event* event = task->Waiting;
+            if (event != nullptr) { event->Unsubscribe(task); }
+
+            if (state == LOOP_TASK_READY)
+            {
+                Guard.Acquire();
+                LoopTask* prev = nullptr;
+                for (LoopTask* t = Head; t != nullptr; prev = t, t = t->Next)
+                {
+                    if (t != task) { continue; }
+                    if (prev == nullptr) { Head = t->Next; } else { prev->Next = t->Next; }
+                    if (Tail == t) { Tail = prev; }
+                    break;
+                }
+                Guard.Release();
+            }
+            __atomic_fetch_sub(&Tasks, 1, __ATOMIC_RELAXED);
+        }
+
+        Threading::Thread* EventLoop::GetThread() { return Host; }
+
+        // move a waiting task to the ready queue, false if it was not waiting or something else woke it first - safe from irq handlers
+        bool EventLoop::Wake(LoopTask* task, bool timedOut)
+        {
+            EventLoop* loop = task->Loop;
+            if (loop == nullptr) { return false; }
+            if (__sync_val_compare_and_swap(&task->State, LOOP_TASK_WAITING, LOOP_TASK_READY) != LOOP_TASK_WAITING) { return false; }
+
+            task->TimedOut = timedOut;
+            loop->Push(task);
+            return true;
+        }
+
+        // only a push onto an empty queue has to wake the loop, it looks at the queue again before sleeping
+        void EventLoop::Push(LoopTask* task)
+        {
+            Guard.Acquire();
+            task->Next = nullptr;
+            bool empty = Head == nullptr;
+            if (empty) { Head = task; } else { Tail->Next = task; }
+            Tail = task;
+            Guard.Release();
+
+            if (empty) { Wakeup.Set(); }
+        }
+
+        LoopTask* EventLoop::Pop()
+        {
+            Guard.Acquire();
+            LoopTask* task = Head;
+            if (task != nullptr)
+            {
+                Head = task->Next;
+                if (Head == nullptr) { Tail = nullptr; }
+                task->Next = nullptr;
+            }
+            Guard.Release();
+            return task;
+        }
+
+        // runs in the timer interrupt
+        void EventLoop::TimerExpired(KernelTimer* timer) { Wake((LoopTask*)timer->Data, true); }
+
+        void EventLoop::ThreadMain(Threading::Thread* t)
+        {
+            for (EventLoop* loop = LoopList; loop != nullptr; loop = loop->Next) { if (loop->Host == t) { loop->Run(); } }
+        }
+    }
+}
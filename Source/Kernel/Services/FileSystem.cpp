@@ -33,6 +33,9 @@ namespace PMOS
         {
             Service::Initialize();
 
+            // disk tables are shared by every thread using the file system, io methods call each other so the lock is recursive
+            IOLock.Initialize("fshost");
+
             Kernel::ServiceMgr.Register(this);
             Kernel::ServiceMgr.Start(this);
         }
@@ -86,6 +89,8 @@ namespace PMOS
         // print contents of specified directory
         void FSHost::PrintDirectoryContents(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             if (path == nullptr) { return; }
             if (StringUtil::Length(path) == 0) { return; }
 
@@ -123,6 +128,8 @@ namespace PMOS
         // mount the file system
         void FSHost::Mount()
         {
+            Threading::MutexGuard guard(&IOLock);
+
             if (!Kernel::ATA->Identify()) { return; }
 
             // read super block from disk
@@ -144,6 +151,8 @@ namespace PMOS
         // unmount the file system
         void FSHost::Unmount()
         {
+            Threading::MutexGuard guard(&IOLock);
+
             uint block_table_size = SuperBlock.BlockTable.SizeInBytes;
             uint entry_table_size = SuperBlock.EntryTable.SizeInBytes;
 
@@ -162,6 +171,8 @@ namespace PMOS
         // format the disk with manually specified size in bytes
         void FSHost::Format(uint size, bool wipe)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             DiskSize = size;
 
             // make sure drive is unmounted before formatting
@@ -205,6 +216,8 @@ namespace PMOS
         // fill entire disk image with zeros
         void FSHost::Wipe()
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // clear disk
             Kernel::Debug.WriteLine("DISK SIZE: %d", DiskSize);
             byte* data = (byte*)MemAlloc(FS_SIZE_SECTOR);
@@ -228,6 +241,8 @@ namespace PMOS
         // write block and entry table to disk
         void FSHost::WriteTables()
         {
+            Threading::MutexGuard guard(&IOLock);
+
             WriteSuperBlock();
             WriteBlockTable();
             WriteEntryTable();
@@ -999,7 +1014,7 @@ namespace PMOS
             {
                 if (StringUtil::Length(args[i]) > 0)
                 {
-                    char* str = (char*)MemAlloc(StringUtil::Length(args[i]));
+                    char* str = (char*)MemAlloc(StringUtil::Length(args[i]) + 1);
                     StringUtil::Copy(str, args[i]);
                     output[index] = str;
                     index++;
@@ -1253,6 +1268,8 @@ namespace PMOS
 
         FileEntry FSHost::IOOpenFile(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             if(!IOFileExists(path)) { Kernel::Debug.Error("Unable to locate file %s", path); return NullFile; }
 
             FileEntry* fileptr = GetFileByName(path);
@@ -1280,6 +1297,8 @@ namespace PMOS
 
         FileEntry FSHost::IOCreateFile(char* path, uint size, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate arguments
             if (StringUtil::Length(path) == 0 || size == 0) { return NullFile; }
 
@@ -1329,6 +1348,8 @@ namespace PMOS
         
         FileEntry FSHost::IOCreateFile(char* path, uint size, byte* data, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate arguments
             if (StringUtil::Length(path) == 0 || size == 0) { return NullFile; }
 
@@ -1399,6 +1420,8 @@ namespace PMOS
 
         DirectoryEntry FSHost::IOCreateDirectory(char* path, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate arguments
             if (StringUtil::Length(path) == 0) { return NullDir; }
 
@@ -1442,6 +1465,8 @@ namespace PMOS
 
         bool FSHost::IOFileExists(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate path
             if (path == nullptr) { Kernel::Debug.Error("Null path while searching for file"); return false; }
             if (StringUtil::Length(path) == 0) { Kernel::Debug.Error("Blank path while searching for file"); return false; }
@@ -1490,6 +1515,7 @@ namespace PMOS
 
         bool FSHost::IODirectoryExists(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
             
             if (path == nullptr) { return false; }
 
@@ -1543,48 +1569,64 @@ namespace PMOS
 
         FileEntry FSHost::IOCopyFile(char* dest, char* src)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IOCopyFile - NOT YET IMPLEMENTED");
             return NullFile;
         }
 
         DirectoryEntry FSHost::IOCopyDirectory(char* dest, char* src)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IOCopyDirectory - NOT YET IMPLEMENTED");
             return NullDir;
         }
 
         FileEntry FSHost::IOMoveFile(char* dest, char* src)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IOMoveFile - NOT YET IMPLEMENTED");
             return NullFile;
         }
 
         DirectoryEntry FSHost::IOMoveDirectory(char* dest, char* src)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IOMoveDirectory - NOT YET IMPLEMENTED");
             return NullDir;
         }
 
         bool FSHost::IODeleteFile(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IODeleteFile - NOT YET IMPLEMENTED");
             return false;
         }
 
         bool FSHost::IODeleteDirectory(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IODeleteDirectory - NOT YET IMPLEMENTED");
             return false;
         }
 
         bool FSHost::IORenameFile(char* path, char* name)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IORenameFile - NOT YET IMPLEMENTED");
             return false;
         }
 
         bool FSHost::IORenameDirectory(char* path, char* name)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IORenameDirectory - NOT YET IMPLEMENTED");
             return false;
         }
@@ -1595,6 +1637,8 @@ namespace PMOS
 
         bool FSHost::IOWriteAllText(char* path, char* text, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // file already exists - override
             if (IOFileExists(path))
             {
@@ -1683,6 +1727,8 @@ namespace PMOS
 
         bool FSHost::IOWriteAllBytes(char* path, byte* data, uint size, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // file already exists - override
             if (IOFileExists(path))
             {
@@ -1771,12 +1817,16 @@ namespace PMOS
 
         bool FSHost::IOWriteAllLines(char* path, char** lines, uint count, bool write)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             Kernel::Debug.Info("IOWriteAllLines - NOT YET IMPLEMENTED");
             return false;
         }
         
         char* FSHost::IOReadAllText(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate file
             if (!IOFileExists(path)) { Kernel::Debug.Error("Unable to locate file for reading"); return nullptr; }
 
@@ -1799,6 +1849,8 @@ namespace PMOS
 
         byte* FSHost::IOReadAllBytes(char* path)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate file
             if (!IOFileExists(path)) { Kernel::Debug.Error("Unable to locate file for reading"); return nullptr; }
 
@@ -1816,47 +1868,31 @@ namespace PMOS
 
         char** FSHost::IOReadAllLines(char* path, uint* count)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // validate file
             if (!IOFileExists(path)) { Kernel::Debug.Error("Unable to locate file for reading all lines"); return nullptr; }
 
             // read data from file
             char* file_text = IOReadAllText(path);
+            uint  text_len  = StringUtil::Length(file_text);
 
-            // split by newline
-            uint lines_count = 1;
-
-            // count lines
-            for (uint i = 0; i < StringUtil::Length(file_text); i++)
+            // split by newline, growing the output array as lines are found
+            char** output = nullptr;
+            uint lines_count = 0;
+            uint start = 0;
+            for (uint i = 0; i <= text_len; i++)
             {
-                if (file_text[i] == '\n') { lines_count++; }
-            }
+                if (i < text_len && file_text[i] != '\n') { continue; }
 
-            // allocate new array
-            char** output = (char**)MemAlloc(sizeof(char*) * lines_count);
-            char* temp = (char*)MemAlloc(16384);
-
-            // add lines
-            int index = 0;
-            int len = 0;
-            for (uint i = 0; i < StringUtil::Length(file_text); i++)
-            {
-                if (file_text[i] == '\n' || i == StringUtil::Length(file_text) - 1)
-                {
-                    output[index] = (char*)MemAlloc(len + 1, true, AllocationType::String);
-                    StringUtil::Copy(output[index], temp);
-                    index++;
-                    len = 0;
-                    StringUtil::Clear(temp);
-                }
-                else
-                {
-                    StringUtil::Append(temp, file_text[i]);
-                    len++;
-                }
+                if ((lines_count & 15) == 0) { output = (char**)MemRealloc(output, (lines_count + 16) * sizeof(char*)); }
+                output[lines_count] = (char*)MemAlloc(i - start + 1, true, AllocationType::String);
+                Memory::Copy(output[lines_count], file_text + start, i - start);
+                lines_count++;
+                start = i + 1;
             }
 
             // return list
-            MemFree(temp);
             MemFree(file_text);
             *count = lines_count;
             return output;
@@ -1864,6 +1900,8 @@ namespace PMOS
 
         DirectoryEntry** FSHost::IOGetDirectories(char* path, uint* count)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // output array
             uint output_len = 0;
             DirectoryEntry** output = nullptr;
@@ -1919,6 +1957,8 @@ namespace PMOS
 
         FileEntry** FSHost::IOGetFiles(char* path, uint* count)
         {
+            Threading::MutexGuard guard(&IOLock);
+
             // output array
             uint output_len = 0;
             FileEntry** output = nullptr;
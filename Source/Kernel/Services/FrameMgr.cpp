@@ -0,0 +1,242 @@
+#include <Kernel/Services/FrameMgr.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace Services
+    {
+        void FrameManager::Initialize()
+        {
+            FrameLock.Initialize("frames");
+
+            // size the bitmaps by the highest usable address below 4 GB
+            uint top = 0;
+            for (uint i = 0; i < Kernel::Multiboot.MemoryMapLength; i += sizeof(MemoryMapEntry))
+            {
+                MemoryMapEntry* entry = (MemoryMapEntry*)(Kernel::Multiboot.MemoryMapAddress + i);
+                if (entry->Type != 0x01 || entry->AddressHigh != 0) { continue; }
+                uint end = entry->AddressLow + entry->LengthLow;
+                if (entry->LengthHigh != 0 || end < entry->AddressLow) { end = 0xFFFFF000; }
+                if (end > top) { top = end; }
+            }
+
+            InstalledBytes = top;
+            FrameCount     = top / FM_FRAME;
+            uint words = (FrameCount + 31) / 32;
+
+            // bitmaps sit right after the kernel - used frames, first frame and last frame of each allocation
+            Bitmap   = (uint*)((Kernel::GetEndAddress() & 0xFFFFF000) + FM_FRAME);
+            StartMap = Bitmap + words;
+            EndMap   = StartMap + words;
+            MapEnd   = (((uint)(EndMap + words)) & 0xFFFFF000) + FM_FRAME;
+
+            Memory::Set(Bitmap, 0xFF, words * sizeof(uint));
+            Memory::Set(StartMap, 0, words * sizeof(uint));
+            Memory::Set(EndMap, 0, words * sizeof(uint));
+
+            // free every whole frame of every usable region
+            TotalCount = 0;
+            for (uint i = 0; i < Kernel::Multiboot.MemoryMapLength; i += sizeof(MemoryMapEntry))
+            {
+                MemoryMapEntry* entry = (MemoryMapEntry*)(Kernel::Multiboot.MemoryMapAddress + i);
+                if (entry->Type != 0x01 || entry->AddressHigh != 0) { continue; }
+                uint end = entry->AddressLow + entry->LengthLow;
+                if (entry->LengthHigh != 0 || end < entry->AddressLow) { end = 0xFFFFF000; }
+
+                uint first = (entry->AddressLow + FM_FRAME - 1) / FM_FRAME;
+                uint last  = end / FM_FRAME;
+                if (last <= first) { continue; }
+                SetRange(Bitmap, first, last - first, false);
+                TotalCount += last - first;
+            }
+
+            // low memory, the kernel image, the bitmaps and the memory map itself stay reserved
+            SetRange(Bitmap, 0, MapEnd / FM_FRAME, true);
+            uint mmap = Kernel::Multiboot.MemoryMapAddress / FM_FRAME;
+            uint mmap_end = (Kernel::Multiboot.MemoryMapAddress + Kernel::Multiboot.MemoryMapLength + FM_FRAME - 1) / FM_FRAME;
+            if (mmap_end <= FrameCount) { SetRange(Bitmap, mmap, mmap_end - mmap, true); }
+
+            FreeCount = 0;
+            for (uint i = 0; i < FrameCount; i++) { if (!IsUsed(i)) { FreeCount++; } }
+
+            Kernel::Debug.Info("FRAME BITMAP     0x%8x", (uint)Bitmap);
+            Kernel::Debug.Info("FRAMES USABLE    %d MB", (TotalCount * FM_FRAME) / 1024 / 1024);
+            Kernel::Debug.Info("FRAMES FREE      %d MB", (FreeCount * FM_FRAME) / 1024 / 1024);
+        }
+
+        void FrameManager::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("PHYSICAL FRAMES", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" ---------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("FREE RUN      FRAMES\n", Col4::DarkGray);
+
+            Lock();
+            uint run = 0;
+            for (uint i = 0; i <= FrameCount; i++)
+            {
+                if (i < FrameCount && !IsUsed(i)) { run++; continue; }
+                if (run == 0) { continue; }
+
+                Col4 old = Kernel::Terminal->GetForeColor();
+                Kernel::Terminal->SetForeColor(Col4::White);
+                Kernel::Debug.Write("0x%8x    ", (i - run) * FM_FRAME);
+                Kernel::Terminal->SetForeColor(Col4::Yellow);
+                Kernel::Debug.WriteLine("%d", run);
+                Kernel::Terminal->SetForeColor(old);
+                run = 0;
+            }
+            Unlock();
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("USABLE        %d KB", GetTotalBytes() / 1024);
+            Kernel::Debug.WriteLine("FREE          %d KB", GetFreeBytes() / 1024);
+            Kernel::Debug.WriteLine("USED          %d KB", GetUsedBytes() / 1024);
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // first fit from the top of memory down, so the heap can keep growing upwards from the bottom of its run
+        uint FrameManager::AllocateFrames(uint count)
+        {
+            if (count == 0) { return 0; }
+
+            Lock();
+            uint run = 0;
+            for (int i = (int)FrameCount - 1; i >= 0; i--)
+            {
+                if ((i & 31) == 31 && Bitmap[i >> 5] == 0xFFFFFFFF) { run = 0; i -= 31; continue; }
+                if (IsUsed(i)) { run = 0; continue; }
+                if (++run < count) { continue; }
+
+                MarkAllocation(i, count);
+                Unlock();
+                return i * FM_FRAME;
+            }
+            Unlock();
+            return 0;
+        }
+
+        // take a specific range, fails if any frame in it is already used
+        bool FrameManager::ClaimFrames(uint addr, uint count)
+        {
+            if (count == 0 || (addr & (FM_FRAME - 1)) != 0) { return false; }
+            uint frame = addr / FM_FRAME;
+            if (frame + count > FrameCount) { return false; }
+
+            Lock();
+            for (uint i = frame; i < frame + count; i++) { if (IsUsed(i)) { Unlock(); return false; } }
+            MarkAllocation(frame, count);
+            Unlock();
+            return true;
+        }
+
+        // permanently withhold a physical range, e.g. memory hidden behind a virtual window
+        void FrameManager::ReserveRange(uint addr, uint length)
+        {
+            uint first = addr / FM_FRAME;
+            uint last = (addr + length - 1) / FM_FRAME;
+            if (first >= FrameCount) { return; }
+            if (last >= FrameCount) { last = FrameCount - 1; }
+
+            Lock();
+            for (uint i = first; i <= last; i++)
+            {
+                if (IsUsed(i)) { continue; }
+                Bitmap[i >> 5] |= (1 << (i & 31));
+                FreeCount--;
+                TotalCount--;
+            }
+            Unlock();
+        }
+
+        // release a whole allocation by its base address, returns the number of frames freed
+        uint FrameManager::FreeFrames(uint addr)
+        {
+            Lock();
+            if (!IsAllocation(addr)) { Unlock(); return 0; }
+
+            uint frame = addr / FM_FRAME;
+            uint count = 1;
+            while (!(EndMap[(frame + count - 1) >> 5] & (1 << ((frame + count - 1) & 31)))) { count++; }
+
+            SetRange(Bitmap, frame, count, false);
+            StartMap[frame >> 5] &= ~(1 << (frame & 31));
+            EndMap[(frame + count - 1) >> 5] &= ~(1 << ((frame + count - 1) & 31));
+            FreeCount += count;
+            Unlock();
+            return count;
+        }
+
+        bool FrameManager::IsAllocation(uint addr)
+        {
+            if ((addr & (FM_FRAME - 1)) != 0) { return false; }
+            uint frame = addr / FM_FRAME;
+            if (frame >= FrameCount) { return false; }
+            return (StartMap[frame >> 5] & (1 << (frame & 31))) != 0;
+        }
+
+        uint FrameManager::GetAllocationSize(uint addr)
+        {
+            if (!IsAllocation(addr)) { return 0; }
+            uint frame = addr / FM_FRAME;
+            uint count = 1;
+            while (!(EndMap[(frame + count - 1) >> 5] & (1 << ((frame + count - 1) & 31)))) { count++; }
+            return count * FM_FRAME;
+        }
+
+        // longest stretch of free frames, in frames
+        uint FrameManager::GetLargestRun(uint* base)
+        {
+            uint best = 0, run = 0;
+            for (uint i = 0; i <= FrameCount; i++)
+            {
+                if (i < FrameCount && !IsUsed(i)) { run++; continue; }
+                if (run > best) { best = run; if (base != nullptr) { *base = (i - run) * FM_FRAME; } }
+                run = 0;
+            }
+            return best;
+        }
+
+        // end of the highest usable region, holes and reserved ranges below it included
+        uint FrameManager::GetInstalledBytes() { return InstalledBytes; }
+
+        uint FrameManager::GetTotalBytes() { return TotalCount * FM_FRAME; }
+
+        uint FrameManager::GetFreeBytes() { return FreeCount * FM_FRAME; }
+
+        uint FrameManager::GetUsedBytes() { return (TotalCount - FreeCount) * FM_FRAME; }
+
+        // true while this processor is inside the allocator, a stack fault taken there must not scan the bitmap again
+        bool FrameManager::IsBusy() { return FrameLock.IsHeld(); }
+
+        void FrameManager::Lock() { FrameLock.Acquire(); }
+
+        void FrameManager::Unlock() { FrameLock.Release(); }
+
+        bool FrameManager::IsUsed(uint frame) { return (Bitmap[frame >> 5] & (1 << (frame & 31))) != 0; }
+
+        void FrameManager::SetRange(uint* map, uint frame, uint count, bool state)
+        {
+            uint end = frame + count;
+            while (frame < end)
+            {
+                // whole words at a time where possible
+                if ((frame & 31) == 0 && end - frame >= 32) { map[frame >> 5] = state ? 0xFFFFFFFF : 0; frame += 32; continue; }
+                if (state) { map[frame >> 5] |= (1 << (frame & 31)); } else { map[frame >> 5] &= ~(1 << (frame & 31)); }
+                frame++;
+            }
+        }
+
+        void FrameManager::MarkAllocation(uint frame, uint count)
+        {
+            SetRange(Bitmap, frame, count, true);
+            StartMap[frame >> 5] |= (1 << (frame & 31));
+            EndMap[(frame + count - 1) >> 5] |= (1 << ((frame + count - 1) & 31));
+            FreeCount -= count;
+        }
+    }
+}
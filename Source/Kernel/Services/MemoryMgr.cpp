@@ -6,37 +6,74 @@ namespace PMOS
     namespace Services
     {
 
+        // printable names for AllocationType, objects sitting in a thread magazine are tagged Slab
+        const char* AllocationTypeNames[MM_TYPES] = { "UNUSED", "DEFAULT", "STRING", "BITMAP", "SYSTEM", "THREAD", "STACK", "FRAMEBUF", "PCI", "VMRAM", "UI", "CACHED", "ARENA" };
+
+        inline void StatAdd(uint* value, uint amount) { __atomic_fetch_add(value, amount, __ATOMIC_RELAXED); }
+
+        uint Align(uint addr)
+        {
+            uint out = addr;
+            out &= 0xFFFFF000;
+            if (out < addr) { out += MM_ALIGN; }
+            return out;
+        }
+
         void MemoryManager::Initialize()
         {
             MessagesEnabled = true;
-            uint start = Kernel::GetEndAddress() & 0xFFFFF000;
-            start += 0x1000;
-            Header.MMapStart = start;
+            HeapLock.Initialize("heap");
 
+            // memory map copy and entry table come straight from the frame allocator
+            Header.MMapStart = Kernel::FrameMgr.AllocateFrames(Align(Kernel::Multiboot.MemoryMapLength) / MM_ALIGN);
             ReadMemoryMap();
 
-            uint tableStart = ((Header.MMapStart + Header.MMapSize) & 0xFFFFF000) + MM_ALIGN;
-            
             Header.TableMaxEntries = 65536;
-            Header.TableStart = tableStart;
             Header.TableLength = Header.TableMaxEntries * sizeof(HeapEntry);
+            Header.TableStart = Kernel::FrameMgr.AllocateFrames(Align(Header.TableLength) / MM_ALIGN);
+            DirectRuns = (HeapDirectRun*)Kernel::FrameMgr.AllocateFrames(1);
             Header.TablePosition = 0;
             Header.TableEntries = 0;
-            
-            uint dataStart = ((Header.TableStart + Header.TableLength) & 0xFFFFF000) + MM_ALIGN;
-            Header.DataStart = dataStart;
-            Header.DataLength = Header.DataEnd - Header.DataStart;
+            Header.TableFreeSlot = 0;
+            if (Header.MMapStart == 0 || Header.TableStart == 0 || DirectRuns == nullptr) { Kernel::Debug.Panic((int)Exception::OutOfMemory); return; }
+
+            // the heap starts at the bottom of the largest free run and grows up into it on demand
+            uint run_base = 0;
+            uint run = Kernel::FrameMgr.GetLargestRun(&run_base);
+            Header.DataLimit = run_base + (run * MM_ALIGN);
+
+            // page map - first and last page of every block hold the index + 1 of its entry
+            Header.PageMapStart = run_base;
+            Header.PageMapCount = run;
+            Header.DataStart = Header.PageMapStart + Align(Header.PageMapCount * sizeof(uint));
+            Header.DataLength = Header.DataLimit - Header.DataStart;
+            if (Header.DataLength > MM_HEAP_INITIAL) { Header.DataLength = MM_HEAP_INITIAL; }
+            Header.DataEnd = Header.DataStart + Header.DataLength;
             Header.DataUsed = 0;
+            Header.DirectUsed = 0;
+            if (!Kernel::FrameMgr.ClaimFrames(Header.PageMapStart, (Header.DataEnd - Header.PageMapStart) / MM_ALIGN)) { Kernel::Debug.Panic("Unable to claim heap frames"); return; }
 
             Memory::Set((void*)Header.TableStart, 0, Header.TableLength);
-            Memory::Set((void*)Header.DataStart, 0, Header.DataLength);
+            Memory::Set(DirectRuns, 0, MM_ALIGN);
+            Memory::Set((void*)Header.PageMapStart, 0, Header.PageMapCount * sizeof(uint));
+            Memory::Set(FreeBuckets, 0, sizeof(FreeBuckets));
+            Memory::Set(&Stats, 0, sizeof(HeapStats));
+            Trace = nullptr;
+            TraceHead = TraceTail = TraceDropped = 0;
+            Tracing = false;
+
+            // data region contents are unknown, memory is zeroed on demand
+            Header.MassClean = Header.DataStart;
 
-            CreateEntry({ Header.DataStart, Header.DataLength, (byte)AllocationType::Unused });
+            CreateEntry(Header.DataStart, Header.DataLength, AllocationType::Unused);
+            InitializeSlabs();
 
             Kernel::Debug.Info("TABLE START      0x%8x", Header.TableStart);
             Kernel::Debug.Info("TABLE SIZE       %d KB", Header.TableLength / 1024);
+            Kernel::Debug.Info("PAGE MAP SIZE    %d KB", (Header.PageMapCount * sizeof(uint)) / 1024);
             Kernel::Debug.Info("DATA START       0x%8x", Header.DataStart);
             Kernel::Debug.Info("DATA END         0x%8x", Header.DataEnd);
+            Kernel::Debug.Info("DATA LIMIT       0x%8x", Header.DataLimit);
             Kernel::Debug.Info("DATA SIZE        %d MB", Header.DataLength / 1024 / 1024);
         }
 
@@ -58,9 +95,9 @@ namespace PMOS
                     {
                         Memory::Copy((void*)(Header.MMapStart + pos), entry, sizeof(MemoryMapEntry));
 
-                        if (entry->Type == 0x01 && i > 0)
+                        // the kernel is loaded into the first usable region above low memory
+                        if (entry->Type == 0x01 && entry->AddressLow <= Kernel::GetEndAddress() && entry->AddressLow + entry->LengthLow > Kernel::GetEndAddress())
                         {
-                            Header.DataEnd = entry->AddressLow + entry->LengthLow;
                             KernelSize = Kernel::GetEndAddress() - entry->AddressLow;
                         }
 
@@ -83,7 +120,7 @@ namespace PMOS
             Kernel::Debug.NewLine();
             Kernel::Debug.WriteUnformatted("ID        ADDR          TYPE    SIZE\n", Col4::DarkGray);
 
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            for (uint i = 0; i < Header.TablePosition; i++)
             {
                 HeapEntry* entry = GetEntry(i);
 
@@ -118,6 +155,101 @@ namespace PMOS
             Kernel::Debug.SetMode(oldMode);
         }
 
+        void MemoryManager::PrintSlabs(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("SLAB CLASSES", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" ------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("SIZE      PER PAGE    SLABS     OBJECTS\n", Col4::DarkGray);
+
+            for (uint i = 0; i < MM_SLAB_CLASSES; i++)
+            {
+                SlabClass* cls = &SlabClasses[i];
+                uint objects = 0;
+
+                // full slabs are off the partial list, so count through the table
+                for (uint j = 0; j < Header.TablePosition; j++)
+                {
+                    HeapEntry* entry = GetEntry(j);
+                    if (entry->Type != (byte)AllocationType::Slab) { continue; }
+                    SlabHeader* slab = (SlabHeader*)entry->Base;
+                    if (slab->Magic == MM_SLAB_MAGIC && slab->Class == i) { objects += slab->Used; }
+                }
+
+                Col4 old = Kernel::Terminal->GetForeColor();
+                Kernel::Terminal->SetForeColor(Col4::White);
+                Kernel::Debug.Write("%d", cls->Size);
+                Kernel::Terminal->SetForeColor(Col4::Gray);
+                Kernel::Terminal->SetCursorX(10);
+                Kernel::Debug.Write("%d", cls->Capacity);
+                Kernel::Terminal->SetCursorX(22);
+                Kernel::Debug.Write("%d", cls->Slabs);
+                Kernel::Terminal->SetForeColor(Col4::Yellow);
+                Kernel::Terminal->SetCursorX(32);
+                Kernel::Debug.WriteLine("%d", objects);
+                Kernel::Terminal->SetForeColor(old);
+            }
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        void MemoryManager::PrintStats(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("HEAP STATISTICS", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" ---------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("TYPE      COUNT       BYTES\n", Col4::DarkGray);
+
+            Col4 old = Kernel::Terminal->GetForeColor();
+            for (uint i = 1; i < MM_TYPES; i++)
+            {
+                if (Stats.LiveCount[i] == 0) { continue; }
+                Kernel::Terminal->SetForeColor(Col4::White);
+                Kernel::Debug.Write("%s", AllocationTypeNames[i]);
+                Kernel::Terminal->SetForeColor(Col4::Gray);
+                Kernel::Terminal->SetCursorX(10);
+                Kernel::Debug.Write("%d", Stats.LiveCount[i]);
+                Kernel::Terminal->SetForeColor(Col4::Yellow);
+                Kernel::Terminal->SetCursorX(22);
+                Kernel::Debug.WriteLine("%d", Stats.LiveBytes[i]);
+            }
+            Kernel::Terminal->SetForeColor(old);
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("USED          %d bytes", Header.DataUsed);
+            Kernel::Debug.WriteLine("DIRECT        %d bytes", Header.DirectUsed);
+            Kernel::Debug.WriteLine("PEAK          %d bytes", Stats.Peak);
+            Kernel::Debug.WriteLine("PAGE WASTE    %d bytes", Stats.Waste);
+            Kernel::Debug.WriteLine("ALLOCATIONS   %d", Stats.Allocations);
+            Kernel::Debug.WriteLine("FREES         %d", Stats.Frees);
+            Kernel::Debug.WriteLine("ALLOC CYCLES  p50 < %d  p99 < %d", GetLatencyPercentile(Stats.AllocCycles, 50), GetLatencyPercentile(Stats.AllocCycles, 99));
+            Kernel::Debug.WriteLine("FREE CYCLES   p50 < %d  p99 < %d", GetLatencyPercentile(Stats.FreeCycles, 50), GetLatencyPercentile(Stats.FreeCycles, 99));
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("REQUEST SIZE     COUNT\n", Col4::DarkGray);
+            for (uint i = 0; i < MM_SIZE_BUCKETS; i++)
+            {
+                if (Stats.Sizes[i] == 0) { continue; }
+                Kernel::Terminal->SetForeColor(Col4::Gray);
+                if (i == MM_SIZE_BUCKETS - 1) { Kernel::Debug.Write("> %d", 16 << (i - 1)); }
+                else { Kernel::Debug.Write("<= %d", 16 << i); }
+                Kernel::Terminal->SetForeColor(Col4::Yellow);
+                Kernel::Terminal->SetCursorX(17);
+                Kernel::Debug.WriteLine("%d", Stats.Sizes[i]);
+            }
+            Kernel::Terminal->SetForeColor(old);
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
         void MemoryManager::PrintMemoryMap(DebugMode mode)
         {
             DebugMode oldMode = Kernel::Debug.Mode;
@@ -192,60 +324,630 @@ namespace PMOS
             Kernel::Debug.WriteLine("%d", entry->Size);
         }
 
-        uint Align(uint addr)
+        void* MemoryManager::Allocate(uint size) { return Allocate(size, true, AllocationType::Default, __builtin_return_address(0)); }
+
+        void* MemoryManager::Allocate(uint size, bool clear, AllocationType type) { return Allocate(size, clear, type, __builtin_return_address(0)); }
+
+        void* MemoryManager::Allocate(uint size, bool clear, AllocationType type, void* caller)
         {
-            uint out = addr;
-            out &= 0xFFFFF000;
-            if (out < addr) { out += MM_ALIGN; }
-            return out;
+            if (size == 0) { return nullptr; }
+            if (type == AllocationType::Unused) { type = AllocationType::Default; }
+
+            uint start = Kernel::CPU.ReadTSC();
+            void* ptr = AllocateRouted(size, clear, type);
+            StatAdd(&Stats.Sizes[GetSizeBucket(size)], 1);
+            StatAdd(&Stats.Allocations, 1);
+            TrackLatency(Stats.AllocCycles, start);
+            if (Tracing) { TraceEvent(HeapTraceOp::Allocate, ptr, size, type, caller); }
+            return ptr;
+        }
+
+        void* MemoryManager::AllocateRouted(uint size, bool clear, AllocationType type)
+        {
+            // route to the arena the current thread has pushed, if any - an irq handler would land in whichever thread it interrupted,
+            // and arenas take no lock, while frames and thread objects have to outlive the scope that happened to create them
+            Threading::Thread* thread = Kernel::ThreadMgr.GetCurrentThread();
+            bool irq = Kernel::InterruptMgr.InInterrupt();
+            if (thread != nullptr && thread->Arena != nullptr && !irq && !IsDirect(type, size) && type != AllocationType::Thread) { return ArenaAllocate(thread->Arena, size, clear); }
+
+            // stacks, frame buffers and vm memory take whole frames and never fragment the heap
+            if (IsDirect(type, size))
+            {
+                void* ptr = AllocateDirect(size, clear, type);
+                if (ptr != nullptr) { return ptr; }
+            }
+
+            // threads take small objects from their own magazines, irq handlers go straight to the slabs
+            if (thread != nullptr && SlabsReady && size <= MM_SLAB_MAX && !irq) { return AllocateCached(&thread->Magazines, size, clear, type); }
+
+            Lock();
+            void* ptr = (SlabsReady && size <= MM_SLAB_MAX) ? AllocateSmall(size, clear, type) : AllocatePages(size, clear, type);
+            Unlock();
+            return ptr;
+        }
+
+        void MemoryManager::Free(void* ptr) { Free(ptr, __builtin_return_address(0)); }
+
+        void MemoryManager::Free(void* ptr, void* caller)
+        {
+            if (!IsAddressValid((uint)ptr) && !Kernel::FrameMgr.IsAllocation((uint)ptr)) { return; }
+
+            // arena objects are traced when their arena is released
+            if (Tracing && GetArenaChunkFromPtr(ptr) == nullptr) { TraceEvent(HeapTraceOp::Free, ptr, 0, AllocationType::Unused, caller); }
+
+            uint start = Kernel::CPU.ReadTSC();
+            FreeRouted(ptr);
+            StatAdd(&Stats.Frees, 1);
+            TrackLatency(Stats.FreeCycles, start);
+        }
+
+        void MemoryManager::FreeRouted(void* ptr)
+        {
+            if (!IsAddressValid((uint)ptr)) { FreeDirect(ptr); return; }
+
+            // page allocations are always aligned, slab and arena objects never are - arena objects go with their arena
+            if (((uint)ptr & (MM_ALIGN - 1)) != 0)
+            {
+                if (GetArenaChunkFromPtr(ptr) != nullptr) { return; }
+
+                Threading::Thread* thread = Kernel::ThreadMgr.GetCurrentThread();
+                if (thread != nullptr && thread->Magazines != nullptr && !Kernel::InterruptMgr.InInterrupt() && FreeCached(thread->Magazines, ptr)) { return; }
+            }
+
+            Lock();
+            if (((uint)ptr & (MM_ALIGN - 1)) != 0) { FreeSmall(ptr); } else { FreePages(ptr); }
+            Unlock();
+        }
+
+        // nullptr only when the run table is full, the frames are cleared outside the lock
+        void* MemoryManager::AllocateDirect(uint size, bool clear, AllocationType type)
+        {
+            Lock();
+            HeapDirectRun* run = GetDirectRun(0);
+            if (run == nullptr) { Unlock(); return nullptr; }
+
+            uint addr = Kernel::FrameMgr.AllocateFrames(Align(size) / MM_ALIGN);
+            if (addr == 0) { Unlock(); Kernel::Debug.Panic((int)Exception::OutOfMemory); return nullptr; }
+
+            run->Base = addr;
+            run->Size = size;
+            run->Type = (uint)type;
+            StatAdd(&Header.DirectUsed, Align(size));
+            TrackType(type, 1, Align(size));
+            Stats.Waste += Align(size) - size;
+            UpdatePeak();
+            Unlock();
+
+            if (clear) { Memory::Set((void*)addr, 0, size); }
+            return (void*)addr;
+        }
+
+        void MemoryManager::FreeDirect(void* ptr)
+        {
+            Lock();
+            HeapDirectRun* run = GetDirectRun((uint)ptr);
+            uint bytes = Kernel::FrameMgr.FreeFrames((uint)ptr) * MM_ALIGN;
+            StatAdd(&Header.DirectUsed, 0 - bytes);
+            if (run != nullptr)
+            {
+                TrackType((AllocationType)run->Type, -1, -(int)bytes);
+                Stats.Waste -= bytes - run->Size;
+                run->Base = 0;
+            }
+            Unlock();
+        }
+
+        // record of the run starting at base, or a free slot for base 0 - called with the heap locked
+        HeapDirectRun* MemoryManager::GetDirectRun(uint base)
+        {
+            for (uint i = 0; i < MM_DIRECT_RUNS; i++) { if (DirectRuns[i].Base == base) { return &DirectRuns[i]; } }
+            return nullptr;
         }
 
-        void* MemoryManager::Allocate(uint size) { Allocate(size, false, AllocationType::Default); }
+        // heap and direct frames together, called with the heap locked
+        void MemoryManager::UpdatePeak()
+        {
+            uint used = Header.DataUsed + Header.DirectUsed;
+            if (used > Stats.Peak) { Stats.Peak = used; }
+        }
+
+        // heap critical section - interrupts stay off while the shared structures are touched
+        void MemoryManager::Lock() { HeapLock.Acquire(); }
+
+        void MemoryManager::Unlock() { HeapLock.Release(); }
+
+        // counters are bumped from the lock free magazine path too, so they are updated atomically
+        void MemoryManager::TrackType(AllocationType type, int count, int bytes)
+        {
+            StatAdd(&Stats.LiveCount[(byte)type], (uint)count);
+            StatAdd(&Stats.LiveBytes[(byte)type], (uint)bytes);
+        }
+
+        void MemoryManager::TrackLatency(uint* buckets, uint start)
+        {
+            if (start == 0) { return; }
+            uint cycles = Kernel::CPU.ReadTSC() - start;
+            StatAdd(&buckets[cycles == 0 ? 0 : 31 - __builtin_clz(cycles)], 1);
+        }
+
+        // bucket 0 holds requests up to 16 bytes, each bucket after doubles, the last takes everything bigger
+        uint MemoryManager::GetSizeBucket(uint size)
+        {
+            uint bucket = (size <= 16) ? 0 : (32 - __builtin_clz(size - 1)) - 4;
+            return (bucket >= MM_SIZE_BUCKETS) ? MM_SIZE_BUCKETS - 1 : bucket;
+        }
+
+        // upper bound in cycles under which the given percentage of samples fall
+        uint MemoryManager::GetLatencyPercentile(uint* buckets, uint percent)
+        {
+            uint total = 0;
+            for (uint i = 0; i < MM_LATENCY_BUCKETS; i++) { total += buckets[i]; }
+            if (total == 0) { return 0; }
+
+            uint target = ((total / 100) * percent) + (((total % 100) * percent + 99) / 100), seen = 0;
+            for (uint i = 0; i < MM_LATENCY_BUCKETS; i++)
+            {
+                seen += buckets[i];
+                if (seen >= target) { return (i >= 31) ? 0xFFFFFFFF : (2u << i) - 1; }
+            }
+            return 0xFFFFFFFF;
+        }
+
+        HeapStats* MemoryManager::GetStats() { return &Stats; }
+
+        void MemoryManager::RetypeSmall(SlabHeader* slab, void* ptr, AllocationType type)
+        {
+            byte* old = GetSlabType(slab, ptr);
+            uint size = SlabClasses[slab->Class].Size;
+            TrackType((AllocationType)*old, -1, -(int)size);
+            TrackType(type, 1, size);
+            *old = (byte)type;
+        }
+
+        void* MemoryManager::AllocateCached(HeapMagazine** magazines, uint size, bool clear, AllocationType type)
+        {
+            byte index = SlabLookup[(size + 15) >> 4];
+            SlabClass* cls = &SlabClasses[index];
+
+            // refill an empty magazine with one batch per trip to the slabs
+            HeapMagazine* mag = (*magazines != nullptr) ? &(*magazines)[index] : nullptr;
+            if (mag == nullptr || mag->Count == 0)
+            {
+                Lock();
+                if (*magazines == nullptr) { *magazines = (HeapMagazine*)AllocateSmall(sizeof(HeapMagazine) * MM_SLAB_CLASSES, true, AllocationType::System); }
+                if (*magazines != nullptr)
+                {
+                    mag = &(*magazines)[index];
+                    while (mag->Count < MM_MAGAZINE_BATCH)
+                    {
+                        void* obj = AllocateSmall(cls->Size, false, AllocationType::Slab);
+                        if (obj == nullptr) { break; }
+                        mag->Objects[mag->Count++] = (uint)obj;
+                    }
+                }
+                Unlock();
+                if (mag == nullptr || mag->Count == 0) { return nullptr; }
+            }
+
+            void* obj = (void*)mag->Objects[--mag->Count];
+            RetypeSmall(GetSlabFromPtr(obj), obj, type);
+            if (clear) { Memory::Set(obj, 0, cls->Size); }
+            return obj;
+        }
+
+        bool MemoryManager::FreeCached(HeapMagazine* magazines, void* ptr)
+        {
+            // anything odd is left to the slab path so it gets reported there
+            SlabHeader* slab = GetSlabFromPtr(ptr);
+            if (slab == nullptr) { return false; }
+            SlabClass* cls = &SlabClasses[slab->Class];
+            uint offset = (uint)ptr - (uint)slab;
+            if (offset < cls->ObjectOffset || (offset - cls->ObjectOffset) % cls->Size != 0) { return false; }
+
+            byte* type = GetSlabType(slab, ptr);
+            if (*type == (byte)AllocationType::Unused || *type == (byte)AllocationType::Slab) { Kernel::Debug.Warning("Double free at 0x%8x", (uint)ptr); return true; }
+
+            // drain a full magazine down to one batch
+            HeapMagazine* mag = &magazines[slab->Class];
+            if (mag->Count == MM_MAGAZINE_SIZE)
+            {
+                Lock();
+                while (mag->Count > MM_MAGAZINE_SIZE - MM_MAGAZINE_BATCH)
+                {
+                    void* obj = (void*)mag->Objects[--mag->Count];
+                    RetypeSmall(GetSlabFromPtr(obj), obj, AllocationType::Default);
+                    FreeSmall(obj);
+                }
+                Unlock();
+            }
+
+            // cached objects are marked so a second free is still caught
+            RetypeSmall(slab, ptr, AllocationType::Slab);
+            mag->Objects[mag->Count++] = (uint)ptr;
+            return true;
+        }
+
+        void MemoryManager::ReleaseMagazines(HeapMagazine* magazines)
+        {
+            if (magazines == nullptr) { return; }
+
+            Lock();
+            for (uint i = 0; i < MM_SLAB_CLASSES; i++)
+            {
+                HeapMagazine* mag = &magazines[i];
+                while (mag->Count > 0)
+                {
+                    void* obj = (void*)mag->Objects[--mag->Count];
+                    RetypeSmall(GetSlabFromPtr(obj), obj, AllocationType::Default);
+                    FreeSmall(obj);
+                }
+            }
+            FreeSmall(magazines);
+            Unlock();
+        }
 
-        void* MemoryManager::Allocate(uint size, bool clear, AllocationType type)
+        void* MemoryManager::Reallocate(void* ptr, uint size) { return Reallocate(ptr, size, __builtin_return_address(0)); }
+
+        void* MemoryManager::Reallocate(void* ptr, uint size, void* caller)
+        {
+            if (ptr == nullptr) { return Allocate(size, true, AllocationType::Default, caller); }
+            if (size == 0) { Free(ptr, caller); return nullptr; }
+            if (!IsAddressValid((uint)ptr) && !Kernel::FrameMgr.IsAllocation((uint)ptr)) { return nullptr; }
+
+            // traced as a free of the old block and an allocation that keeps its type
+            void* data = ReallocateRouted(ptr, size);
+            if (Tracing && data != nullptr)
+            {
+                TraceEvent(HeapTraceOp::Free, ptr, 0, AllocationType::Unused, caller);
+                TraceEvent(HeapTraceOp::Allocate, data, size, AllocationType::Unused, caller);
+            }
+            return data;
+        }
+
+        void* MemoryManager::ReallocateRouted(void* ptr, uint size)
+        {
+            // direct frames move to a fresh run, there is no heap entry to grow in place
+            if (!IsAddressValid((uint)ptr))
+            {
+                uint old_size = Kernel::FrameMgr.GetAllocationSize((uint)ptr);
+                Lock();
+                HeapDirectRun* run = GetDirectRun((uint)ptr);
+                AllocationType type = (run != nullptr) ? (AllocationType)run->Type : AllocationType::Default;
+                if (run != nullptr && Align(size) == old_size) { Stats.Waste += run->Size - size; run->Size = size; }
+                Unlock();
+                if (Align(size) == old_size) { return ptr; }
+
+                // a run shrunk below the direct minimum moves into the heap with the type it had
+                byte* data = (byte*)AllocateRouted(size, false, type);
+                if (data == nullptr) { return nullptr; }
+                Memory::Copy(data, ptr, old_size < size ? old_size : size);
+                if (size > old_size) { Memory::Set(data + old_size, 0, size - old_size); }
+                FreeRouted(ptr);
+                return data;
+            }
+
+            // arena objects are copied to a new slot in the same arena
+            ArenaChunk* chunk = GetArenaChunkFromPtr(ptr);
+            if (chunk != nullptr)
+            {
+                uint old_size = *(uint*)((uint)ptr - 8);
+                if (size <= old_size) { return ptr; }
+                byte* data = (byte*)ArenaAllocate((HeapArena*)chunk->Arena, size, false);
+                if (data == nullptr) { return nullptr; }
+                Memory::Copy(data, ptr, old_size);
+                Memory::Set(data + old_size, 0, size - old_size);
+                return data;
+            }
+
+            Lock();
+            void* data = (((uint)ptr & (MM_ALIGN - 1)) != 0) ? ReallocateSmall(ptr, size) : ReallocatePages(ptr, size);
+            Unlock();
+            return data;
+        }
+
+        void* MemoryManager::ReallocateSmall(void* ptr, uint size)
+        {
+            // slab objects keep their slot while the size still fits the class
+            SlabHeader* slab = GetSlabFromPtr(ptr);
+            if (slab == nullptr) { Kernel::Debug.Warning("Unable to reallocate memory at 0x%8x", (uint)ptr); return nullptr; }
+            SlabClass* cls = &SlabClasses[slab->Class];
+            if (size <= cls->Size) { return ptr; }
+
+            AllocationType type = (AllocationType)*GetSlabType(slab, ptr);
+            byte* data = (byte*)(size <= MM_SLAB_MAX ? AllocateSmall(size, false, type) : AllocatePages(size, false, type));
+            if (data == nullptr) { return nullptr; }
+            Memory::Copy(data, ptr, cls->Size);
+            Memory::Set(data + cls->Size, 0, size - cls->Size);
+            FreeSmall(ptr);
+            return data;
+        }
+
+        void* MemoryManager::ReallocatePages(void* ptr, uint size)
+        {
+            HeapEntry* entry = GetEntryFromPtr(ptr);
+            if (entry == nullptr || entry->Type == (byte)AllocationType::Unused) { Kernel::Debug.Warning("Unable to reallocate memory at 0x%8x", (uint)ptr); return nullptr; }
+
+            uint old_size = entry->Size;
+            uint old_length = entry->Length;
+            uint length = Align(size);
+
+            // shrink - give the tail back to the heap
+            if (length <= entry->Length)
+            {
+                if (length < entry->Length)
+                {
+                    HeapEntry* rest = CreateEntry(entry->Base + length, entry->Length - length, AllocationType::Unused);
+                    if (rest != nullptr)
+                    {
+                        Header.DataUsed -= rest->Length;
+                        TrackType((AllocationType)entry->Type, 0, -(int)rest->Length);
+                        entry->Length = length;
+                        SetTag(entry);
+                        Coalesce(rest);
+                    }
+                }
+                if (size > old_size) { Memory::Set((void*)(entry->Base + old_size), 0, size - old_size); }
+                Stats.Waste += (entry->Length - size) - (old_length - old_size);
+                entry->Size = size;
+                return ptr;
+            }
+
+            // grow in place into mass or a free block directly after this one
+            uint need = length - entry->Length;
+            HeapEntry* mass = GetEntry(0);
+            HeapEntry* next = GetNeighbour(entry);
+
+            if (next == mass && mass->Length >= need)
+            {
+                mass->Base += need;
+                mass->Length -= need;
+                if (Header.MassClean < mass->Base) { Header.MassClean = mass->Base; }
+                SetTag(mass);
+            }
+            else if (next != nullptr && next != mass && next->Type == (byte)AllocationType::Unused && next->Length >= need)
+            {
+                RemoveFree(next);
+                if (next->Length == need) { DeleteEntry(next); }
+                else
+                {
+                    next->Base += need;
+                    next->Length -= need;
+                    SetTag(next);
+                    InsertFree(next);
+                }
+            }
+            else
+            {
+                // no room - move
+                void* data = AllocatePages(size, false, (AllocationType)entry->Type);
+                if (data == nullptr) { return nullptr; }
+                Memory::Copy(data, ptr, old_size);
+                Memory::Set((void*)((uint)data + old_size), 0, size - old_size);
+                FreePages(ptr);
+                return data;
+            }
+
+            entry->Length += need;
+            SetTag(entry);
+            Memory::Set((void*)(entry->Base + old_size), 0, size - old_size);
+            Stats.Waste += (entry->Length - size) - (old_length - old_size);
+            entry->Size = size;
+            Header.DataUsed += need;
+            UpdatePeak();
+            TrackType((AllocationType)entry->Type, 0, need);
+            return ptr;
+        }
+
+        void MemoryManager::SetType(void* ptr, AllocationType type)
+        {
+            if (type == AllocationType::Unused) { return; }
+            if (!IsAddressValid((uint)ptr))
+            {
+                Lock();
+                HeapDirectRun* run = (ptr != nullptr) ? GetDirectRun((uint)ptr) : nullptr;
+                if (run != nullptr)
+                {
+                    TrackType((AllocationType)run->Type, -1, -(int)Align(run->Size));
+                    TrackType(type, 1, Align(run->Size));
+                    run->Type = (uint)type;
+                }
+                Unlock();
+                return;
+            }
+
+            if (((uint)ptr & (MM_ALIGN - 1)) != 0)
+            {
+                SlabHeader* slab = GetSlabFromPtr(ptr);
+                if (slab != nullptr) { RetypeSmall(slab, ptr, type); }
+                return;
+            }
+
+            HeapEntry* entry = GetEntryFromPtr(ptr);
+            if (entry == nullptr || entry->Type == (byte)AllocationType::Unused || entry->Type == (byte)AllocationType::Slab) { return; }
+            TrackType((AllocationType)entry->Type, -1, -(int)entry->Length);
+            TrackType(type, 1, entry->Length);
+            entry->Type = (byte)type;
+        }
+
+        void* MemoryManager::AllocatePages(uint size, bool clear, AllocationType type)
         {
             uint real_size = size;
-            if (size == 0) { return nullptr; }
             size = Align(size);
             
-            HeapEntry* entry = GetFreeEntry(size);
+            HeapEntry* entry = GetFreeEntry(size, clear);
             if (entry == nullptr) { Kernel::Debug.Panic((int)Exception::OutOfMemory); return nullptr; }
 
-            if (clear) { Memory::Set((void*)entry->Base, 0, entry->Length); }
+            if (clear && !entry->Clean) { Memory::Set((void*)entry->Base, 0, entry->Length); }
+            entry->Clean = false;
 
-            if (type == AllocationType::Unused) { type = AllocationType::Default; }
             entry->Type = (byte)type;
             entry->Size = real_size;
 
             Header.DataUsed += size;
+            UpdatePeak();
+            if (type != AllocationType::Slab) { TrackType(type, 1, entry->Length); }
+            Stats.Waste += entry->Length - real_size;
             GetEntry(0)->Size = GetEntry(0)->Length;
             if (!IsAddressValid(entry->Base)) { Kernel::Debug.Panic("Invalid pointer after allocation"); return nullptr; }
             if (MessagesEnabled) { PrintAllocation(entry); }
             return (void*)entry->Base;
         }
 
-        void MemoryManager::Free(void* ptr)
+        void MemoryManager::FreePages(void* ptr)
         {
-            if (!IsAddressValid((uint)ptr)) { return; }   
+            HeapEntry* entry = GetEntryFromPtr(ptr);
+            if (entry == nullptr) { Kernel::Debug.Warning("Unable to free memory at 0x%8x", (uint)ptr); return; }
+            if (entry->Type == (byte)AllocationType::Unused) { Kernel::Debug.Warning("Double free at 0x%8x", (uint)ptr); return; }
+            if (entry->Type == (byte)AllocationType::Arena) { Kernel::Debug.Warning("Free of arena chunk at 0x%8x", (uint)ptr); return; }
+            if (entry == GetEntry(0)) { Kernel::Debug.Panic("Heap corruption"); return; }
+            FreeEntry(entry);
+        }
+
+        void MemoryManager::FreeEntry(HeapEntry* entry)
+        {
+            if (MessagesEnabled) { PrintFree(entry); }
+            Header.DataUsed -= entry->Length;
+            if (entry->Type != (byte)AllocationType::Slab) { TrackType((AllocationType)entry->Type, -1, -(int)entry->Length); }
+            Stats.Waste -= entry->Length - entry->Size;
+            entry->Type = (byte)AllocationType::Unused;
+            entry->Clean = false;
+            entry->Size = 0;
+            Coalesce(entry);
+            GetEntry(0)->Size = GetEntry(0)->Length;
+        }
+
+        void MemoryManager::InitializeSlabs()
+        {
+            static const ushort sizes[MM_SLAB_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256, 336, 448, 672, 1008, 1344, 2016 };
+
+            for (uint i = 0; i < MM_SLAB_CLASSES; i++)
+            {
+                SlabClass* cls = &SlabClasses[i];
+                cls->Size    = sizes[i];
+                cls->Partial = 0;
+                cls->Slabs   = 0;
+
+                // one type byte per object sits between the header and the first object
+                uint cap = (MM_ALIGN - MM_SLAB_HEADER) / (cls->Size + 1);
+                uint offset = (MM_SLAB_HEADER + cap + 15) & 0xFFFFFFF0;
+                while (offset + (cap * cls->Size) > MM_ALIGN) { cap--; offset = (MM_SLAB_HEADER + cap + 15) & 0xFFFFFFF0; }
+                cls->Capacity     = cap;
+                cls->ObjectOffset = offset;
+            }
 
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            // size -> class lookup in 16 byte steps
+            uint cls = 0;
+            for (uint i = 0; i <= (MM_SLAB_MAX >> 4); i++)
             {
-                HeapEntry* temp = GetEntry(i);
+                while (SlabClasses[cls].Size < (i << 4)) { cls++; }
+                SlabLookup[i] = cls;
+            }
 
-                if (temp->Base == (uint)ptr)
-                {
-                    if (MessagesEnabled) { PrintFree(temp); }
-                    if (i == 0) { Kernel::Debug.Panic("Heap corruption"); return; }
-                    Header.DataUsed -= temp->Length;
-                    Memory::Set((void*)temp->Base, 0, temp->Length);
-                    temp->Type = (byte)AllocationType::Unused;
-                    MergeFreeEntries();
-                    GetEntry(0)->Size = GetEntry(0)->Length;
-                    return;
-                }
+            SlabsReady = true;
+        }
+
+        void* MemoryManager::AllocateSmall(uint size, bool clear, AllocationType type)
+        {
+            SlabClass* cls = &SlabClasses[SlabLookup[(size + 15) >> 4]];
+            SlabHeader* slab = (SlabHeader*)cls->Partial;
+            if (slab == nullptr) { slab = CreateSlab(SlabLookup[(size + 15) >> 4]); }
+            if (slab == nullptr) { return nullptr; }
+
+            uint obj = 0;
+            if (slab->FreeList != 0)
+            {
+                obj = slab->FreeList;
+                slab->FreeList = *(uint*)obj;
+                if (clear) { Memory::Set((void*)obj, 0, cls->Size); }
             }
+            // fresh objects come from a cleared page
+            else { obj = (uint)slab + cls->ObjectOffset + (slab->Bump++ * cls->Size); }
 
-            Kernel::Debug.Warning("Unable to free memory at 0x%8x", (uint)ptr);
+            slab->Used++;
+            if (slab->Used == cls->Capacity) { UnlinkSlab(cls, slab); }
+
+            *GetSlabType(slab, (void*)obj) = (byte)type;
+            TrackType(type, 1, cls->Size);
+            return (void*)obj;
+        }
+
+        void MemoryManager::FreeSmall(void* ptr)
+        {
+            SlabHeader* slab = GetSlabFromPtr(ptr);
+            if (slab == nullptr) { Kernel::Debug.Warning("Unable to free memory at 0x%8x", (uint)ptr); return; }
+
+            SlabClass* cls = &SlabClasses[slab->Class];
+            uint offset = (uint)ptr - (uint)slab;
+            if (offset < cls->ObjectOffset || (offset - cls->ObjectOffset) % cls->Size != 0) { Kernel::Debug.Warning("Misaligned free at 0x%8x", (uint)ptr); return; }
+
+            uint  index = (offset - cls->ObjectOffset) / cls->Size;
+            byte* type  = GetSlabType(slab, ptr);
+            if (index >= slab->Bump || *type == (byte)AllocationType::Unused || *type == (byte)AllocationType::Slab) { Kernel::Debug.Warning("Double free at 0x%8x", (uint)ptr); return; }
+
+            TrackType((AllocationType)*type, -1, -(int)cls->Size);
+            *type = (byte)AllocationType::Unused;
+            *(uint*)ptr = slab->FreeList;
+            slab->FreeList = (uint)ptr;
+
+            if (slab->Used == cls->Capacity) { LinkSlab(cls, slab); }
+            slab->Used--;
+
+            // release empty slabs, keeping the last one around for reuse
+            if (slab->Used == 0 && cls->Slabs > 1)
+            {
+                UnlinkSlab(cls, slab);
+                cls->Slabs--;
+                slab->Magic = 0;
+                FreePages(slab);
+            }
+        }
+
+        SlabHeader* MemoryManager::CreateSlab(byte cls)
+        {
+            SlabHeader* slab = (SlabHeader*)AllocatePages(MM_ALIGN, true, AllocationType::Slab);
+            if (slab == nullptr) { return nullptr; }
+
+            slab->Magic    = MM_SLAB_MAGIC;
+            slab->Next     = 0;
+            slab->Prev     = 0;
+            slab->FreeList = 0;
+            slab->Bump     = 0;
+            slab->Used     = 0;
+            slab->Class    = cls;
+            SlabClasses[cls].Slabs++;
+            LinkSlab(&SlabClasses[cls], slab);
+            return slab;
+        }
+
+        SlabHeader* MemoryManager::GetSlabFromPtr(void* ptr)
+        {
+            SlabHeader* slab = (SlabHeader*)((uint)ptr & ~(MM_ALIGN - 1));
+            if (!IsAddressValid((uint)slab)) { return nullptr; }
+            if (slab->Magic != MM_SLAB_MAGIC || slab->Class >= MM_SLAB_CLASSES) { return nullptr; }
+            return slab;
+        }
+
+        byte* MemoryManager::GetSlabType(SlabHeader* slab, void* ptr)
+        {
+            SlabClass* cls = &SlabClasses[slab->Class];
+            return &((byte*)slab)[MM_SLAB_HEADER + (((uint)ptr - (uint)slab - cls->ObjectOffset) / cls->Size)];
+        }
+
+        void MemoryManager::LinkSlab(SlabClass* cls, SlabHeader* slab)
+        {
+            slab->Prev = 0;
+            slab->Next = cls->Partial;
+            if (cls->Partial != 0) { ((SlabHeader*)cls->Partial)->Prev = (uint)slab; }
+            cls->Partial = (uint)slab;
+        }
+
+        void MemoryManager::UnlinkSlab(SlabClass* cls, SlabHeader* slab)
+        {
+            if (slab->Prev != 0) { ((SlabHeader*)slab->Prev)->Next = slab->Next; }
+            else { cls->Partial = slab->Next; }
+            if (slab->Next != 0) { ((SlabHeader*)slab->Next)->Prev = slab->Prev; }
+            slab->Next = 0;
+            slab->Prev = 0;
         }
 
         void MemoryManager::FreeArray(void** ptr, uint len)
@@ -258,55 +960,295 @@ namespace PMOS
             Free(ptr);
         }
 
-        void MemoryManager::MergeFreeEntries()
+        void MemoryManager::Coalesce(HeapEntry* entry)
         {
             HeapEntry* mass = GetEntry(0);
-            uint free_total = 0;
-            uint free_addr = 0xFFFFFFFF;
 
-            // loop through entries
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            // merge with the free block ending where this one starts
+            HeapEntry* prev = GetPrevNeighbour(entry);
+            if (prev != nullptr && prev != mass && prev->Type == (byte)AllocationType::Unused && prev->Clean == entry->Clean)
             {
-                // get entry
-                HeapEntry* entry = GetEntry(i);
-                
-                // validate entry
-                if (IsAddressValid(entry->Base) && entry->Type == (byte)AllocationType::Unused)
+                RemoveFree(prev);
+                prev->Length += entry->Length;
+                DeleteEntry(entry);
+                entry = prev;
+            }
+
+            // fold into mass if it directly follows
+            HeapEntry* next = GetNeighbour(entry);
+            if (next == mass)
+            {
+                // blocks of the other clean state left in front of mass are folded too
+                while (entry != nullptr)
                 {
-                    // get nearest
-                    HeapEntry* nearest = GetNeighbour(entry);
+                    // a dirty block in front of mass drops its clean prefix
+                    if (!entry->Clean) { Header.MassClean = entry->Base; }
+                    mass->Base = entry->Base;
+                    mass->Length += entry->Length;
+                    DeleteEntry(entry);
+                    SetTag(mass);
+
+                    entry = GetPrevNeighbour(mass);
+                    if (entry == nullptr || entry->Type != (byte)AllocationType::Unused) { break; }
+                    RemoveFree(entry);
+                }
+                return;
+            }
+
+            // merge with the free block starting where this one ends
+            if (next != nullptr && next->Type == (byte)AllocationType::Unused && next->Clean == entry->Clean)
+            {
+                RemoveFree(next);
+                entry->Length += next->Length;
+                DeleteEntry(next);
+            }
+
+            SetTag(entry);
+            InsertFree(entry);
+        }
+
+        HeapArena* MemoryManager::CreateArena(AllocationType type)
+        {
+            Lock();
+            HeapArena* arena = (HeapArena*)AllocateSmall(sizeof(HeapArena), true, AllocationType::System);
+            Unlock();
+            arena->Type = (byte)type;
+            return arena;
+        }
+
+        void* MemoryManager::ArenaAllocate(HeapArena* arena, uint size, bool clear)
+        {
+            if (arena == nullptr || size == 0) { return nullptr; }
+
+            // each object is 8 byte aligned and preceded by its size
+            uint need = ((size + 7) & 0xFFFFFFF8) + 8;
+            ArenaChunk* chunk = (ArenaChunk*)arena->Current;
 
-                    // validate nearest entry
-                    if (nearest != nullptr && nearest != entry && nearest != mass && entry != mass)
+            if (chunk == nullptr || chunk->Used + need > MM_ARENA_CHUNK)
+            {
+                // large objects get a chunk of their own, small ones start a new shared chunk
+                uint length = Align(MM_ARENA_HEADER + need);
+                Lock();
+                chunk = (ArenaChunk*)AllocatePages(length, false, AllocationType::Arena);
+                Unlock();
+                if (chunk == nullptr) { return nullptr; }
+                chunk->Magic = MM_ARENA_MAGIC;
+                chunk->Next  = arena->Chunks;
+                chunk->Arena = (uint)arena;
+                chunk->Used  = MM_ARENA_HEADER;
+                arena->Chunks = (uint)chunk;
+                if (length == MM_ARENA_CHUNK) { arena->Current = (uint)chunk; }
+            }
+
+            uint obj = (uint)chunk + chunk->Used + 8;
+            *(uint*)(obj - 8) = size;
+            chunk->Used += need;
+            if (clear) { Memory::Set((void*)obj, 0, size); }
+
+            arena->Size += size;
+            arena->Count++;
+            return (void*)obj;
+        }
+
+        void MemoryManager::ReleaseArena(HeapArena* arena)
+        {
+            if (arena == nullptr) { return; }
+
+            // report every object in the arena as freed so traces don't show them as leaks
+            if (Tracing)
+            {
+                for (uint chunk = arena->Chunks; chunk != 0; chunk = ((ArenaChunk*)chunk)->Next)
+                {
+                    uint offset = MM_ARENA_HEADER;
+                    while (offset < ((ArenaChunk*)chunk)->Used)
                     {
-                        if (entry->Base > nearest->Base) { entry->Base = nearest->Base; }
-                        entry->Length += nearest->Length;
-                        DeleteEntry(nearest);
+                        uint size = *(uint*)(chunk + offset);
+                        TraceEvent(HeapTraceOp::Free, (void*)(chunk + offset + 8), 0, AllocationType::Unused, __builtin_return_address(0));
+                        offset += ((size + 7) & 0xFFFFFFF8) + 8;
                     }
                 }
             }
 
-            // attempt to free mass neighbour
-            HeapEntry* nearest = GetNeighbour(mass);
+            Lock();
+            uint chunk = arena->Chunks;
+            while (chunk != 0)
+            {
+                uint next = ((ArenaChunk*)chunk)->Next;
+                ((ArenaChunk*)chunk)->Magic = 0;
+                FreeEntry(GetEntryFromPtr((void*)chunk));
+                chunk = next;
+            }
+
+            FreeSmall(arena);
+            Unlock();
+        }
 
-            // loop through entries
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+        HeapArena* MemoryManager::PushArena(HeapArena* arena)
+        {
+            Threading::Thread* thread = Kernel::ThreadMgr.GetCurrentThread();
+            if (thread == nullptr) { return nullptr; }
+            HeapArena* previous = thread->Arena;
+            thread->Arena = arena;
+            return previous;
+        }
+
+        void MemoryManager::PopArena(HeapArena* previous)
+        {
+            Threading::Thread* thread = Kernel::ThreadMgr.GetCurrentThread();
+            if (thread != nullptr) { thread->Arena = previous; }
+        }
+
+        ArenaChunk* MemoryManager::GetArenaChunkFromPtr(void* ptr)
+        {
+            ArenaChunk* chunk = (ArenaChunk*)((uint)ptr & ~(MM_ALIGN - 1));
+            if (!IsAddressValid((uint)chunk)) { return nullptr; }
+            if (chunk->Magic != MM_ARENA_MAGIC) { return nullptr; }
+            return chunk;
+        }
+
+        // background thread that clears free memory ahead of clear allocations
+        void HeapZeroMain(Threading::Thread* thread)
+        {
+            while (true)
             {
-                // get entry
-                HeapEntry* entry = GetEntry(i);
+                // each step takes the heap lock for one chunk only
+                bool work = Kernel::MemoryMgr.ZeroStep();
+                if (!work) { thread->Sleep(100); }
+            }
+        }
+
+        void MemoryManager::StartZeroThread()
+        {
+            Threading::Thread* thread = Kernel::ThreadMgr.Create("heapzero", 8192, ThreadPriority::Low, HeapZeroMain);
+            thread->Start();
+        }
 
-                if (entry->Base != mass->Base)
+        // background thread that sends queued trace records out over serial
+        void HeapTraceMain(Threading::Thread* thread)
+        {
+            while (true)
+            {
+                if (!Kernel::MemoryMgr.FlushTrace()) { thread->Sleep(50); }
+            }
+        }
+
+        void MemoryManager::StartTrace()
+        {
+            // the ring itself is allocated before tracing starts so it never shows up in the stream
+            if (Trace == nullptr)
+            {
+                Lock();
+                Trace = (HeapTraceRecord*)AllocatePages(sizeof(HeapTraceRecord) * MM_TRACE_RECORDS, true, AllocationType::System);
+                Unlock();
+                if (Trace == nullptr) { return; }
+
+                Threading::Thread* thread = Kernel::ThreadMgr.Create("heaptrace", 8192, ThreadPriority::Low, HeapTraceMain);
+                thread->Start();
+            }
+            Tracing = true;
+        }
+
+        // stop recording, whatever is still queued keeps draining
+        void MemoryManager::StopTrace() { Tracing = false; }
+
+        bool MemoryManager::IsTracing() { return Tracing; }
+
+        void MemoryManager::TraceEvent(HeapTraceOp op, void* ptr, uint size, AllocationType type, void* caller)
+        {
+            Lock();
+            if (TraceHead - TraceTail >= MM_TRACE_RECORDS) { TraceDropped++; }
+            else
+            {
+                HeapTraceRecord* rec = &Trace[TraceHead % MM_TRACE_RECORDS];
+                rec->Time     = (uint)Kernel::Clock.GetMilliseconds();
+                rec->Pointer  = (uint)ptr;
+                rec->Size     = size;
+                rec->Caller   = (uint)caller;
+                rec->Op       = (byte)op;
+                rec->Type     = (byte)type;
+                rec->Reserved = 0;
+                TraceHead++;
+            }
+            Unlock();
+        }
+
+        // send one frame of queued records, returns false when there was nothing to send
+        bool MemoryManager::FlushTrace()
+        {
+            if (Trace == nullptr) { return false; }
+
+            Lock();
+            uint tail  = TraceTail;
+            uint count = TraceHead - TraceTail;
+            if (count > MM_TRACE_BATCH) { count = MM_TRACE_BATCH; }
+            uint dropped = (TraceDropped > 0xFFFF) ? 0xFFFF : TraceDropped;
+            TraceDropped -= dropped;
+            Unlock();
+            if (count == 0 && dropped == 0) { return false; }
+
+            // the serial port is slow, so records are written outside the lock - the ring only reuses them once the tail moves
+            HeapTraceFrame frame = { MM_TRACE_MAGIC, (ushort)count, (ushort)dropped };
+            Kernel::Serial.WriteBytes((byte*)&frame, sizeof(HeapTraceFrame));
+
+            uint sum = 0;
+            for (uint i = 0; i < count; i++)
+            {
+                HeapTraceRecord* rec = &Trace[(tail + i) % MM_TRACE_RECORDS];
+                for (uint j = 0; j < sizeof(HeapTraceRecord) / 4; j++) { sum += ((uint*)rec)[j]; }
+                Kernel::Serial.WriteBytes((byte*)rec, sizeof(HeapTraceRecord));
+            }
+            Kernel::Serial.WriteBytes((byte*)&sum, 4);
+
+            Lock();
+            TraceTail += count;
+            Unlock();
+            return true;
+        }
+
+        bool MemoryManager::ZeroStep()
+        {
+            Lock();
+            bool work = ZeroChunk();
+            Unlock();
+            return work;
+        }
+
+        bool MemoryManager::ZeroChunk()
+        {
+            // clean one chunk of a dirty free block
+            for (uint b = 0; b < MM_BUCKETS; b++)
+            {
+                if (FreeBuckets[0][b] == 0) { continue; }
+                HeapEntry* entry = GetEntry(FreeBuckets[0][b] - 1);
+                RemoveFree(entry);
+
+                // split so the dirty remainder stays free while this chunk is cleared
+                if (entry->Length > MM_ZERO_STEP)
                 {
-                    if (entry->Base + entry->Length == mass->Base && entry->Type == (byte)AllocationType::Unused)
-                    {
-                        mass->Base = entry->Base;
-                        mass->Length += entry->Length;
-                        mass->Type = (byte)AllocationType::Unused;
-                        DeleteEntry(entry);
-                        break;
-                    }
+                    HeapEntry* rest = CreateEntry(entry->Base + MM_ZERO_STEP, entry->Length - MM_ZERO_STEP, AllocationType::Unused);
+                    if (rest == nullptr) { InsertFree(entry); return false; }
+                    entry->Length = MM_ZERO_STEP;
+                    SetTag(entry);
+                    InsertFree(rest);
                 }
+
+                Memory::Set((void*)entry->Base, 0, entry->Length);
+                entry->Clean = true;
+                Coalesce(entry);
+                return true;
             }
+
+            // then extend the clean prefix of mass
+            HeapEntry* mass = GetEntry(0);
+            uint end = mass->Base + mass->Length;
+            if (mass->Base + MM_ZERO_WINDOW < end) { end = mass->Base + MM_ZERO_WINDOW; }
+            if (Header.MassClean >= end) { return false; }
+
+            uint len = end - Header.MassClean;
+            if (len > MM_ZERO_STEP) { len = MM_ZERO_STEP; }
+            Memory::Set((void*)Header.MassClean, 0, len);
+            Header.MassClean += len;
+            return true;
         }
 
         HeapEntry* MemoryManager::GetEntry(int index)
@@ -315,70 +1257,131 @@ namespace PMOS
             return (HeapEntry*)(Header.TableStart + (index * sizeof(HeapEntry)));
         }
 
-        HeapEntry* MemoryManager::GetFreeEntry(uint size)
+        int MemoryManager::GetEntryIndex(HeapEntry* entry)
+        {
+            if (entry == nullptr) { return -1; }
+            return ((uint)entry - Header.TableStart) / sizeof(HeapEntry);
+        }
+
+        HeapEntry* MemoryManager::GetFreeEntry(uint size, bool clear)
         {
             if (size == 0) { return nullptr; }
 
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            // first fit in the matching bucket, any block in the buckets above - clean blocks are preferred for clear requests
+            HeapEntry* entry = nullptr;
+            for (uint b = GetBucket(size); b < MM_BUCKETS && entry == nullptr; b++)
             {
-                HeapEntry* entry = GetEntry(i);
+                for (uint pass = 0; pass < 2 && entry == nullptr; pass++)
+                {
+                    uint index = FreeBuckets[clear ? 1 - pass : pass][b];
+                    while (index != 0)
+                    {
+                        HeapEntry* temp = GetEntry(index - 1);
+                        if (temp->Length >= size) { entry = temp; break; }
+                        index = temp->Next;
+                    }
+                }
+            }
 
-                if (IsAddressValid(entry->Base) && size == entry->Length && entry->Type == (byte)AllocationType::Unused)
+            if (entry != nullptr)
+            {
+                RemoveFree(entry);
+                if (entry->Length > size)
                 {
-                    entry->Type = (byte)AllocationType::Default;
-                    return entry;
+                    HeapEntry* rest = CreateEntry(entry->Base + size, entry->Length - size, AllocationType::Unused);
+                    if (rest == nullptr) { InsertFree(entry); return nullptr; }
+                    rest->Clean = entry->Clean;
+                    entry->Length = size;
+                    SetTag(entry);
+                    InsertFree(rest);
                 }
+                entry->Type = (byte)AllocationType::Default;
+                return entry;
             }
 
             HeapEntry* mass = GetEntry(0);
-            uint addr = mass->Base;
+            if (mass->Length < size && !Grow(size - mass->Length)) { return nullptr; }
 
-            HeapEntry* entry = CreateEntry({ addr, size, (byte)AllocationType::Default });
+            entry = CreateEntry(mass->Base, size, AllocationType::Default);
+            if (entry == nullptr) { return nullptr; }
+            entry->Clean = (Header.MassClean >= mass->Base + size);
             mass->Base += size;
             mass->Length -= size;
             mass->Type = (byte)AllocationType::Unused;
+            if (Header.MassClean < mass->Base) { Header.MassClean = mass->Base; }
+            SetTag(mass);
             return entry;
         }
 
+        // extend the heap into the frames right after it, the mass always ends the heap so it takes the new space
+        bool MemoryManager::Grow(uint size)
+        {
+            uint length = Align(size);
+            if (length < MM_HEAP_GROW) { length = MM_HEAP_GROW; }
+            if (Header.DataEnd + length > Header.DataLimit || Header.DataEnd + length < Header.DataEnd) { length = Header.DataLimit - Header.DataEnd; }
+            if (length < size) { return false; }
+            if (!Kernel::FrameMgr.ClaimFrames(Header.DataEnd, length / MM_ALIGN)) { return false; }
+
+            HeapEntry* mass = GetEntry(0);
+            Header.DataEnd += length;
+            Header.DataLength += length;
+            mass->Length += length;
+            mass->Size = mass->Length;
+            SetTag(mass);
+            return true;
+        }
+
         int MemoryManager::GetFreeIndex()
         {
-            for (int i = 0; i < Header.TableMaxEntries; i++)
+            // reuse a released slot before growing the used part of the table
+            if (Header.TableFreeSlot != 0)
             {
-                HeapEntry* entry = GetEntry(i);
-                if (entry == nullptr) { continue; }
-                if (entry->Base == 0) { return i; }
+                int index = Header.TableFreeSlot - 1;
+                Header.TableFreeSlot = GetEntry(index)->Next;
+                return index;
             }
-            return -1;
+
+            if (Header.TablePosition >= Header.TableMaxEntries) { return -1; }
+            return Header.TablePosition++;
         }
 
         HeapEntry* MemoryManager::GetNeighbour(HeapEntry* entry)
         {
             if (entry == nullptr) { return nullptr; }
             if (!IsAddressValid(entry->Base)) { return nullptr; }
-            
-            for (uint i = 1; i < Header.TableMaxEntries; i++)
-            {
-                HeapEntry* temp = GetEntry(i);
+            return GetEntryFromPtr((void*)(entry->Base + entry->Length));
+        }
 
-                if (temp != nullptr && temp != entry && temp->Base + temp->Length == entry->Base && temp->Type == (byte)AllocationType::Unused) { return temp; }
-                if (temp != nullptr && temp != entry && entry->Base - entry->Length == temp->Base && temp->Type == (byte)AllocationType::Unused) { return temp; }
-            }
-            return nullptr;
+        HeapEntry* MemoryManager::GetPrevNeighbour(HeapEntry* entry)
+        {
+            if (entry == nullptr) { return nullptr; }
+            if (!IsAddressValid(entry->Base) || entry->Base == Header.DataStart) { return nullptr; }
+
+            // end tags share the page map with start tags, so check the geometry
+            uint index = ((uint*)Header.PageMapStart)[(entry->Base - Header.DataStart) / MM_ALIGN - 1];
+            if (index == 0 || index > Header.TablePosition) { return nullptr; }
+            HeapEntry* prev = GetEntry(index - 1);
+            if (prev->Base == 0 || prev->Base + prev->Length != entry->Base) { return nullptr; }
+            return prev;
         }
 
-        HeapEntry* MemoryManager::CreateEntry(HeapEntry entry)
+        HeapEntry* MemoryManager::CreateEntry(uint base, uint length, AllocationType type)
         {
-            if (!IsAddressValid(entry.Base)) { return nullptr; }   
-            if (entry.Length == 0) { return nullptr; }
+            if (!IsAddressValid(base)) { return nullptr; }   
+            if (length == 0) { return nullptr; }
 
             HeapEntry* new_entry = GetEntry(GetFreeIndex());
             if (new_entry == nullptr) { Kernel::Debug.Panic((int)Exception::OutOfMemory); return nullptr; }
 
-            new_entry->Base = entry.Base;
-            new_entry->Length = entry.Length;
-            new_entry->Type = entry.Type;
+            new_entry->Base   = base;
+            new_entry->Length = length;
+            new_entry->Size   = 0;
+            new_entry->Next   = 0;
+            new_entry->Prev   = 0;
+            new_entry->Type   = (byte)type;
+            new_entry->Clean  = false;
+            SetTag(new_entry);
 
-            Header.TablePosition++;
             Header.TableEntries++;
             return new_entry;
         }
@@ -388,22 +1391,61 @@ namespace PMOS
             if (entry == nullptr) { return false; }
             if (entry->Base == 0) { return false; }
 
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
-            {
-                HeapEntry* temp = GetEntry(i);
-                if (temp->Base == entry->Base && temp->Length == entry->Length && temp->Type == entry->Type)
-                {
-                    temp->Base   = 0;
-                    temp->Length = 0;
-                    temp->Type   = 0;
-                    Header.TableEntries--;
-                    Header.TablePosition--;
-                    return true;
-                }
-            }
+            entry->Base   = 0;
+            entry->Length = 0;
+            entry->Size   = 0;
+            entry->Prev   = 0;
+            entry->Type   = 0;
+            entry->Clean  = false;
+            entry->Next   = Header.TableFreeSlot;
+            Header.TableFreeSlot = GetEntryIndex(entry) + 1;
+            Header.TableEntries--;
+            return true;
+        }
+
+        uint MemoryManager::GetBucket(uint length)
+        {
+            uint pages = length / MM_ALIGN;
+            uint bucket = 0;
+            while (pages > 1 && bucket < MM_BUCKETS - 1) { pages >>= 1; bucket++; }
+            return bucket;
+        }
+
+        void MemoryManager::InsertFree(HeapEntry* entry)
+        {
+            uint  index = GetEntryIndex(entry) + 1;
+            uint* head  = &FreeBuckets[entry->Clean ? 1 : 0][GetBucket(entry->Length)];
+            entry->Prev = 0;
+            entry->Next = *head;
+            if (*head != 0) { GetEntry(*head - 1)->Prev = index; }
+            *head = index;
+        }
+
+        void MemoryManager::RemoveFree(HeapEntry* entry)
+        {
+            uint* head = &FreeBuckets[entry->Clean ? 1 : 0][GetBucket(entry->Length)];
+            if (entry->Prev != 0) { GetEntry(entry->Prev - 1)->Next = entry->Next; }
+            else { *head = entry->Next; }
+            if (entry->Next != 0) { GetEntry(entry->Next - 1)->Prev = entry->Prev; }
+            entry->Next = 0;
+            entry->Prev = 0;
+        }
+
+        void MemoryManager::SetTag(HeapEntry* entry)
+        {
+            if (!IsAddressValid(entry->Base) || entry->Length == 0) { return; }
+
+            // boundary tags on the first and last page of the block
+            uint* map = (uint*)Header.PageMapStart;
+            uint  page = (entry->Base - Header.DataStart) / MM_ALIGN;
+            map[page] = GetEntryIndex(entry) + 1;
+            map[page + (entry->Length / MM_ALIGN) - 1] = GetEntryIndex(entry) + 1;
+        }
 
-            Kernel::Debug.Warning("Unable to delete heap entry { BASE:0x%8x LEN:0x%8x TYPE:0x%2x", entry->Base, entry->Length, entry->Type);
-            return false;
+        bool MemoryManager::IsDirect(AllocationType type, uint size)
+        {
+            if (size < MM_DIRECT_MIN) { return false; }
+            return type == AllocationType::ThreadStack || type == AllocationType::FrameBuffer || type == AllocationType::VMRAM;
         }
 
         bool MemoryManager::IsAddressValid(uint addr)
@@ -415,23 +1457,28 @@ namespace PMOS
         HeapEntry* MemoryManager::GetEntryFromPtr(void* ptr)
         {
             if (ptr == nullptr) { return nullptr;}
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
-            {
-                HeapEntry* entry = GetEntry(i);
-                if (entry->Base == (uint)ptr) { return entry; }
-            }
-            return nullptr;
+            if (!IsAddressValid((uint)ptr) || ((uint)ptr & (MM_ALIGN - 1)) != 0) { return nullptr; }
+
+            // page map slots can be stale, so the entry must still start here
+            uint index = ((uint*)Header.PageMapStart)[((uint)ptr - Header.DataStart) / MM_ALIGN];
+            if (index == 0 || index > Header.TablePosition) { return nullptr; }
+            HeapEntry* entry = GetEntry(index - 1);
+            if (entry->Base != (uint)ptr) { return nullptr; }
+            return entry;
         }
 
         uint MemoryManager::GetSizeFromPtr(void* ptr)
         {
             if (ptr == nullptr) { return 0;}
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            if (((uint)ptr & (MM_ALIGN - 1)) != 0)
             {
-                HeapEntry* entry = GetEntry(i);
-                if (entry->Base == (uint)ptr) { return entry->Length; }
+                if (GetArenaChunkFromPtr(ptr) != nullptr) { return *(uint*)((uint)ptr - 8); }
+                SlabHeader* slab = GetSlabFromPtr(ptr);
+                return slab == nullptr ? 0 : SlabClasses[slab->Class].Size;
             }
-            return 0;
+
+            HeapEntry* entry = GetEntryFromPtr(ptr);
+            return entry == nullptr ? 0 : entry->Length;
         }
         
         uint MemoryManager::GetHeapCount() { return Header.TableEntries; }
@@ -439,7 +1486,7 @@ namespace PMOS
         uint MemoryManager::GetUsedHeapCount() 
         { 
             Header.TableEntriesUsed = 0;
-            for (uint i = 0; i < Header.TableMaxEntries; i++)
+            for (uint i = 0; i < Header.TablePosition; i++)
             {
                 HeapEntry* entry = GetEntry(i);
                 if (IsAddressValid(entry->Base) && entry->Type != (byte)AllocationType::Unused) { Header.TableEntriesUsed++; }
@@ -447,59 +1494,13 @@ namespace PMOS
             return Header.TableEntriesUsed;
         }
 
-        uint MemoryManager::GetRAMInstalled()
-        {
-            register ulong* mem;
-            ulong mem_count, a;
-            uint memkb;
-            byte	irq1, irq2;
-
-            irq1 = HAL::Ports::Read8(0x21);
-            irq2 = HAL::Ports::Read8(0xA1);
-
-            HAL::Ports::Write8(0x21, 0xFF);
-            HAL::Ports::Write8(0xA1, 0xFF);
-
-            mem_count = 0;
-            memkb = 0;
-            __asm__ __volatile__("wbinvd");
-
-            do 
-            {
-                memkb++;
-                mem_count += 1024 * 1024;
-                mem = (ulong*)mem_count;
-
-                a = *mem;
-                *mem = 0x55AA55AA;
-
-                asm("":::"memory");
-                if (*mem != 0x55AA55AA) { mem_count = 0; }
-                else 
-                {
-                    *mem = 0xAA55AA55;
-                    asm("":::"memory");
-                    if (*mem != 0xAA55AA55)
-                        mem_count = 0;
-                }
-
-                asm("":::"memory");
-                *mem = a;
-
-            } while (memkb < 4096 && mem_count != 0);
-
-            mem = (ulong*)0x413;
-
-            HAL::Ports::Write8(0x21, irq1);
-            HAL::Ports::Write8(0xA1, irq2);
-
-            return memkb * 1024 * 1024;
-        }
+        // from the multiboot memory map, probing by writing to every megabyte is not safe with devices mapped and other processors running
+        uint MemoryManager::GetRAMInstalled() { return Kernel::FrameMgr.GetInstalledBytes(); }
 
-        uint MemoryManager::GetRAMReserved() { return Header.DataLength; }
+        uint MemoryManager::GetRAMReserved() { return Kernel::FrameMgr.GetTotalBytes(); }
         
-        uint MemoryManager::GetRAMFree() { return Header.DataLength - Header.DataUsed; }
+        uint MemoryManager::GetRAMFree() { return GetRAMReserved() - GetRAMUsed(); }
         
-        uint MemoryManager::GetRAMUsed() { return Header.DataUsed; }
+        uint MemoryManager::GetRAMUsed() { return Kernel::FrameMgr.GetUsedBytes(); }
     }
 }
\ No newline at end of file
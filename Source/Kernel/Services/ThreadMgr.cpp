@@ -5,8 +5,8 @@ namespace PMOS
 {
     namespace Threading
     {
-        // init flag
-        bool  ThreadSwitchInit = false;
+        // time slice of each priority in milliseconds, every ready thread runs once per round
+        const uint TimeSlices[THREAD_PRIORITIES] = { 2, 4, 8, 16 };
 
         ThreadManager::ThreadManager() : Service("threadmgr", PMOS::ServiceType::KernelComponent)
         {
@@ -25,13 +25,36 @@ namespace PMOS
             Threads = (Thread**)MemAlloc(MaxCount * sizeof(Thread*), true, AllocationType::System);
 
             // reset other properties
-            CurrentThread = nullptr;
-            CurrentIndex  = 0;
-            Count         = 0;
-
+            Count     = 0;
             Unloading = nullptr;
+            TableLock.Initialize("threads");
+
+            // every processor schedules from its own ready queues
+            Memory::Set(RunQueues, 0, sizeof(RunQueues));
+            for (uint i = 0; i < SMP_MAX_CPUS; i++) { RunQueues[i].Lock.Initialize("runqueue"); }
+
+            // recycled threads, filled to the low mark by the idle thread
+            Memory::Set(&Pool, 0, sizeof(ThreadPool));
+            Pool.Lock.Initialize("threadpool");
+            Pool.LowWater  = THREAD_POOL_LOW;
+            Pool.HighWater = THREAD_POOL_HIGH;
+
+            // fpu and sse state is switched lazily, the first touch after a switch traps with #NM
+            Kernel::InterruptMgr.Register(7, SwitchFPU);
 
-            CPUUsage = 100.0f;
+            // threads that block or give up their slice switch away through a software interrupt
+            Kernel::InterruptMgr.Register(IRQ_YIELD, YieldCallback);
+
+            // idle processors sleep without a tick, they are told to reschedule with an ipi when work arrives
+            Kernel::InterruptMgr.Register(IRQ_SCHEDULE, ScheduleCallback);
+
+            CPUUsage    = 100.0f;
+            IdleTicks   = 0;
+            LastTick    = 0;
+            SampleTicks = 0;
+            SampleIdle  = 0;
+            SampleStamp = Kernel::CPU.ReadCycles();
+            HAL::SMPManager::GetCurrent()->SwitchStamp = SampleStamp;
 
             // message
             Kernel::Debug.OK("Initialized thread manager");
@@ -48,16 +71,18 @@ namespace PMOS
             if (t == nullptr) { return; }
 
             // get next free index
+            TableLock.Acquire();
             uint i = GetFreeIndex();
 
             // validate next free index
-            if (i >= MaxCount) { Kernel::Debug.Error("Maximum amount of running threads has been reached"); return; }
+            if (i >= MaxCount) { TableLock.Release(); Kernel::Debug.Error("Maximum amount of running threads has been reached"); return; }
 
             // add thread to list
             Threads[i] = t;
             
             // increment thread count
             Count++;
+            TableLock.Release();
 
             Kernel::Debug.Info("Loaded thread %s", t->GetName());
         }
@@ -68,70 +93,242 @@ namespace PMOS
             // validate thread
             if (t == nullptr) { return; }
 
-            Unloading = t;
+            // take it off the ready and reap queues
+            RunQueue* rq = LockQueue(t);
+            if (t->Queued) { Dequeue(rq, t); }
+            if (t->Period > 0) { rq->DeadlineLoad -= t->Load; t->Period = 0; }
+            if (t->Reaping)
+            {
+                Thread** link = &rq->Reaping;
+                while (*link != nullptr && *link != t) { link = &(*link)->ReapNext; }
+                if (*link == t) { *link = t->ReapNext; }
+                t->Reaping = false;
+            }
+            HAL::Processor* cpu = HAL::SMPManager::GetCurrent();
+            bool self = cpu->CurrentThread == t;
+            if (self) { cpu->CurrentThread = nullptr; }
+            rq->Lock.Release();
 
             // loop through threads
+            TableLock.Acquire();
+            Unloading = t;
+            bool found = false;
             for (uint i = 0; i < MaxCount; i++)
             {
-                // thread match
+                // thread match - clear value in list and decrement count
                 if (Threads[i] != nullptr && Threads[i] == t)
                 {
-                    // stop execution thread if it is active
-                    if (CurrentIndex == (int)i)  { CurrentIndex = -1; CurrentThread = nullptr; }
-                    if (CurrentThread == t) { CurrentIndex = -1; CurrentThread = nullptr; }
-                    
-                    // dispose thread
-                    Threads[i]->Dispose();
-
-                    // decrement count
-                    Count--;
-
-                    // clear value in list and return
                     Threads[i] = nullptr;
-                    Unloading = nullptr;
-                    return;
+                    Count--;
+                    found = true;
+                    break;
                 }
             }
+            TableLock.Release();
+
+            // dispose thread, nobody can look it up any more - one still running on its own stack cannot be handed out again yet
+            if (found && (self || !Recycle(t))) { t->Dispose(); }
+            Unloading = nullptr;
         }
 
-        // create new thread
+        // create new thread, from the pool when one is cached
         Thread* ThreadManager::Create(char* name, ThreadPriority priority, void protocol(Thread*))
         {
-            Thread* t = new Thread(name, priority, protocol);
-            HeapEntry* e = Kernel::MemoryMgr.GetEntryFromPtr(t);
-            if (e != nullptr) { e->Type = (byte)AllocationType::Thread; }
+            Thread* t = TakePooled(name, STACK_SIZE, priority, protocol);
+            if (t != nullptr) { return t; }
+
+            // never part of an arena the caller has pushed, the thread may well outlive it
+            HeapArena* previous = Kernel::MemoryMgr.PushArena(nullptr);
+            t = new Thread(name, priority, protocol);
+            Kernel::MemoryMgr.SetType(t, AllocationType::Thread);
+            Kernel::MemoryMgr.PopArena(previous);
             return t;
         }
 
         // create new thread with specified stack size
         Thread* ThreadManager::Create(char* name, uint stack, ThreadPriority priority, void protocol(Thread*))
         {
-            Thread* t = new Thread(name, stack, priority, protocol);
-            HeapEntry* e = Kernel::MemoryMgr.GetEntryFromPtr(t);
-            if (e != nullptr) { e->Type = (byte)AllocationType::Thread; }
+            Thread* t = TakePooled(name, stack, priority, protocol);
+            if (t != nullptr) { return t; }
+
+            HeapArena* previous = Kernel::MemoryMgr.PushArena(nullptr);
+            t = new Thread(name, stack, priority, protocol);
+            Kernel::MemoryMgr.SetType(t, AllocationType::Thread);
+            Kernel::MemoryMgr.PopArena(previous);
+            return t;
+        }
+
+        // only default size stacks are pooled, so any cached thread fits
+        Thread* ThreadManager::TakePooled(char* name, uint stack, ThreadPriority priority, void protocol(Thread*))
+        {
+            if (stack != STACK_SIZE) { return nullptr; }
+
+            Pool.Lock.Acquire();
+            Thread* t = Pool.Head;
+            if (t != nullptr) { Pool.Head = t->QueueNext; Pool.Count--; Pool.Reused++; }
+            else { Pool.Allocated++; }
+            Pool.Lock.Release();
+            if (t == nullptr) { return nullptr; }
+
+            t->Reset(name, priority, protocol);
             return t;
         }
 
+        // keep an unloaded thread with its stack instead of freeing it, false if the pool has no room for it
+        bool ThreadManager::Recycle(Thread* t)
+        {
+            if (t->StackSize != STACK_SIZE || t->FPUState == nullptr) { return false; }
+
+            Pool.Lock.Acquire();
+            bool room = Pool.Count < Pool.HighWater;
+            Pool.Lock.Release();
+            if (!room) { return false; }
+
+            // the timer, heap magazines and fpu are let go of now, not when the thread is reused
+            t->Detach();
+            t->Properties.State = ThreadState::Completed;
+
+            Pool.Lock.Acquire();
+            t->QueueNext = Pool.Head;
+            Pool.Head = t;
+            Pool.Count++;
+            Pool.Lock.Release();
+            return true;
+        }
+
+        // cache threads up to the low mark, called from the idle thread so a spawn never waits for the allocation
+        void ThreadManager::FillPool()
+        {
+            while (Pool.Count < Pool.LowWater)
+            {
+                Thread* t = new Thread("pooled", STACK_SIZE, ThreadPriority::Low, nullptr);
+                Kernel::MemoryMgr.SetType(t, AllocationType::Thread);
+                t->Properties.State = ThreadState::Completed;
+
+                Pool.Lock.Acquire();
+                t->QueueNext = Pool.Head;
+                Pool.Head = t;
+                Pool.Count++;
+                Pool.Lock.Release();
+            }
+        }
+
+        // the high mark is never below the low one, cached threads over the new high mark are freed right away
+        void ThreadManager::SetPoolLimits(uint low, uint high)
+        {
+            if (high < low) { high = low; }
+
+            Pool.Lock.Acquire();
+            Pool.LowWater  = low;
+            Pool.HighWater = high;
+            Thread* list = nullptr;
+            while (Pool.Count > Pool.HighWater)
+            {
+                Thread* t = Pool.Head;
+                Pool.Head = t->QueueNext;
+                Pool.Count--;
+                t->QueueNext = list;
+                list = t;
+            }
+            Pool.Lock.Release();
+
+            while (list != nullptr)
+            {
+                Thread* t = list;
+                list = t->QueueNext;
+                t->Dispose();
+            }
+        }
+
+        void ThreadManager::PrintPool(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteLine("POOLED        %d threads(low = %d, high = %d)", Pool.Count, Pool.LowWater, Pool.HighWater);
+            Kernel::Debug.WriteLine("REUSED        %d", Pool.Reused);
+            Kernel::Debug.WriteLine("ALLOCATED     %d", Pool.Allocated);
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // threads in the deadline class and the bandwidth each processor has handed out
+        void ThreadManager::PrintDeadlines(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("DEADLINES", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" ---------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("PERIOD    BUDGET    LEFT      MISSED      CORE   NAME\n", Col4::DarkGray);
+
+            uint freq = Kernel::APICTimer.GetFrequency();
+            TableLock.Acquire();
+            for (uint i = 0; i < MaxCount; i++)
+            {
+                Thread* t = Threads[i];
+                if (t == nullptr || t->Period == 0) { continue; }
+                Kernel::Debug.Write("%d ms     ", t->Period);
+                Kernel::Debug.Write("%d ms     ", (t->Budget * 1000) / freq);
+                Kernel::Debug.Write("%d ms     ", (t->Remaining * 1000) / freq);
+                Kernel::Debug.Write("0x%8x  ", t->Misses);
+                Kernel::Debug.Write("%d      ", t->CPU);
+                Kernel::Debug.WriteLine("%s", t->GetName());
+            }
+            TableLock.Release();
+
+            Kernel::Debug.NewLine();
+            for (uint i = 0; i < Kernel::SMP.GetCount(); i++) { Kernel::Debug.WriteLine("CPU %d LOAD    %d/%d", i, RunQueues[i].DeadlineLoad, THREAD_DEADLINE_LOAD); }
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // share of all processors each thread used since the last sample, the system figure is whatever the idle threads did not get
         void ThreadManager::CalculateCPUUsage()
         {
-            ulong total_tps;
+            TableLock.Acquire();
+            ChargeCycles(HAL::SMPManager::GetCurrent());
+            ulonglong now = Kernel::CPU.ReadCycles();
+            ulonglong cycles = (now - SampleStamp) * Kernel::SMP.GetCount();
+            uint ticks = Kernel::APICTimer.GetTicks() - SampleTicks;
+            uint idle  = IdleTicks - SampleIdle;
+            SampleStamp  = now;
+            SampleTicks += ticks;
+            SampleIdle  += idle;
 
-            // calculate usage of each thread
             for (uint i = 0; i < MaxCount; i++)
             {
-                if (Threads[i] != nullptr)
-                {
-                    if (Threads[i] != Kernel::IdleThread) { total_tps += Threads[i]->GetTPS(); }
-                    Threads[i]->CPUUsage = 0.0f;
-                }
+                Thread* t = Threads[i];
+                if (t == nullptr) { continue; }
+                ulonglong used = t->Cycles - t->SampleCycles;
+                t->SampleCycles = t->Cycles;
+                t->CPUUsage = (cycles == 0) ? 0.0f : ((float)used * 100.0f) / (float)cycles;
             }
 
-            // calculate total usage
-            long double val = (long double)total_tps / (long double)Kernel::IdleThread->GetTPS();
+            float idleUsage = 0.0f;
+            for (uint i = 0; i < Kernel::SMP.GetCount(); i++)
+            {
+                Thread* t = Kernel::SMP.Get(i)->IdleThread;
+                if (t != nullptr) { idleUsage += t->CPUUsage; }
+            }
+            TableLock.Release();
 
-            CPUUsage = ((float)val * 100);
-            if (CPUUsage < 0.0f)   { CPUUsage = 0.0f; }
-            if (CPUUsage > 100.0f) { CPUUsage = 100.0f; }
+            // without a time stamp counter only the idle share of ticks on the boot processor is known
+            if (cycles > 0 && Kernel::IdleThread != nullptr) { CPUUsage = 100.0f - idleUsage; }
+            else if (ticks > 0) { CPUUsage = 100.0f - (((float)(idle > ticks ? ticks : idle) * 100.0f) / (float)ticks); }
+            if (CPUUsage < 0.0f) { CPUUsage = 0.0f; }
+        }
+
+        // usage as a percentage with one decimal, e.g. 12.5%
+        char* ThreadManager::FormatUsage(float usage, char* text)
+        {
+            char temp[16];
+            uint tenths = (usage <= 0.0f) ? 0 : (uint)(usage * 10.0f + 0.5f);
+            StringUtil::Clear(text);
+            StringUtil::Append(text, StringUtil::FromDecimal(tenths / 10, temp));
+            StringUtil::Append(text, ".");
+            StringUtil::Append(text, StringUtil::FromDecimal(tenths % 10, temp));
+            StringUtil::Append(text, "%");
+            return text;
         }
 
         // terminate thread by pointer
@@ -141,15 +338,18 @@ namespace PMOS
             if (thread == nullptr) { return false; }
 
             // loop through list
+            TableLock.Acquire();
             for (uint i = 0; i < MaxCount; i++)
             {
                 // located thread - terminate and return success
                 if (Threads[i] == thread)
                 {
                     Threads[i]->Stop();
+                    TableLock.Release();
                     return true;
                 }
             }
+            TableLock.Release();
             
             // unable to locate thread in list
             return false;
@@ -162,15 +362,18 @@ namespace PMOS
             if (index < 0 || index >= MaxCount) { return false; }
 
             // loop through list
+            TableLock.Acquire();
             for (uint i = 0; i < MaxCount; i++)
             {
                 // located thread - terminate and return success
                 if (Threads[i] != nullptr && i == index)
                 {
                     Threads[i]->Stop();
+                    TableLock.Release();
                     return true;
                 }
             }
+            TableLock.Release();
 
             // unable to locate thread in list
             return false;
@@ -184,15 +387,18 @@ namespace PMOS
             if (StringUtil::Length(name) == 0) { return false; }
 
             // loop through list
+            TableLock.Acquire();
             for (uint i = 0; i < MaxCount; i++)
             {
                 // located thread - terminate and return success
                 if (Threads[i] != nullptr && StringUtil::Equals(Threads[i]->Properties.Name, name))
                 {
                     Threads[i]->Stop();
+                    TableLock.Release();
                     return true;
                 }
             }
+            TableLock.Release();
 
             // unable to locate thread in list
             return false;
@@ -205,7 +411,7 @@ namespace PMOS
             if (name == nullptr) { return false; }
             if (StringUtil::Length(name) == 0) { return false; }
 
-            Kernel::InterruptMgr.DisableInterrupts();
+            TableLock.Acquire();
 
             // loop through list
             ushort del = 0;
@@ -219,7 +425,7 @@ namespace PMOS
                 }
             }
 
-            Kernel::InterruptMgr.EnableInterrupts();
+            TableLock.Release();
 
             // unable to locate thread in list
             if (del > 0) { return true; }
@@ -235,8 +441,10 @@ namespace PMOS
             Kernel::Debug.WriteUnformatted("THREADS", Col4::Green);
             Kernel::Debug.WriteUnformatted(" -----------------------------------");
             Kernel::Debug.NewLine();
-            Kernel::Debug.WriteUnformatted("ID          PRIORITY      STATE      STACK       NAME\n", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("ID          PRIORITY      STATE      CORE   STACK       CPU       TIME(ms)    NAME\n", Col4::DarkGray);
 
+            CalculateCPUUsage();
+            TableLock.Acquire();
             for (size_t i = 0; i < MaxCount; i++)
             {
                 if (Threads[i] == nullptr) { continue; }
@@ -244,11 +452,25 @@ namespace PMOS
                 Kernel::Debug.Write("0x%8x  ", (uint)Threads[i]->GetID());
                 Kernel::Debug.Write("0x%2x          ", (uint)Threads[i]->GetPriority());
                 Kernel::Debug.Write("0x%2x       ", (uint)Threads[i]->GetState());
+                Kernel::Debug.Write("%d      ", Threads[i]->GetCPU());
                 Kernel::Debug.Write("0x%8x  ", (uint)Threads[i]->StackSize);
+
+                char temp[16];
+                FormatUsage(Threads[i]->GetCPUUsage(), temp);
+                Kernel::Debug.WriteUnformatted(temp);
+                for (uint j = StringUtil::Length(temp); j < 10; j++) { Kernel::Debug.WriteChar(' '); }
+                StringUtil::FromDecimal(Threads[i]->GetCPUTime(), temp);
+                Kernel::Debug.WriteUnformatted(temp);
+                for (uint j = StringUtil::Length(temp); j < 12; j++) { Kernel::Debug.WriteChar(' '); }
+
                 Kernel::Debug.Write("%s", Threads[i]->GetName());
                 Kernel::Debug.NewLine();
             }
+            TableLock.Release();
 
+            char usage[16];
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("CPU USAGE     %s", FormatUsage(CPUUsage, usage));
             Kernel::Debug.NewLine();
             Kernel::Debug.SetMode(oldMode);
         }
@@ -256,49 +478,495 @@ namespace PMOS
         // get total cpu usage
         float ThreadManager::GetCPUUsage() { return CPUUsage; }
 
-        // handle thread switching
-        int PriorityTick;
+        // handle thread switching - the current thread keeps the cpu until its slice runs out or a higher priority thread is ready
         void ThreadManager::Schedule(uint* regs)
         {
-            // call primary pit callback method
-            Kernel::PITCallback(regs);
-            
+            ThreadManager* mgr = &Kernel::ThreadMgr;
+            HAL::Processor* cpu = HAL::SMPManager::GetCurrent();
+
+            // every processor ticks on its own timer, the boot processor's tick also keeps the time
+            if (cpu->Index == 0)
+            {
+                Kernel::TimerCallback(regs);
+
+                // ticks are charged to whoever held the cpu, a tickless idle stretch arrives as one large step
+                uint ticks = Kernel::APICTimer.GetTicks();
+                if (cpu->CurrentThread != nullptr && cpu->CurrentThread == cpu->IdleThread) { mgr->IdleTicks += ticks - mgr->LastTick; }
+                mgr->LastTick = ticks;
+            }
+
+            // frames for stack faults are taken from the allocator here, never from the fault itself
+            Kernel::Paging.Refill();
+
+            // idle processors sleep without a tick, one of them is woken when this one has more ready than it can run
+            if (mgr->RunQueues[cpu->Index].ReadyCount > 2)
+            {
+                for (uint i = 0; i < Kernel::SMP.GetCount(); i++)
+                {
+                    HAL::Processor* other = Kernel::SMP.Get(i);
+                    if (other == cpu || other->CurrentThread != other->IdleThread || other->Timer == HAL::TimerMode::Periodic) { continue; }
+                    Kernel::APIC.SendIPI(other->APICID, IRQ_SCHEDULE);
+                    break;
+                }
+            }
+
+            Reschedule(regs, false);
+        }
+
+        void ThreadManager::ScheduleCallback(uint* regs) { Reschedule(regs, false); }
+
+        // give up the rest of the slice, or the cpu entirely if the current thread just blocked
+        void ThreadManager::Yield() { asm volatile("int $0x81" : : : "memory"); }
+
+        void ThreadManager::YieldCallback(uint* regs) { Reschedule(regs, true); }
+
+        // idle thread body - halt until the next interrupt, and with nothing else ready stop the tick until the next timer is due
+        void ThreadManager::Idle()
+        {
+            uint flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            HAL::Processor* cpu = HAL::SMPManager::GetCurrent();
+            RunQueue* rq = &RunQueues[cpu->Index];
+
+            // the pool is topped up while there is nothing better to do, with interrupts back on
+            if (cpu->Index == 0 && Pool.Count < Pool.LowWater)
+            {
+                if (flags & 0x200) { asm volatile("sti"); }
+                FillPool();
+                return;
+            }
+
+            // this is the idle thread's own stack, the thread switched away from is free to move without waiting for another tick
+            if (cpu->Previous != nullptr) { cpu->Previous->OnCPU = false; cpu->Previous = nullptr; }
+            Reap(rq);
+
+            // halting while other threads are ready would waste their share of the round - a deadline thread out of budget only runs again in its next period
+            rq->Lock.Acquire();
+            uint ready = rq->ReadyCount;
+            for (Thread* t = rq->Deadlines; t != nullptr; t = t->QueueNext) { if (t->Remaining == 0) { ready--; } }
+            rq->Lock.Release();
+            if (ready > 1)
+            {
+                if (flags & 0x200) { asm volatile("sti"); }
+                Yield();
+                return;
+            }
+
+            // application processors keep neither the time nor timers, they sleep with the tick off until an ipi brings work - unless halted threads still wait to be released
+            // or a throttled deadline thread waits for its next period, which only a tick notices
+            if (cpu->Index != 0) { if (rq->Reaping == nullptr && rq->DeadlineCount == 0) { Kernel::APICTimer.Stop(); } }
+            else
+            {
+                // the boot processor keeps the clock the others read, so it only stops ticking while all of them are idle too
+                bool tickless = rq->DeadlineCount == 0;
+                for (uint i = 1; i < Kernel::SMP.GetCount() && tickless; i++)
+                {
+                    HAL::Processor* ap = Kernel::SMP.Get(i);
+                    if (ap->CurrentThread != ap->IdleThread || RunQueues[i].ReadyCount > 1) { tickless = false; }
+                }
+                if (tickless) { Kernel::APICTimer.SetOneShot(Kernel::TimerMgr.GetNextDeadline(APIC_TIMER_ONESHOT_MAX)); }
+            }
+
+            asm volatile("sti; hlt; cli" : : : "memory");
+            Kernel::APICTimer.Resume();
+
+            if (flags & 0x200) { asm volatile("sti"); }
+        }
+
+        // the calling thread, read in one instruction so a move to another processor halfway cannot mix two of them up
+        Thread* ThreadManager::GetCurrentThread() { return HAL::SMPManager::GetCurrentThread(); }
+
+        uint ThreadManager::GetReadyCount(uint cpu) { return (cpu < SMP_MAX_CPUS) ? RunQueues[cpu].ReadyCount : 0; }
+
+        // park the current thread on a wait queue - the caller holds the guard, which is only dropped once the thread is queued so a wake cannot slip in between
+        void ThreadManager::Block(WaitQueue* queue, Spinlock* guard)
+        {
+            Thread* t = GetCurrentThread();
+            if (t == nullptr || Kernel::InterruptMgr.InInterrupt()) { guard->Release(); Kernel::Debug.Panic("Attempted to block outside of a thread"); return; }
+
+            t->WaitNext = nullptr;
+            if (queue->Tail != nullptr) { queue->Tail->WaitNext = t; } else { queue->Head = t; }
+            queue->Tail  = t;
+            t->Waiting   = queue;
+            t->WaitGuard = guard;
+            t->SetState(ThreadState::Blocked);
+            guard->Release();
+
+            while (t->Properties.State == ThreadState::Blocked) { Yield(); }
+        }
+
+        // make the first waiter ready again, the caller holds the guard of the queue
+        Thread* ThreadManager::WakeOne(WaitQueue* queue)
+        {
+            Thread* t = queue->Head;
+            if (t == nullptr) { return nullptr; }
+
+            queue->Head = t->WaitNext;
+            if (queue->Head == nullptr) { queue->Tail = nullptr; }
+            t->WaitNext  = nullptr;
+            t->Waiting   = nullptr;
+            t->WaitGuard = nullptr;
+            if (t->Properties.State == ThreadState::Blocked) { t->SetState(ThreadState::Running); }
+            return t;
+        }
+
+        void ThreadManager::WakeAll(WaitQueue* queue) { while (WakeOne(queue) != nullptr); }
+
+        // take a stopped thread off whatever it was waiting on, under the guard of that queue since a waker may be on another processor
+        void ThreadManager::Unwait(Thread* t)
+        {
+            if (t == nullptr) { return; }
+
+            while (true)
+            {
+                Spinlock* guard = t->WaitGuard;
+                if (guard == nullptr) { return; }
+
+                guard->Acquire();
+                if (t->WaitGuard != guard) { guard->Release(); continue; }
+
+                WaitQueue* queue = t->Waiting;
+                Thread* prev = nullptr;
+                for (Thread* w = queue->Head; w != nullptr; prev = w, w = w->WaitNext)
+                {
+                    if (w != t) { continue; }
+                    if (prev != nullptr) { prev->WaitNext = t->WaitNext; } else { queue->Head = t->WaitNext; }
+                    if (queue->Tail == t) { queue->Tail = prev; }
+                    break;
+                }
+                t->WaitNext  = nullptr;
+                t->Waiting   = nullptr;
+                t->WaitGuard = nullptr;
+                guard->Release();
+                return;
+            }
+        }
+
+        void ThreadManager::Reschedule(uint* regs, bool yield)
+        {
             // get registers from argument
             ISRRegs* r = (ISRRegs*)*regs;
-
-            // validate thread list
-            if (Kernel::ThreadMgr.Count == 0) { return; }
+            ThreadManager* mgr = &Kernel::ThreadMgr;
+            HAL::Processor* cpu = HAL::SMPManager::GetCurrent();
+            RunQueue* rq = &mgr->RunQueues[cpu->Index];
 
             // save registers
-            if (ThreadSwitchInit) 
-            { 
-                Kernel::ThreadMgr.Threads[Kernel::ThreadMgr.CurrentIndex]->Registers = r; 
+            if (cpu->CurrentThread != nullptr) { cpu->CurrentThread->Registers = r; }
+
+            // a processor woken from a stopped or one shot tick gets its periodic tick back before running anything
+            Kernel::APICTimer.Resume();
+
+            // the thread switched away from last time is off its stack by now, other processors may take it
+            if (cpu->Previous != nullptr) { cpu->Previous->OnCPU = false; cpu->Previous = nullptr; }
+
+            // the outgoing thread pays for everything up to here, interrupt time included
+            mgr->ChargeCycles(cpu);
+
+            // halted threads are released here, away from their own code
+            mgr->Reap(rq);
+
+            // charge the tick, an expired or yielding thread waits for the next round - a deadline thread only uses up its budget
+            rq->Lock.Acquire();
+            Thread* current = cpu->CurrentThread;
+            if (current != nullptr && current->Queued && current->QueueSet == THREAD_DEADLINE_SET)
+            {
+                if (!yield && current->Remaining > 0) { current->Remaining--; }
+            }
+            else if (current != nullptr && current->Queued && current->QueueSet == rq->Active)
+            {
+                if (current->Slice > 0) { current->Slice--; }
+                if (current->Slice == 0 || yield)
+                {
+                    mgr->Dequeue(rq, current);
+                    current->Slice = mgr->GetTimeSlice(current);
+                    mgr->Enqueue(rq, current, rq->Active ^ 1);
+                }
             }
 
-            Kernel::ThreadMgr.CurrentIndex++;
-            if (Kernel::ThreadMgr.CurrentIndex >= Kernel::ThreadMgr.Count) { Kernel::ThreadMgr.CurrentIndex = 0; }
+            // a processor left with nothing but its idle thread takes work from the busiest one
+            Thread* next = mgr->PickNext(rq);
+            if ((next == nullptr || next == cpu->IdleThread) && rq->ReadyCount <= 1)
+            {
+                Thread* stolen = mgr->Steal(cpu, rq);
+                if (stolen != nullptr) { next = stolen; }
+            }
+            rq->Lock.Release();
+            if (next == nullptr || next == current) { return; }
+
+            // the outgoing thread stays marked until this processor has left its stack
+            if (current != nullptr) { cpu->Previous = current; }
+            next->OnCPU = true;
+            cpu->CurrentThread = next;
+            *regs = (uint)next->Registers;
+
+            // the fpu keeps the last user's registers, any other thread traps on its first fpu instruction
+            if (next == cpu->FPUOwner) { asm volatile("clts"); }
+            else { asm volatile("mov %%cr0, %%eax; or $0x08, %%eax; mov %%eax, %%cr0" : : : "eax"); }
+        }
 
-            // get next thread
-            Thread* next = Kernel::ThreadMgr.Threads[Kernel::ThreadMgr.CurrentIndex];
-            if (next == nullptr) { return; }
+        void ThreadManager::ChargeCycles(HAL::Processor* cpu)
+        {
+            ulonglong now = Kernel::CPU.ReadCycles();
+            if (cpu->CurrentThread != nullptr) { cpu->CurrentThread->Cycles += now - cpu->SwitchStamp; }
+            cpu->SwitchStamp = now;
+        }
+
+        // unload halted threads of this processor that no processor is running on any more
+        void ThreadManager::Reap(RunQueue* rq)
+        {
+            if (rq->Reaping == nullptr) { return; }
 
-            // check if thread has halted
-            if (next->GetState() == ThreadState::Halted)
+            rq->Lock.Acquire();
+            Thread* list = nullptr;
+            Thread** link = &rq->Reaping;
+            while (*link != nullptr)
             {
-                Kernel::ThreadMgr.Unload(next);
-                Schedule(regs);
-                return;
+                Thread* t = *link;
+                if (t->OnCPU) { link = &t->ReapNext; continue; }
+                *link = t->ReapNext;
+                t->Reaping  = false;
+                t->ReapNext = list;
+                list = t;
+            }
+            rq->Lock.Release();
+
+            while (list != nullptr)
+            {
+                Thread* t = list;
+                list = t->ReapNext;
+                Unload(t);
+            }
+        }
+
+        // move a thread on or off the ready queues after a state change
+        void ThreadManager::UpdateQueue(Thread* t)
+        {
+            if (t == nullptr) { return; }
+
+            RunQueue* rq = LockQueue(t);
+            bool woken = false;
+            if (t->Properties.State == ThreadState::Running)
+            {
+                if (!t->Queued) { t->Slice = GetTimeSlice(t); Enqueue(rq, t, rq->Active); woken = true; }
             }
-            // check if thread has paused
-            else if (next->GetState() == ThreadState::Paused)
+            else
+            {
+                if (t->Queued) { Dequeue(rq, t); }
+                if (t->Properties.State == ThreadState::Halted && !t->Reaping)
+                {
+                    t->Reaping  = true;
+                    t->ReapNext = rq->Reaping;
+                    rq->Reaping = t;
+                }
+            }
+            uint index = t->CPU;
+            rq->Lock.Release();
+
+            // an idle processor halts without a tick of its own, so it has to be told about new work
+            if (!woken || index == HAL::SMPManager::GetIndex()) { return; }
+            HAL::Processor* cpu = Kernel::SMP.Get(index);
+            if (cpu != nullptr && cpu->CurrentThread == cpu->IdleThread) { Kernel::APIC.SendIPI(cpu->APICID, IRQ_SCHEDULE); }
+        }
+
+        // lock the run queue a thread is on, it can be stolen by another processor until the lock is held
+        RunQueue* ThreadManager::LockQueue(Thread* t)
+        {
+            while (true)
             {
-                Schedule(regs);
+                uint index = t->CPU;
+                RunQueue* rq = &RunQueues[index];
+                rq->Lock.Acquire();
+                if (t->CPU == index) { return rq; }
+                rq->Lock.Release();
+            }
+        }
+
+        void ThreadManager::Enqueue(RunQueue* rq, Thread* t, uint set)
+        {
+            if (t->Period > 0) { EnqueueDeadline(rq, t); return; }
+
+            uint prio = (uint)t->Properties.Priority;
+            ThreadQueue* queue = &rq->Queues[set][prio];
+            t->QueueNext = nullptr;
+            t->QueuePrev = queue->Tail;
+            if (queue->Tail != nullptr) { queue->Tail->QueueNext = t; } else { queue->Head = t; }
+            queue->Tail = t;
+            t->QueueSet = set;
+            t->Queued   = true;
+            rq->ReadyCount++;
+            rq->ReadyMask[set] |= (1 << prio);
+        }
+
+        void ThreadManager::Dequeue(RunQueue* rq, Thread* t)
+        {
+            if (t->QueueSet == THREAD_DEADLINE_SET) { DequeueDeadline(rq, t); return; }
+
+            uint prio = (uint)t->Properties.Priority;
+            ThreadQueue* queue = &rq->Queues[t->QueueSet][prio];
+            if (t->QueuePrev != nullptr) { t->QueuePrev->QueueNext = t->QueueNext; } else { queue->Head = t->QueueNext; }
+            if (t->QueueNext != nullptr) { t->QueueNext->QueuePrev = t->QueuePrev; } else { queue->Tail = t->QueuePrev; }
+            if (queue->Head == nullptr) { rq->ReadyMask[t->QueueSet] &= ~(1 << prio); }
+            t->QueueNext = t->QueuePrev = nullptr;
+            t->Queued = false;
+            rq->ReadyCount--;
+        }
+
+        // head of the highest non-empty active queue, the sets swap once every ready thread has had its slice
+        Thread* ThreadManager::PickNext(RunQueue* rq)
+        {
+            Thread* deadline = PickDeadline(rq);
+            if (deadline != nullptr) { return deadline; }
+
+            if (rq->ReadyMask[rq->Active] == 0) { rq->Active ^= 1; }
+            if (rq->ReadyMask[rq->Active] == 0) { return nullptr; }
+            uint prio = 31 - __builtin_clz(rq->ReadyMask[rq->Active]);
+            return rq->Queues[rq->Active][prio].Head;
+        }
+
+        // deadline threads with budget left go before every priority, earliest deadline first - a thread whose deadline passed gets a new period and budget
+        Thread* ThreadManager::PickDeadline(RunQueue* rq)
+        {
+            if (rq->Deadlines == nullptr) { return nullptr; }
+
+            uint now = (uint)Kernel::Clock.GetMilliseconds();
+            Thread* due = nullptr;
+            Thread** link = &rq->Deadlines;
+            while (*link != nullptr)
+            {
+                Thread* t = *link;
+                if ((int)(now - t->Deadline) < 0) { link = &t->QueueNext; continue; }
+
+                // ready with budget left at its deadline means it did not get its share in time
+                if (t->Remaining > 0) { t->Misses++; }
+                *link = t->QueueNext;
+                t->QueueNext = due;
+                due = t;
+                rq->DeadlineCount--;
+                rq->ReadyCount--;
+            }
+
+            while (due != nullptr)
+            {
+                Thread* t = due;
+                due = t->QueueNext;
+                EnqueueDeadline(rq, t);
+            }
+
+            for (Thread* t = rq->Deadlines; t != nullptr; t = t->QueueNext) { if (t->Remaining > 0) { return t; } }
+            return nullptr;
+        }
+
+        // keep the list sorted by deadline, a thread waking with more budget than fits before its deadline starts a new period instead
+        void ThreadManager::EnqueueDeadline(RunQueue* rq, Thread* t)
+        {
+            uint now  = (uint)Kernel::Clock.GetMilliseconds();
+            int  left = (int)(t->Deadline - now);
+            if (left <= 0 || (ulonglong)t->Remaining * t->Period > (ulonglong)left * t->Budget)
+            {
+                t->Deadline  = now + t->Period;
+                t->Remaining = t->Budget;
+            }
+
+            Thread** link = &rq->Deadlines;
+            while (*link != nullptr && (int)((*link)->Deadline - t->Deadline) <= 0) { link = &(*link)->QueueNext; }
+            t->QueueNext = *link;
+            t->QueuePrev = nullptr;
+            *link = t;
+            t->QueueSet = THREAD_DEADLINE_SET;
+            t->Queued   = true;
+            rq->DeadlineCount++;
+            rq->ReadyCount++;
+        }
+
+        void ThreadManager::DequeueDeadline(RunQueue* rq, Thread* t)
+        {
+            Thread** link = &rq->Deadlines;
+            while (*link != nullptr && *link != t) { link = &(*link)->QueueNext; }
+            if (*link == t) { *link = t->QueueNext; rq->DeadlineCount--; rq->ReadyCount--; }
+            t->QueueNext = nullptr;
+            t->Queued    = false;
+        }
+
+        // move the highest priority waiting thread of the busiest processor over - the caller holds its own queue, the other one is only tried so two thieves cannot deadlock
+        Thread* ThreadManager::Steal(HAL::Processor* cpu, RunQueue* rq)
+        {
+            // a queue of the idle thread, the running thread and one more is the least worth taking from
+            uint victim = cpu->Index;
+            uint most   = 2;
+            for (uint i = 0; i < Kernel::SMP.GetCount(); i++)
+            {
+                if (i != cpu->Index && RunQueues[i].ReadyCount > most) { most = RunQueues[i].ReadyCount; victim = i; }
+            }
+            if (victim == cpu->Index) { return nullptr; }
+
+            RunQueue* from = &RunQueues[victim];
+            if (!from->Lock.TryAcquire()) { return nullptr; }
+
+            // threads still on a stack, pinned ones and the one whose registers are in the other fpu stay where they are
+            Thread* owner  = Kernel::SMP.Get(victim)->FPUOwner;
+            Thread* stolen = nullptr;
+            for (uint s = 0; s < 2 && stolen == nullptr; s++)
+            {
+                uint set = from->Active ^ s;
+                for (int prio = THREAD_PRIORITIES - 1; prio >= 0 && stolen == nullptr; prio--)
+                {
+                    for (Thread* t = from->Queues[set][prio].Head; t != nullptr; t = t->QueueNext)
+                    {
+                        if (t->Pinned || t->OnCPU || t == owner) { continue; }
+                        stolen = t;
+                        break;
+                    }
+                }
+            }
+
+            if (stolen != nullptr)
+            {
+                Dequeue(from, stolen);
+                stolen->CPU   = cpu->Index;
+                stolen->Slice = GetTimeSlice(stolen);
+                Enqueue(rq, stolen, rq->Active);
+                cpu->Steals++;
+            }
+            from->Lock.Release();
+            return stolen;
+        }
+
+        uint ThreadManager::GetTimeSlice(Thread* t)
+        {
+            uint ticks = (TimeSlices[(uint)t->Properties.Priority] * Kernel::APICTimer.GetFrequency()) / 1000;
+            return (ticks == 0) ? 1 : ticks;
+        }
+
+        // #NM handler - save the previous owner's fpu state and load the current thread's, both belong to this processor
+        void ThreadManager::SwitchFPU(uint* regs)
+        {
+            UNUSED(regs);
+            asm volatile("clts");
+
+            HAL::Processor* cpu = HAL::SMPManager::GetCurrent();
+            Thread* thread = cpu->CurrentThread;
+            Thread* owner  = cpu->FPUOwner;
+            if (thread == owner) { return; }
+
+            bool fxsr = Kernel::CPU.Features.FXSR;
+            if (owner != nullptr && owner->FPUState != nullptr)
+            {
+                if (fxsr) { asm volatile("fxsave (%0)" : : "r"(FPU_STATE(owner)) : "memory"); }
+                else { asm volatile("fnsave (%0)" : : "r"(FPU_STATE(owner)) : "memory"); }
+            }
+            cpu->FPUOwner = thread;
+
+            // first use - start from a clean fpu, the save area was allocated with the thread since the heap may be locked right now
+            if (thread == nullptr || !thread->FPUUsed || thread->FPUState == nullptr)
+            {
+                if (thread != nullptr) { thread->FPUUsed = true; }
+                asm volatile("fninit");
+                if (Kernel::CPU.Instructions.SSE) { uint mxcsr = 0x1F80; asm volatile("ldmxcsr %0" : : "m"(mxcsr)); }
                 return;
             }
 
-            Kernel::ThreadMgr.CurrentThread = next;
-            *regs = (uint)Kernel::ThreadMgr.CurrentThread->Registers;
-            ThreadSwitchInit = true;
+            if (fxsr) { asm volatile("fxrstor (%0)" : : "r"(FPU_STATE(thread)) : "memory"); }
+            else { asm volatile("frstor (%0)" : : "r"(FPU_STATE(thread)) : "memory"); }
         }
 
         // get next available spot in thread array
@@ -313,5 +981,16 @@ namespace PMOS
             // return invalid index
             return 0xFFFFFFFF;
         }
+
+        // online processor with the fewest ready threads, new threads start there
+        uint ThreadManager::GetIdlestCPU()
+        {
+            uint best = 0;
+            for (uint i = 1; i < Kernel::SMP.GetCount(); i++)
+            {
+                if (RunQueues[i].ReadyCount < RunQueues[best].ReadyCount) { best = i; }
+            }
+            return best;
+        }
     }
-}
\ No newline at end of file
+}
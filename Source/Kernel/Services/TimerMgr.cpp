@@ -0,0 +1,189 @@
+#include <Kernel/Services/TimerMgr.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace Services
+    {
+        void TimerManager::Initialize()
+        {
+            Memory::Set(Root, 0, sizeof(Root));
+            Memory::Set(Levels, 0, sizeof(Levels));
+            Now   = (uint)Kernel::APICTimer.GetTotalMilliseconds();
+            Count = 0;
+            Firing = nullptr;
+            WheelLock.Initialize("timers");
+
+            Kernel::Debug.OK("Initialized timer wheel");
+        }
+
+        // called from the timer callback - run every millisecond the wheel has not caught up on yet
+        void TimerManager::Tick(uint ms)
+        {
+            WheelLock.Acquire();
+            while ((int)(ms - Now) >= 0)
+            {
+                // a finished lap of a wheel pulls the next slot of the level above down into it
+                uint index = Now & (TIMER_ROOT_SLOTS - 1);
+                if (index == 0) { for (uint l = 0; l < TIMER_LEVELS && Cascade(l) == 0; l++); }
+                Now++;
+
+                // detach the slot first, a periodic timer may land back in it
+                KernelTimer* expired = Root[index];
+                Root[index] = nullptr;
+                for (KernelTimer* t = expired; t != nullptr; t = t->Next) { t->Slot = &expired; }
+
+                while (expired != nullptr)
+                {
+                    KernelTimer* timer = expired;
+                    Unlink(timer);
+                    if (timer->Period > 0) { timer->Expires += timer->Period; Insert(timer); }
+
+                    // callbacks may start and stop timers themselves, so the lock is dropped around them
+                    TimerCallback callback = timer->Callback;
+                    Firing    = timer;
+                    FiringCPU = HAL::SMPManager::GetIndex();
+                    WheelLock.Release();
+                    callback(timer);
+                    WheelLock.Acquire();
+                    Firing = nullptr;
+                }
+            }
+            WheelLock.Release();
+        }
+
+        void TimerManager::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("TIMERS", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" ------------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteUnformatted("EXPIRES     PERIOD      CALLBACK\n", Col4::DarkGray);
+
+            WheelLock.Acquire();
+            for (uint i = 0; i < TIMER_ROOT_SLOTS + (TIMER_LEVELS * TIMER_LEVEL_SLOTS); i++)
+            {
+                KernelTimer* timer = (i < TIMER_ROOT_SLOTS) ? Root[i] : Levels[(i - TIMER_ROOT_SLOTS) / TIMER_LEVEL_SLOTS][(i - TIMER_ROOT_SLOTS) % TIMER_LEVEL_SLOTS];
+                for (; timer != nullptr; timer = timer->Next)
+                {
+                    Kernel::Debug.Write("%d ms", timer->Expires - Now);
+                    Kernel::Debug.Write("    %d ms", timer->Period);
+                    Kernel::Debug.WriteLine("    0x%8x", (uint)timer->Callback);
+                }
+            }
+            WheelLock.Release();
+
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("PENDING       %d", Count);
+            Kernel::Debug.WriteLine("UPTIME        %d ms", Now);
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // fire once after at least ms milliseconds
+        void TimerManager::Start(KernelTimer* timer, uint ms, TimerCallback callback, void* data) { Arm(timer, ms, 0, callback, data); }
+
+        // fire every ms milliseconds, re-armed from its own expiry so it does not drift
+        void TimerManager::StartPeriodic(KernelTimer* timer, uint ms, TimerCallback callback, void* data)
+        {
+            Arm(timer, ms, (ms == 0) ? 1 : ms, callback, data);
+        }
+
+        // cancel a pending timer, returns false if it already fired or was never started
+        bool TimerManager::Stop(KernelTimer* timer)
+        {
+            if (timer == nullptr) { return false; }
+
+            WheelLock.Acquire();
+            bool pending = timer->Slot != nullptr;
+            if (pending) { Unlink(timer); }
+            WheelLock.Release();
+
+            // a callback still running on another processor may be using the timer's data, a callback stopping its own timer must not wait for itself
+            while (Firing == timer && FiringCPU != HAL::SMPManager::GetIndex()) { asm volatile("pause"); }
+            return pending;
+        }
+
+        bool TimerManager::IsPending(KernelTimer* timer) { return timer != nullptr && timer->Slot != nullptr; }
+
+        uint TimerManager::GetCount() { return Count; }
+
+        // milliseconds until the wheel next has work - a due slot or the end of the lap where the outer levels cascade
+        uint TimerManager::GetNextDeadline(uint limit)
+        {
+            WheelLock.Acquire();
+            uint lap = (TIMER_ROOT_SLOTS - (Now & (TIMER_ROOT_SLOTS - 1))) & (TIMER_ROOT_SLOTS - 1);
+            if (Count > 0 && limit > lap) { limit = lap; }
+
+            for (uint i = 0; i < limit && Count > 0; i++) { if (Root[(Now + i) & (TIMER_ROOT_SLOTS - 1)] != nullptr) { limit = i; break; } }
+            WheelLock.Release();
+            return limit;
+        }
+
+        void TimerManager::Arm(KernelTimer* timer, uint ms, uint period, TimerCallback callback, void* data)
+        {
+            if (timer == nullptr || callback == nullptr) { return; }
+
+            WheelLock.Acquire();
+            if (timer->Slot != nullptr) { Unlink(timer); }
+            timer->Expires  = Now + ms;
+            timer->Period   = period;
+            timer->Callback = callback;
+            timer->Data     = data;
+            Insert(timer);
+            WheelLock.Release();
+        }
+
+        // pick the level by distance to expiry and the slot by the expiry itself
+        void TimerManager::Insert(KernelTimer* timer)
+        {
+            uint delta = timer->Expires - Now;
+            KernelTimer** slot;
+
+            if ((int)delta < 0) { slot = &Root[Now & (TIMER_ROOT_SLOTS - 1)]; }
+            else if (delta < TIMER_ROOT_SLOTS) { slot = &Root[timer->Expires & (TIMER_ROOT_SLOTS - 1)]; }
+            else
+            {
+                uint expires = (delta > TIMER_MAX_DELAY) ? Now + TIMER_MAX_DELAY : timer->Expires;
+                uint level = 0;
+                while (level < TIMER_LEVELS - 1 && delta >= (1u << (TIMER_ROOT_BITS + ((level + 1) * TIMER_LEVEL_BITS)))) { level++; }
+                slot = &Levels[level][(expires >> (TIMER_ROOT_BITS + (level * TIMER_LEVEL_BITS))) & (TIMER_LEVEL_SLOTS - 1)];
+            }
+
+            timer->Prev = nullptr;
+            timer->Next = *slot;
+            if (*slot != nullptr) { (*slot)->Prev = timer; }
+            *slot = timer;
+            timer->Slot = slot;
+            Count++;
+        }
+
+        void TimerManager::Unlink(KernelTimer* timer)
+        {
+            if (timer->Prev != nullptr) { timer->Prev->Next = timer->Next; } else { *timer->Slot = timer->Next; }
+            if (timer->Next != nullptr) { timer->Next->Prev = timer->Prev; }
+            timer->Next = timer->Prev = nullptr;
+            timer->Slot = nullptr;
+            Count--;
+        }
+
+        // re-sort the current slot of a level into the levels below, returns the slot index so the caller knows if this level wrapped too
+        uint TimerManager::Cascade(uint level)
+        {
+            uint index = (Now >> (TIMER_ROOT_BITS + (level * TIMER_LEVEL_BITS))) & (TIMER_LEVEL_SLOTS - 1);
+            KernelTimer* list = Levels[level][index];
+            Levels[level][index] = nullptr;
+
+            while (list != nullptr)
+            {
+                KernelTimer* timer = list;
+                list = timer->Next;
+                Count--;
+                Insert(timer);
+            }
+            return index;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#include <Kernel/Services/WorkMgr.hpp>
+#include <Kernel/Core/Kernel.hpp>
+
+namespace PMOS
+{
+    namespace Services
+    {
+        // items can be deferred from here on, they run once the worker is started
+        void WorkManager::Initialize()
+        {
+            for (uint i = 0; i < WORK_QUEUE_SIZE; i++) { Items[i].Sequence = i; }
+            Head         = 0;
+            Tail         = 0;
+            Sleeping     = 0;
+            Worker       = nullptr;
+            Queued       = 0;
+            Executed     = 0;
+            Dropped      = 0;
+            Batches      = 0;
+            LargestBatch = 0;
+            Wakeup.Initialize("workqueue", 0);
+
+            Kernel::Debug.OK("Initialized work queue(%d slots)", WORK_QUEUE_SIZE);
+        }
+
+        // the worker runs above ordinary threads so deferred input is handled before whatever it interrupted
+        void WorkManager::Start()
+        {
+            Worker = Kernel::ThreadMgr.Create("workqueue", 16384, ThreadPriority::High, WorkerMain);
+            Worker->Start();
+        }
+
+        // claim a slot, fill it and publish it - interrupts stay on throughout, false if the ring is full
+        bool WorkManager::Defer(WorkCallback callback, void* data, uint arg)
+        {
+            if (callback == nullptr) { return false; }
+
+            uint pos = Head;
+            WorkItem* item;
+            while (true)
+            {
+                item = &Items[pos & (WORK_QUEUE_SIZE - 1)];
+                int diff = (int)(__atomic_load_n(&item->Sequence, __ATOMIC_ACQUIRE) - pos);
+
+                // the slot still holds an item from one lap ago
+                if (diff < 0) { __atomic_fetch_add(&Dropped, 1, __ATOMIC_RELAXED); return false; }
+                if (diff == 0)
+                {
+                    uint seen = __sync_val_compare_and_swap(&Head, pos, pos + 1);
+                    if (seen == pos) { break; }
+                    pos = seen;
+                }
+                else { pos = Head; }
+            }
+
+            item->Callback = callback;
+            item->Data     = data;
+            item->Arg      = arg;
+            __atomic_store_n(&item->Sequence, pos + 1, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&Queued, 1, __ATOMIC_RELAXED);
+
+            // only the producer that finds the worker asleep signals it, the rest just queue
+            if (__sync_lock_test_and_set(&Sleeping, 0)) { Wakeup.Signal(); }
+            return true;
+        }
+
+        // items published but not yet taken, a slot claimed and still being filled does not count
+        uint WorkManager::GetPending() { return Queued - Executed; }
+
+        void WorkManager::Print(DebugMode mode)
+        {
+            DebugMode oldMode = Kernel::Debug.Mode;
+            Kernel::Debug.SetMode(mode);
+            Kernel::Debug.WriteUnformatted("-------- ", Col4::DarkGray);
+            Kernel::Debug.WriteUnformatted("WORK QUEUE", Col4::Green);
+            Kernel::Debug.WriteUnformatted(" --------------------------------");
+            Kernel::Debug.NewLine();
+            Kernel::Debug.WriteLine("PENDING       %d/%d", GetPending(), WORK_QUEUE_SIZE);
+            Kernel::Debug.WriteLine("QUEUED        %d", Queued);
+            Kernel::Debug.WriteLine("EXECUTED      %d", Executed);
+            Kernel::Debug.WriteLine("DROPPED       %d", Dropped);
+            Kernel::Debug.WriteLine("BATCHES       %d(largest = %d)", Batches, LargestBatch);
+            Kernel::Debug.NewLine();
+            Kernel::Debug.SetMode(oldMode);
+        }
+
+        // only the worker takes items, so the tail needs no atomic update
+        bool WorkManager::Take(WorkItem* item)
+        {
+            uint pos = Tail;
+            WorkItem* slot = &Items[pos & (WORK_QUEUE_SIZE - 1)];
+            if (__atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) != pos + 1) { return false; }
+
+            item->Callback = slot->Callback;
+            item->Data     = slot->Data;
+            item->Arg      = slot->Arg;
+            Tail = pos + 1;
+            __atomic_store_n(&slot->Sequence, pos + WORK_QUEUE_SIZE, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        bool WorkManager::IsEmpty()
+        {
+            WorkItem* slot = &Items[Tail & (WORK_QUEUE_SIZE - 1)];
+            return __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) != Tail + 1;
+        }
+
+        // drain in batches, then sleep until a producer finds the worker asleep
+        void WorkManager::WorkerMain(Threading::Thread* t)
+        {
+            UNUSED(t);
+            WorkManager* mgr = &Kernel::WorkMgr;
+            while (true)
+            {
+                uint done = 0;
+                WorkItem item;
+                while (done < WORK_BATCH && mgr->Take(&item))
+                {
+                    item.Callback(item.Data, item.Arg);
+                    done++;
+                    __atomic_fetch_add(&mgr->Executed, 1, __ATOMIC_RELAXED);
+                }
+
+                if (done > 0)
+                {
+                    mgr->Batches++;
+                    if (done > mgr->LargestBatch) { mgr->LargestBatch = done; }
+                }
+                if (done == WORK_BATCH) { Kernel::ThreadMgr.Yield(); continue; }
+
+                // announce the sleep before the last look, an item published in between is then either seen here or signalled
+                __atomic_store_n(&mgr->Sleeping, 1, __ATOMIC_SEQ_CST);
+                if (mgr->IsEmpty()) { mgr->Wakeup.Wait(); continue; }
+
+                // a producer that already took the flag has signalled or is about to, that signal is consumed here
+                if (!__sync_lock_test_and_set(&mgr->Sleeping, 0)) { mgr->Wakeup.Wait(); }
+            }
+        }
+    }
+}
@@ -123,18 +123,8 @@ namespace PMOS
     
         bool Container::AddControl(Control* control)
         {
-            // temporary array
-            Control** temp = new Control*[ControlCount + 1];
-
-            // copy controls to temporary array
-            if (ControlCount > 0)
-            { for (size_t i = 0; i < ControlCount; i++) { temp[i] = Controls[i]; } }
-
-            // delete old array if exists
-            if (Controls != nullptr) { MemFree(Controls); }
-
-            // assign new array
-            Controls = temp;
+            // grow array
+            Controls = (Control**)MemRealloc(Controls, (ControlCount + 1) * sizeof(Control*));
 
             // add new control
             Controls[ControlCount] = control;
@@ -17,8 +17,7 @@ namespace PMOS
             if (parent == nullptr)
             {
                 Button* obj = new Button(x, y, text);
-                HeapEntry* entry = Kernel::MemoryMgr.GetEntryFromPtr(obj);
-                if (entry != nullptr) { entry->Type = (byte)AllocationType::UI; }
+                Kernel::MemoryMgr.SetType(obj, AllocationType::UI);
                 if (name != nullptr) { obj->SetName(name); } else { obj->SetName(text); }
                 Kernel::Debug.Info("Created new button: 0x%8x", (uint)obj);
                 return obj;
@@ -26,8 +25,7 @@ namespace PMOS
             else
             {
                 Button* obj = new Button(x, y, text, parent);
-                HeapEntry* entry = Kernel::MemoryMgr.GetEntryFromPtr(obj);
-                if (entry != nullptr) { entry->Type = (byte)AllocationType::UI; }
+                Kernel::MemoryMgr.SetType(obj, AllocationType::UI);
                 if (name != nullptr) { obj->SetName(name); } else { obj->SetName(text); }
                 Kernel::Debug.Info("Created new button: 0x%8x", (uint)obj);
                 return obj;
@@ -39,8 +37,7 @@ namespace PMOS
         Container* CreateContainer(int x, int y, int w, int h, char* name)
         {
             Container* obj = new Container(x, y, w, h);
-            HeapEntry* entry = Kernel::MemoryMgr.GetEntryFromPtr(obj);
-            if (entry != nullptr) { entry->Type = (byte)AllocationType::UI; }
+            Kernel::MemoryMgr.SetType(obj, AllocationType::UI);
             if (name != nullptr) { obj->SetName(name); }
             Kernel::Debug.Info("Created new container: 0x%8x", (uint)obj);
             return obj;
@@ -51,9 +48,12 @@ namespace PMOS
         Window* CreateWindow(int x, int y, int w, int h, char* title, char* name) { return CreateWindow(x, y, w, h, title, name, nullptr); }
         Window* CreateWindow(int x, int y, int w, int h, char* title, char* name, char* args)
         {
+            // everything the window allocates while being built lives in its arena
+            HeapArena* arena = Kernel::MemoryMgr.CreateArena(AllocationType::UI);
+            HeapArena* previous = Kernel::MemoryMgr.PushArena(arena);
             Window* obj = new Window(x, y, w, h, title, name, args);
-            HeapEntry* entry = Kernel::MemoryMgr.GetEntryFromPtr(obj);
-            if (entry != nullptr) { entry->Type = (byte)AllocationType::UI; }
+            Kernel::MemoryMgr.PopArena(previous);
+            obj->Arena = arena;
             Kernel::Debug.Info("Created new window: 0x%8x", (uint)obj);
             return obj;
         }
@@ -162,7 +162,9 @@ namespace PMOS
             ActiveWindow = win;
             ActiveIndex = GetWindowIndex(win);
             win->Flags.Focused = true;
+            HeapArena* previous = Kernel::MemoryMgr.PushArena(win->Arena);
             win->OnCreate();
+            Kernel::MemoryMgr.PopArena(previous);
             Kernel::Debug.Info("Opened window: %s", win->Name);
             return Windows[WindowCount - 1];
         }
@@ -180,8 +182,10 @@ namespace PMOS
                 {
                     Kernel::Debug.Info("Closed window: %s", win->Name);
                     if (ActiveIndex == i || ActiveWindow == win) { ActiveIndex = -1; ActiveWindow = nullptr; }
+                    HeapArena* arena = win->Arena;
                     win->Dispose();
                     MemFree(win);
+                    Kernel::MemoryMgr.ReleaseArena(arena);
                     Windows[i] = nullptr;
                     return true;
                 }
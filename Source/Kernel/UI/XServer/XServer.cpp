@@ -31,18 +31,26 @@ namespace PMOS
 
                 Canvas.Initialize();
                 FPSLimit = 60;
+                NextDraw = (uint)Kernel::Clock.GetMilliseconds();
                 
                 Wallpaper = new Graphics::Bitmap("/sys/resources/wallpaper.bmp");
                 Wallpaper->Resize(Kernel::VESA->GetWidth(), Kernel::VESA->GetHeight());
 
                 Taskbar = new XTaskbar();
-                Kernel::MemoryMgr.GetEntryFromPtr(Taskbar)->Type = (byte)AllocationType::UI;
+                Kernel::MemoryMgr.SetType(Taskbar, AllocationType::UI);
                 Taskbar->OnCreate();
+
+                // frames are drawn by a task on the ui loop, it sleeps between frames instead of polling - half of every frame period is reserved for it
+                if (FPSLimit > 0) { Kernel::UILoop.GetThread()->SetDeadline(1000 / FPSLimit, 500 / FPSLimit); }
+                Kernel::UILoop.Attach(&FrameTask, OnFrame, this);
+                Kernel::UILoop.Post(&FrameTask);
             }
 
             void XServerHost::Stop()
             {
                 Service::Stop();
+                Kernel::UILoop.Cancel(&FrameTask);
+                Kernel::UILoop.GetThread()->SetDeadline(0, 0);
 
                 Taskbar->Dispose();
                 MemFree(Taskbar);
@@ -53,7 +61,8 @@ namespace PMOS
                 MemFree(Canvas.Buffer);
             }
 
-            void XServerHost::Update()
+            // returns the milliseconds until the next frame is due
+            uint XServerHost::Update()
             {
                 Time = Kernel::RTC.GetSecond();
                 if (Time != LastTime)
@@ -72,13 +81,6 @@ namespace PMOS
                     LastTime = Time;
                 }
 
-                DrawTime = Kernel::PIT.GetMilliseconds();
-                if (DrawTime != LastDrawTime)
-                {
-                    DrawTick++;
-                    LastDrawTime = DrawTime;
-                }
-
                 // force quit
                 if (Kernel::Keyboard->IsKeyDown(HAL::Key::LeftCtrl) && Kernel::Keyboard->IsKeyDown(HAL::Key::Escape))
                 {
@@ -88,12 +90,27 @@ namespace PMOS
                     Kernel::VESA->ClearDirect(0);
                     Kernel::Terminal->Clear(Kernel::Terminal->GetBackColor());
                     Kernel::CLI->PrintCaret();
-                    return;
+                    return 0;
                 }
         
                 // draw
-                if (FPSLimit == 0) { Draw(); return; }
-                if (DrawTick >= 1000 / FPSLimit) { Draw(); DrawTick = 0; }
+                if (FPSLimit == 0) { Draw(); return 0; }
+
+                uint now = (uint)Kernel::Clock.GetMilliseconds();
+                if ((int)(NextDraw - now) > 0) { return NextDraw - now; }
+                NextDraw = now + (1000 / FPSLimit);
+                Draw();
+
+                now = (uint)Kernel::Clock.GetMilliseconds();
+                return ((int)(NextDraw - now) > 0) ? NextDraw - now : 0;
+            }
+
+            // unlimited frame rates still go through the loop, so other tasks get a turn between frames
+            void XServerHost::OnFrame(Services::LoopTask* task)
+            {
+                XServerHost* xserver = (XServerHost*)task->Data;
+                uint wait = xserver->Update();
+                if (xserver->IsStarted()) { Kernel::UILoop.Delay(task, wait); }
             }
 
             void XServerHost::Draw()
@@ -105,15 +122,25 @@ namespace PMOS
 
                 Canvas.DrawString(0, 0, FPSString, Colors::White, Fonts::Serif8x8);
 
-                float cpu = Kernel::ThreadMgr.GetCPUUsage();
                 char temp[64];
-                char temp2[64];
-                StringUtil::FromFloat(cpu, temp, 4);
+                char temp2[96];
                 StringUtil::Copy(temp2, "CPU: ");
-                StringUtil::Append(temp2, temp);
-                StringUtil::Append(temp2, "%");
+                StringUtil::Append(temp2, Threading::ThreadManager::FormatUsage(Kernel::ThreadMgr.GetCPUUsage(), temp));
                 Canvas.DrawString(0, 16, temp2, Colors::White, Fonts::Serif8x8);
 
+                // per thread share of the last usage sample
+                int y = 32;
+                for (uint i = 0; i < Kernel::ThreadMgr.MaxCount; i++)
+                {
+                    Threading::Thread* t = Kernel::ThreadMgr.Threads[i];
+                    if (t == nullptr) { continue; }
+                    StringUtil::Copy(temp2, t->GetName());
+                    StringUtil::Append(temp2, ": ");
+                    StringUtil::Append(temp2, Threading::ThreadManager::FormatUsage(t->GetCPUUsage(), temp));
+                    Canvas.DrawString(0, y, temp2, Colors::White, Fonts::Serif8x8);
+                    y += 10;
+                }
+
                 if (Taskbar != nullptr)
                 {
                     Taskbar->Update();
@@ -10,9 +10,21 @@ namespace PMOS
         void RuntimeHost::Initialize(char* name)
         {
             Name = name;
+
+            // vm memory is owned by the runtime and released with it
+            Arena = Kernel::MemoryMgr.CreateArena(AllocationType::VMRAM);
+            HeapArena* previous = Kernel::MemoryMgr.PushArena(Arena);
             BPU.Initialize();
             BPU.RAM.Initialize(512 * 1024);
-            Thread = Kernel::ThreadMgr.Create(name, 512 * 1024, ThreadPriority::Protected, ThreadMain);
+            Kernel::MemoryMgr.PopArena(previous);
+        }
+
+        void RuntimeHost::Dispose()
+        {
+            if (CurrentRuntime == this) { CurrentRuntime = nullptr; }
+            Kernel::MemoryMgr.ReleaseArena(Arena);
+            Arena = nullptr;
+            BPU.RAM.Data = nullptr;
         }
 
         void RuntimeHost::LoadTestProgram()
@@ -41,38 +53,25 @@ namespace PMOS
             Memory::Copy(BPU.RAM.Data, data, len);
         }
         
+        // the program is stepped by a task on the main loop, no thread or stack of its own
         void RuntimeHost::Run()
         {
             CurrentRuntime = this;
-            Thread->Start();
+            BPU.Continue();
+            Kernel::MainLoop.Attach(&StepTask, OnStep, this);
+            Kernel::MainLoop.Delay(&StepTask, 500);
         }
 
-        void RuntimeHost::ThreadMain(Threading::Thread* t)
+        // one instruction every 500 ms
+        void RuntimeHost::OnStep(Services::LoopTask* task)
         {
-            RuntimeHost* runtime = CurrentRuntime;
-            if (runtime == nullptr) { return; }
-            runtime->BPU.Continue();
-
-            int time, last_time, tick;
-            while (true)
-            {
-                t->CalculateTPS();
-
-                time = Kernel::PIT.GetTotalMilliseconds();
-                if (time != last_time)
-                {
-                    tick++;
-                    last_time = time;
-                }
-
-                if (tick >= 500)
-                {
-                    runtime->BPU.Step();
-                    tick = 0;
-                }
+            RuntimeHost* runtime = (RuntimeHost*)task->Data;
+            runtime->BPU.Step();
+            if (!runtime->BPU.IsHalted()) { Kernel::MainLoop.Delay(task, 500); return; }
 
-                if (!runtime->BPU.IsHalted()) { return; }
-            }
+            Kernel::MainLoop.Cancel(task);
+            runtime->Dispose();
+            MemFree(runtime);
         }
     }
 }
\ No newline at end of file